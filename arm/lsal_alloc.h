@@ -0,0 +1,124 @@
+#ifndef LSAL_ALLOC_H
+#define LSAL_ALLOC_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+/*
+ Arena for the DP matrices and kernel scratch rows.
+ The backing memory comes straight from mmap: explicit 2 MB huge pages when the system has
+ them reserved, otherwise regular pages advised for transparent huge pages. Nothing is zeroed
+ on our side since the kernels overwrite every cell, and an arena can be reset and reused
+ across calls without going back to the OS.
+ */
+
+#define LSAL_ALIGN 64
+#define LSAL_HUGE_PAGE (2UL << 20)
+
+#define LSAL_PAGES_NORMAL 0
+#define LSAL_PAGES_THP 1
+#define LSAL_PAGES_HUGETLB 2
+
+typedef struct {
+    char *base;     // start of the usable (2 MB aligned) region
+    size_t size;    // usable bytes
+    size_t used;    // bytes handed out since the last reset
+    void *map;      // what mmap returned, for munmap
+    size_t map_len;
+    int pages;      // LSAL_PAGES_*
+} lsal_arena_t;
+
+static inline size_t lsal_align_up(size_t n, size_t a) { return (n + a - 1) & ~(a - 1); }
+
+// a * b in 64 bits, returns 0 on overflow
+static inline int lsal_size_mul(size_t a, size_t b, size_t *out) {
+    return !__builtin_mul_overflow(a, b, out);
+}
+
+static inline int lsal_arena_map(lsal_arena_t *arena, size_t bytes) {
+    size_t len = lsal_align_up(bytes ? bytes : 1, LSAL_HUGE_PAGE);
+
+#ifdef MAP_HUGETLB
+    void *p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED) {
+        arena->map = p;
+        arena->map_len = len;
+        arena->base = (char *) p;
+        arena->size = len;
+        arena->pages = LSAL_PAGES_HUGETLB;
+        return 0;
+    }
+#endif
+
+    // Over-map by one huge page so the usable region can start on a 2 MB boundary
+    size_t map_len = len + LSAL_HUGE_PAGE;
+    char *m = (char *) mmap(NULL, map_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (m == MAP_FAILED) return -1;
+
+    char *base = (char *) lsal_align_up((uintptr_t) m, LSAL_HUGE_PAGE);
+
+    arena->map = m;
+    arena->map_len = map_len;
+    arena->base = base;
+    arena->size = len;
+    arena->pages = LSAL_PAGES_NORMAL;
+
+#ifdef MADV_HUGEPAGE
+    if (madvise(base, len, MADV_HUGEPAGE) == 0) arena->pages = LSAL_PAGES_THP;
+#endif
+
+    return 0;
+}
+
+static inline void lsal_arena_release(lsal_arena_t *arena) {
+    if (arena->map) munmap(arena->map, arena->map_len);
+    memset(arena, 0, sizeof(*arena));
+}
+
+/*
+ Makes sure the arena can hold at least `bytes`, remapping it if it is too small.
+ Everything previously handed out is invalidated. Returns 0 on success.
+ */
+static inline int lsal_arena_reserve(lsal_arena_t *arena, size_t bytes) {
+    arena->used = 0;
+    if (arena->map && arena->size >= bytes) return 0;
+
+    lsal_arena_release(arena);
+    return lsal_arena_map(arena, bytes);
+}
+
+static inline void lsal_arena_reset(lsal_arena_t *arena) { arena->used = 0; }
+
+// Bytes to reserve for count elements of elem_size, including alignment slack; 0 on overflow
+static inline size_t lsal_arena_bytes(size_t count, size_t elem_size) {
+    size_t bytes;
+    if (!lsal_size_mul(count, elem_size, &bytes) || bytes > SIZE_MAX - LSAL_ALIGN) return 0;
+    return lsal_align_up(bytes, LSAL_ALIGN);
+}
+
+/*
+ Returns uninitialized, LSAL_ALIGN aligned room for count elements of elem_size,
+ or NULL if the size overflows or the arena is exhausted.
+ */
+static inline void *lsal_arena_alloc(lsal_arena_t *arena, size_t count, size_t elem_size) {
+    size_t bytes = lsal_arena_bytes(count, elem_size);
+    if (bytes == 0 && count && elem_size) return NULL;
+    if (bytes > arena->size - arena->used) return NULL;
+
+    void *p = arena->base + arena->used;
+    arena->used += bytes;
+    return p;
+}
+
+static inline const char *lsal_arena_pages_name(const lsal_arena_t *arena) {
+    switch (arena->pages) {
+    case LSAL_PAGES_HUGETLB: return "hugetlb";
+    case LSAL_PAGES_THP: return "thp";
+    default: return "4k";
+    }
+}
+
+#endif
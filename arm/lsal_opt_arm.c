@@ -3,6 +3,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "lsal_alloc.h"
+
 #ifndef TEST
 #define TEST 0
 #endif
@@ -144,8 +146,8 @@ int main(int argc, char **argv) {
         return 1;
     }
 
-    int qlen = atoi(argv[1]);
-    int dlen = atoi(argv[2]);
+    size_t qlen = strtoull(argv[1], NULL, 10);
+    size_t dlen = strtoull(argv[2], NULL, 10);
 
     char *q = (char *) calloc(qlen + 1, sizeof(char));
     char *d = (char *) calloc(dlen + 1, sizeof(char));
@@ -153,8 +155,25 @@ int main(int argc, char **argv) {
     init_random_buf(q, qlen);
     init_random_buf(d, dlen);
 
-    int *similarity = (int *) calloc(qlen * dlen, sizeof(int));
-    char *direction = (char *) calloc(qlen * dlen, sizeof(char));
+    size_t cells;
+    if (!lsal_size_mul(qlen, dlen, &cells)) {
+        fprintf(stderr, "Matrix of %lu x %lu cells is too large\n", qlen, dlen);
+        return 1;
+    }
+
+    // The kernels write every cell, so the matrices are left uninitialized
+    lsal_arena_t arena = {0};
+    if (lsal_arena_reserve(&arena, lsal_arena_bytes(cells, sizeof(int)) + lsal_arena_bytes(cells, sizeof(char)))) {
+        fprintf(stderr, "Failed to map %lu cells\n", cells);
+        return 1;
+    }
+
+    int *similarity = (int *) lsal_arena_alloc(&arena, cells, sizeof(int));
+    char *direction = (char *) lsal_arena_alloc(&arena, cells, sizeof(char));
+    if (!similarity || !direction) {
+        fprintf(stderr, "Failed to allocate %lu cells\n", cells);
+        return 1;
+    }
     
     size_t max_idx;
     
@@ -191,8 +210,7 @@ int main(int argc, char **argv) {
     printf("Exection Time: %lfs\n", total_time_secs);
     #endif
 
-    free(similarity);
-    free(direction);
+    lsal_arena_release(&arena);
     free(q);
     free(d);
 
@@ -4,79 +4,298 @@
 #include <string.h>
 #include "lsal.h"
 
-#define N 32
-#define M 65536
-#define M_p (M + 2 * (N - 1))
-
 #define match 2
 #define mismatch -1
 #define gap_row -1
 #define gap_col -1
 
+// Affine gaps: the first position of a gap costs gap_open, every further one gap_extend
+#define gap_open -3
+#define gap_extend -1
+#define score_neg -16384                // E and F of cells outside the matrix
+
 #define DIR_D 1
 #define DIR_U 2
 #define DIR_L 3
 #define DIR_NONE 0
 
-void lsal_compute_matrices_aug(char *q,
-							   char *d,
-							   int *max_idx,
-							   char *direction)
+// Affine directions: the source of H in the low DIR_BITS, then whether E and F extend a gap
+#define AFF_E_EXT 4
+#define AFF_F_EXT 8
+
+/*
+ Systolic array of NP processing elements, run once per NP-column stripe of the query.
+ Within a stripe PE col handles query column s * NP + col, and PEs past the end of the
+ query are masked off (they output zero and never update the maximum). The database is
+ read from a buffer padded with NP - 1 characters in front and NP behind, and a PE is
+ masked the same way while it sits on that padding, so a query may contain the pad byte.
+
+ Every stripe is a DATAFLOW region of three stages connected by FIFOs:
+   lsal_load     reads the query and database in 512-bit bursts and streams characters
+   lsal_pe_array computes one anti-diagonal per cycle and streams its NP 2-bit directions
+   lsal_store    packs the directions into 512-bit words and writes them in bursts
+ so DDR latency is absorbed by the FIFOs instead of stalling the II=1 Round loop.
+
+ Between stripes the last active column of every database row is kept on chip, which
+ bounds m to M_MAX. Only a stripe with another one after it writes that column. The
+ running maximum is carried across stripes too.
+
+ Directions are packed DIR_BITS per cell, cell k of the buffer in bits 2 * (k % 4) of byte
+ k / 4. Stripe s starts at cell s * stripe_size, NP cells per anti-diagonal, where
+ stripe_size is NP * (m + NP - 1) rounded up to whole AXI words, and max_idx is a cell
+ index into that buffer. max_score is the score of that cell.
+
+ lsal_compute_score_aug is the same array without the store stage: it writes no directions
+ and returns max_idx as the row-major index row * n + col of the best cell, so the host can
+ rebuild the alignment from a small window ending there.
+
+ lsal_compute_batch_aug runs the score-only array over many database records in one launch.
+ Record r is d[offsets[r] .. offsets[r + 1]), packed back to back without padding: the
+ loader generates the padding itself. The array state is reset between records, and
+ record r gets results[2r] = best score and results[2r + 1] = row * n + col of its cell.
+
+ lsal_compute_lanes_aug aligns many queries of the same length n against one database.
+ LANES score-only arrays, each holding a different query, sit in one DATAFLOW region behind
+ a single loader that hands every database character to all of them in the same cycle, so
+ each byte read from DDR feeds LANES queries. Query k is stored at q + k * query_words
+ words, query_words being its stripes rounded up to whole AXI words. The queries go through
+ the lanes in groups of LANES, and query k gets results[2k] = best score and
+ results[2k + 1] = row * n + col of its cell, like a batch record.
+
+ lsal_compute_affine_aug is lsal_compute_matrices_aug with affine-gap PEs (see
+ lsal_pe_array_affine below). Its directions take AFF_BITS per cell, so its stripe_size is
+ counted in AFF_PER_WORD cells per word, and max_idx indexes that layout.
+
+ lsal_compute_hits_aug reports many local hits instead of the single best cell. Every PE
+ tracks the cells of its column scoring at least threshold: such cells no more than HIT_SPAN
+ rows apart form one region, represented by its best cell, and the PE keeps the HIT_K best
+ regions it has closed in registers. Nothing but the slots leaves the array, so after each
+ stripe the store stage writes NP * HIT_K entries { score, row * n + col }, column col's
+ slots at entries col * HIT_K .. col * HIT_K + HIT_K - 1 of the hits buffer. Unused slots
+ have a score of 0. Neighbouring columns see the same alignment, so the host still merges
+ hits lying on nearby diagonals.
+ */
+
+static int lsal_stripe_size(int np, int m, int per_word)
 {
-#pragma HLS TOP name=lsal_compute_matrices_aug
-#pragma HLS INTERFACE s_axilite port=max_idx
-#pragma HLS INTERFACE m_axi port=d bundle=hp0 offset=slave
-#pragma HLS INTERFACE m_axi port=q bundle=hp1 offset=slave
-#pragma HLS BIND_STORAGE variable=q type=ram_t2p impl=autosrl
-#pragma HLS BIND_STORAGE variable=d type=ram_t2p impl=autosrl
-#pragma HLS BIND_STORAGE variable=direction type=ram_t2p impl=autosrl
+    return (np * (m + np - 1) + per_word - 1) / per_word * per_word;
+}
+
+template <int NP>
+static void lsal_load_query(const axi_word_t *q, hls::stream<ap_uint<8 * NP> > &q_stream, int s)
+{
+    // The query stripe never straddles two words since NP divides AXI_BYTES (checked below)
+    axi_word_t q_word = q[s * NP / AXI_BYTES];
+    int q_off = s * NP % AXI_BYTES;
+    ap_uint<8 * NP> q_chars = 0;
+    q_unpack: for (int col = 0; col < NP; col++) {
+#pragma HLS UNROLL
+        q_chars.range(8 * col + 7, 8 * col) = q_word.range(8 * (q_off + col) + 7, 8 * (q_off + col));
+    }
+    q_stream.write(q_chars);
+}
+
+template <int NP>
+static void lsal_load(const axi_word_t *q, const axi_word_t *d, hls::stream<ap_uint<8 * NP> > &q_stream,
+                      hls::stream<char> &d_stream, int s, int width, int m)
+{
+    lsal_load_query<NP>(q, q_stream, s);
+
+    // The NP characters of the initial window, then one per round
+    int chars = m + width - 1 + NP;
+    axi_word_t d_word = 0;
+    d_read: for (int i = 0; i < chars; i++) {
+#pragma HLS LOOP_TRIPCOUNT min=2*NP max=M_MAX+2*NP-1
+#pragma HLS PIPELINE II=1
+        if (i % AXI_BYTES == 0) d_word = d[i / AXI_BYTES];
+        int b = i % AXI_BYTES;
+        d_stream.write((char) d_word.range(8 * b + 7, 8 * b));
+    }
+}
+
+// Streams record characters from any byte offset, with NP - 1 'X' in front and 'X' behind
+template <int NP>
+static void lsal_load_record(const axi_word_t *q, const axi_word_t *d, hls::stream<ap_uint<8 * NP> > &q_stream,
+                             hls::stream<char> &d_stream, int start, int s, int width, int m)
+{
+    lsal_load_query<NP>(q, q_stream, s);
+
+    int chars = m + width - 1 + NP;
+    axi_word_t d_word = d[start / AXI_BYTES];
+    d_read: for (int i = 0; i < chars; i++) {
+#pragma HLS LOOP_TRIPCOUNT min=2*NP max=M_MAX+2*NP-1
+#pragma HLS PIPELINE II=1
+        int real = i - (NP - 1);
+        char c = 'X';
+        if (real >= 0 && real < m) {
+            int pos = start + real;
+            if (real > 0 && pos % AXI_BYTES == 0) d_word = d[pos / AXI_BYTES];
+            int b = pos % AXI_BYTES;
+            c = (char) d_word.range(8 * b + 7, 8 * b);
+        }
+        d_stream.write(c);
+    }
+}
+
+// Loads one query stripe per lane, then streams the database once to every lane
+template <int NP, int L>
+static void lsal_load_lanes(const axi_word_t *q, const axi_word_t *d, hls::stream<ap_uint<8 * NP> > q_streams[L],
+                            hls::stream<char> d_streams[L], int first, int queries, int query_words,
+                            int s, int width, int m)
+{
+    q_lanes: for (int l = 0; l < L; l++) {
+        if (first + l < queries) {
+            lsal_load_query<NP>(q + (first + l) * query_words, q_streams[l], s);
+        } else {
+            // An idle lane: no database character matches, so its scores stay 0
+            q_streams[l].write(0);
+        }
+    }
+
+    int chars = m + width - 1 + NP;
+    axi_word_t d_word = 0;
+    d_read: for (int i = 0; i < chars; i++) {
+#pragma HLS LOOP_TRIPCOUNT min=2*NP max=M_MAX+2*NP-1
+#pragma HLS PIPELINE II=1
+        if (i % AXI_BYTES == 0) d_word = d[i / AXI_BYTES];
+        int b = i % AXI_BYTES;
+        char c = (char) d_word.range(8 * b + 7, 8 * b);
+        d_fanout: for (int l = 0; l < L; l++) {
+#pragma HLS UNROLL
+            d_streams[l].write(c);
+        }
+    }
+}
+
+// Closes a column's hit region into its HIT_K slots, replacing the weakest slot if better
+static void lsal_hit_commit(score_t score, int row, score_t slot_score[HIT_K], int slot_row[HIT_K])
+{
+#pragma HLS INLINE
+    int weakest = 0;
+    hit_min: for (int k = 1; k < HIT_K; k++) {
+#pragma HLS UNROLL
+        if (slot_score[k] < slot_score[weakest]) weakest = k;
+    }
+    if (score > slot_score[weakest]) {
+        slot_score[weakest] = score;
+        slot_row[weakest] = row;
+    }
+}
 
-    int8_t max_similarity = 0;
+// Cells of a column scoring at least threshold, at most HIT_SPAN rows apart, are one region
+static void lsal_hit_track(score_t best, int cell_row, int m, score_t threshold, score_t &open_score,
+                           int &open_row, int &open_last, score_t slot_score[HIT_K], int slot_row[HIT_K])
+{
+#pragma HLS INLINE
+    if (best < threshold || cell_row < 0 || cell_row >= m) return;
+
+    if (open_score > 0 && cell_row - open_last <= HIT_SPAN) {
+        if (best > open_score) {
+            open_score = best;
+            open_row = cell_row;
+        }
+    } else {
+        if (open_score > 0) lsal_hit_commit(open_score, open_row, slot_score, slot_row);
+        open_score = best;
+        open_row = cell_row;
+    }
+    open_last = cell_row;
+}
+
+template <int NP, bool DIRS, bool HITS>
+static void lsal_pe_array(hls::stream<ap_uint<8 * NP> > &q_stream, hls::stream<char> &d_stream,
+                          hls::stream<ap_uint<DIR_BITS * NP> > &dir_stream, hls::stream<ap_uint<64> > &hit_stream,
+                          score_t *boundary, int s, int stripes, int width, int m, score_t threshold,
+                          score_t &stripe_max, int &stripe_idx)
+{
+    score_t max_similarity = 0;
     int max_idx_tmp = 0;
 
-    char q_buf[N], d_buf[N];
+    char q_buf[NP], d_buf[NP];
 #pragma HLS ARRAY_PARTITION variable=q_buf dim=1 complete
 #pragma HLS ARRAY_PARTITION variable=d_buf dim=1 complete
 
-    int8_t buf_curr[N], buf_prev_1[N + 1], buf_prev_2[N + 1];
+    score_t buf_curr[NP], buf_prev_1[NP + 1], buf_prev_2[NP + 1];
 #pragma HLS ARRAY_PARTITION variable=buf_curr dim=1 complete
 #pragma HLS ARRAY_PARTITION variable=buf_prev_1 dim=1 complete
 #pragma HLS ARRAY_PARTITION variable=buf_prev_2 dim=1 complete
 
-    char dir_buf[N];
-#pragma HLS ARRAY_PARTITION variable=dir_buf dim=1 complete
-
-    int max_row_buf[N];
-    int8_t max_value_buf[N];
+    int max_row_buf[NP];
+    score_t max_value_buf[NP];
 #pragma HLS ARRAY_PARTITION variable=max_row_buf dim=1 complete
 #pragma HLS ARRAY_PARTITION variable=max_value_buf dim=1 complete
 
-    q: memcpy(q_buf, q, N * sizeof(char));
-    d: memcpy(d_buf, d, N * sizeof(char));
+    // Hits: every column's open region and the HIT_K best regions it has closed
+    score_t open_score[NP], slot_score[NP][HIT_K];
+    int open_row[NP], open_last[NP], slot_row[NP][HIT_K];
+#pragma HLS ARRAY_PARTITION variable=open_score dim=1 complete
+#pragma HLS ARRAY_PARTITION variable=open_row dim=1 complete
+#pragma HLS ARRAY_PARTITION variable=open_last dim=1 complete
+#pragma HLS ARRAY_PARTITION variable=slot_score dim=0 complete
+#pragma HLS ARRAY_PARTITION variable=slot_row dim=0 complete
+
+    ap_uint<8 * NP> q_chars = q_stream.read();
+    q: for (int col = 0; col < NP; col++) {
+#pragma HLS UNROLL
+        q_buf[col] = q_chars.range(8 * col + 7, 8 * col);
+    }
+    d: for (int col = 0; col < NP; col++) {
+#pragma HLS PIPELINE II=1
+        d_buf[col] = d_stream.read();
+    }
+
+    if (HITS) {
+        hit_init: for (int col = 0; col < NP; col++) {
+#pragma HLS UNROLL
+            open_score[col] = 0;
+            open_row[col] = 0;
+            open_last[col] = 0;
+            hit_init_k: for (int k = 0; k < HIT_K; k++) {
+                slot_score[col][k] = 0;
+                slot_row[col][k] = 0;
+            }
+        }
+    }
+
+    sim_prev_1: memset(buf_prev_1, 0, (NP + 1) * sizeof(score_t));
+    sim_prev_2: memset(buf_prev_2, 0, (NP + 1) * sizeof(score_t));
+
+    max_idx: memset(max_row_buf, 0, NP * sizeof(int));
+    max_val: memset(max_value_buf, 0, NP * sizeof(score_t));
+
+    score_t left_prev = 0;
+    bool carry = s + 1 < stripes;
 
-    sim_prev_1: memset(buf_prev_1, 0, (N + 1) * sizeof(int8_t));
-    sim_prev_2: memset(buf_prev_2, 0, (N + 1) * sizeof(int8_t));
+    Round: for (int row = 0; row < (m + width - 1); row++) {
+#pragma HLS LOOP_TRIPCOUNT min=NP max=M_MAX+NP-1
+#pragma HLS PIPELINE II=1
+#pragma HLS DEPENDENCE variable=boundary inter false
+        // Left neighbours of PE 0: row `row` and row - 1 of the previous stripe's last column
+        score_t left = (s > 0 && row < m) ? boundary[row] : (score_t) 0;
+        buf_prev_1[0] = left;
+        buf_prev_2[0] = left_prev;
+        left_prev = left;
 
-    max_idx: memset(max_row_buf, 0, N * sizeof(int));
-    max_val: memset(max_value_buf, 0, N * sizeof(int8_t));
+        ap_uint<DIR_BITS * NP> dir_word = 0;
 
-    Round: for (int row = 0; row < (M + N - 1); row++) {
-#pragma HLS PIPELINE
-        Off: for (int col = 0; col < N; col++) {
-        	char d_char = d_buf[row + N - 1 - col];
+        Off: for (int col = 0; col < NP; col++) {
+        	int cell_row = row - col;
+        	bool active = col < width;
+        	bool inside = active && cell_row >= 0 && cell_row < m;
+        	char d_char = d_buf[NP - 1 - col];
         	char q_char = q_buf[col];
-        	int8_t buf_D = buf_prev_2[col];
-        	int8_t buf_U = buf_prev_1[col + 1];
-        	int8_t buf_L = buf_prev_1[col];
-        	int8_t max_value = max_value_buf[col];
+        	score_t buf_D = buf_prev_2[col];
+        	score_t buf_U = buf_prev_1[col + 1];
+        	score_t buf_L = buf_prev_1[col];
+        	score_t max_value = max_value_buf[col];
 
-        	int8_t score = (d_char == q_char) ? match : mismatch;
+        	score_t score = (d_char == q_char) ? match : mismatch;
 
-            int8_t D = buf_D + score;
-            int8_t U = buf_U + gap_row;
-            int8_t L = buf_L + gap_col;
+            score_t D = buf_D + score;
+            score_t U = buf_U + gap_row;
+            score_t L = buf_L + gap_col;
 
-            int8_t best1, best2, best;
+            score_t best1, best2, best;
             char dir1, dir2, dir;
 
             if (D > 0) {
@@ -95,7 +314,8 @@ void lsal_compute_matrices_aug(char *q,
             	dir2 = DIR_L;
             }
 
-            if (best1 > best2) {
+            // A cell scoring 0 starts no alignment, even when a gap from a neighbour reaches 0
+            if (best1 > best2 || best2 <= 0) {
             	best = best1;
             	dir = dir1;
             } else {
@@ -103,31 +323,752 @@ void lsal_compute_matrices_aug(char *q,
             	dir = dir2;
             }
 
+            // PEs past the end of the query or on the database padding are masked off
+            if (!inside) {
+            	best = 0;
+            	dir = DIR_NONE;
+            }
+
             buf_curr[col] = best;
-            dir_buf[col] = dir;
+            dir_word.range(DIR_BITS * col + 1, DIR_BITS * col) = dir;
 
-            if (best > max_value) {
+            if (inside && best > max_value) {
                	max_value_buf[col] = best;
                	max_row_buf[col] = row;
             }
+
+            if (HITS && inside) {
+                lsal_hit_track(best, cell_row, m, threshold, open_score[col], open_row[col], open_last[col],
+                               slot_score[col], slot_row[col]);
+            }
         }
 
-        sim_2_prev: memcpy(buf_prev_2 + 1, buf_prev_1 + 1, N * sizeof(int8_t));
-        sim_1_prev: memcpy(buf_prev_1 + 1, buf_curr, N * sizeof(int8_t));
+        // The last active PE finishes database row `row - (width - 1)` this round
+        // and keeps it for the next stripe; the last stripe has no reader for it
+        int out_row = row - (width - 1);
+        if (carry && out_row >= 0) boundary[out_row] = buf_curr[width - 1];
+
+        sim_2_prev: memcpy(buf_prev_2 + 1, buf_prev_1 + 1, NP * sizeof(score_t));
+        sim_1_prev: memcpy(buf_prev_1 + 1, buf_curr, NP * sizeof(score_t));
 
-        dir: memcpy(direction + (N * row), dir_buf, N * sizeof(char));
+        if (DIRS) dir_stream.write(dir_word);
 
-        memcpy(d_buf, d_buf + 1, (N - 1) * sizeof(char));
-        d_buf[N - 1] = d[row + N];
+        // A shift register, memcpy on overlapping ranges is undefined in a C build
+        d_shift: for (int col = 0; col < NP - 1; col++) {
+#pragma HLS UNROLL
+            d_buf[col] = d_buf[col + 1];
+        }
+        d_buf[NP - 1] = d_stream.read();
     }
 
-    max_final: for (int col = 0; col < N; col++) {
+    max_final: for (int col = 0; col < NP; col++) {
 #pragma HLS UNROLL
-    	if (max_similarity <= max_value_buf[col]) {
+    	if (col < width && max_similarity <= max_value_buf[col]) {
     		max_similarity = max_value_buf[col];
-    		max_idx_tmp = max_row_buf[col] * N + col;
+    		max_idx_tmp = max_row_buf[col] * NP + col;
     	}
     }
 
+    stripe_max = max_similarity;
+    stripe_idx = max_idx_tmp;
+
+    // Close the regions still open, then stream every slot: score in the low word, row above
+    if (HITS) {
+        hit_flush: for (int col = 0; col < NP; col++) {
+#pragma HLS UNROLL
+            if (open_score[col] > 0) lsal_hit_commit(open_score[col], open_row[col], slot_score[col], slot_row[col]);
+        }
+        hit_out: for (int e = 0; e < NP * HIT_K; e++) {
+#pragma HLS PIPELINE II=1
+            int col = e / HIT_K, k = e % HIT_K;
+            ap_uint<64> hit = 0;
+            if (col < width) {
+                hit.range(31, 0) = slot_score[col][k];
+                hit.range(63, 32) = slot_row[col][k];
+            }
+            hit_stream.write(hit);
+        }
+    }
+}
+
+/*
+ Affine-gap PEs (Gotoh). Besides H every PE carries E, the best score of a cell ending in a
+ gap in the database (moving left along the query), and F, the best ending in a gap in the
+ query (moving up along the database):
+   E(r, c) = max(H(r, c - 1) + gap_open, E(r, c - 1) + gap_extend)   from the left PE
+   F(r, c) = max(H(r - 1, c) + gap_open, F(r - 1, c) + gap_extend)   from this PE, last round
+   H(r, c) = max(0, H(r - 1, c - 1) + score, E(r, c), F(r, c))
+ E and F ride along with H in e_prev and f_prev, and the boundary keeps E as well as H of
+ the previous stripe's last column. Each cell emits AFF_BITS: the source of H in the low two
+ bits (DIR_L for E, DIR_U for F), then AFF_E_EXT and AFF_F_EXT when E and F extend a gap
+ rather than open one, which is what the traceback needs to follow a gap through its cells.
+ */
+template <int NP>
+static void lsal_pe_array_affine(hls::stream<ap_uint<8 * NP> > &q_stream, hls::stream<char> &d_stream,
+                                 hls::stream<ap_uint<AFF_BITS * NP> > &dir_stream, score_t *boundary,
+                                 score_t *boundary_e, int s, int stripes, int width, int m, score_t &stripe_max, int &stripe_idx)
+{
+    score_t max_similarity = 0;
+    int max_idx_tmp = 0;
+
+    char q_buf[NP], d_buf[NP];
+#pragma HLS ARRAY_PARTITION variable=q_buf dim=1 complete
+#pragma HLS ARRAY_PARTITION variable=d_buf dim=1 complete
+
+    score_t buf_curr[NP], buf_prev_1[NP + 1], buf_prev_2[NP + 1];
+#pragma HLS ARRAY_PARTITION variable=buf_curr dim=1 complete
+#pragma HLS ARRAY_PARTITION variable=buf_prev_1 dim=1 complete
+#pragma HLS ARRAY_PARTITION variable=buf_prev_2 dim=1 complete
+
+    score_t e_curr[NP], e_prev[NP + 1], f_prev[NP];
+#pragma HLS ARRAY_PARTITION variable=e_curr dim=1 complete
+#pragma HLS ARRAY_PARTITION variable=e_prev dim=1 complete
+#pragma HLS ARRAY_PARTITION variable=f_prev dim=1 complete
+
+    int max_row_buf[NP];
+    score_t max_value_buf[NP];
+#pragma HLS ARRAY_PARTITION variable=max_row_buf dim=1 complete
+#pragma HLS ARRAY_PARTITION variable=max_value_buf dim=1 complete
+
+    ap_uint<8 * NP> q_chars = q_stream.read();
+    q: for (int col = 0; col < NP; col++) {
+#pragma HLS UNROLL
+        q_buf[col] = q_chars.range(8 * col + 7, 8 * col);
+    }
+    d: for (int col = 0; col < NP; col++) {
+#pragma HLS PIPELINE II=1
+        d_buf[col] = d_stream.read();
+    }
+
+    init: for (int col = 0; col <= NP; col++) {
+#pragma HLS UNROLL
+        buf_prev_1[col] = 0;
+        buf_prev_2[col] = 0;
+        e_prev[col] = score_neg;
+        if (col < NP) {
+            f_prev[col] = score_neg;
+            max_row_buf[col] = 0;
+            max_value_buf[col] = 0;
+        }
+    }
+
+    score_t left_prev = 0;
+    bool carry = s + 1 < stripes;
+
+    Round: for (int row = 0; row < (m + width - 1); row++) {
+#pragma HLS LOOP_TRIPCOUNT min=NP max=M_MAX+NP-1
+#pragma HLS PIPELINE II=1
+#pragma HLS DEPENDENCE variable=boundary inter false
+#pragma HLS DEPENDENCE variable=boundary_e inter false
+        // Left neighbours of PE 0: the previous stripe's last column, H and E
+        bool inside = s > 0 && row < m;
+        score_t left = inside ? boundary[row] : (score_t) 0;
+        buf_prev_1[0] = left;
+        buf_prev_2[0] = left_prev;
+        e_prev[0] = inside ? boundary_e[row] : (score_t) score_neg;
+        left_prev = left;
+
+        ap_uint<AFF_BITS * NP> dir_word = 0;
+
+        Off: for (int col = 0; col < NP; col++) {
+            int cell_row = row - col;
+            bool active = col < width;
+            bool inside = active && cell_row >= 0 && cell_row < m;
+            char d_char = d_buf[NP - 1 - col];
+            char q_char = q_buf[col];
+            score_t buf_D = buf_prev_2[col];
+            score_t buf_U = buf_prev_1[col + 1];
+            score_t buf_L = buf_prev_1[col];
+            score_t max_value = max_value_buf[col];
+
+            score_t score = (d_char == q_char) ? match : mismatch;
+
+            // A gap extends only when that is strictly better than opening it here
+            score_t e_open = buf_L + gap_open, e_ext = e_prev[col] + gap_extend;
+            score_t f_open = buf_U + gap_open, f_ext = f_prev[col] + gap_extend;
+            bool e_extends = e_ext > e_open;
+            bool f_extends = f_ext > f_open;
+            score_t E = e_extends ? e_ext : e_open;
+            score_t F = f_extends ? f_ext : f_open;
+
+            score_t D = buf_D + score;
+
+            score_t best1, best2, best;
+            char dir1, dir2, dir;
+
+            if (D > 0) {
+                best1 = D;
+                dir1 = DIR_D;
+            } else {
+                best1 = 0;
+                dir1 = DIR_NONE;
+            }
+
+            if (F > E) {
+                best2 = F;
+                dir2 = DIR_U;
+            } else {
+                best2 = E;
+                dir2 = DIR_L;
+            }
+
+            if (best1 > best2 || best2 <= 0) {
+                best = best1;
+                dir = dir1;
+            } else {
+                best = best2;
+                dir = dir2;
+            }
+
+            int code = dir | (e_extends ? AFF_E_EXT : 0) | (f_extends ? AFF_F_EXT : 0);
+
+            // PEs past the end of the query or on the database padding are masked off
+            if (!inside) {
+                best = 0;
+                code = DIR_NONE;
+            }
+
+            buf_curr[col] = best;
+            e_curr[col] = E;
+            f_prev[col] = F;
+            dir_word.range(AFF_BITS * col + AFF_BITS - 1, AFF_BITS * col) = code;
+
+            if (inside && best > max_value) {
+                max_value_buf[col] = best;
+                max_row_buf[col] = row;
+            }
+        }
+
+        // The last active PE finishes database row `row - (width - 1)` this round
+        // and keeps it, H and E, for the next stripe
+        int out_row = row - (width - 1);
+        if (carry && out_row >= 0) {
+            boundary[out_row] = buf_curr[width - 1];
+            boundary_e[out_row] = e_curr[width - 1];
+        }
+
+        shift: for (int col = 0; col < NP; col++) {
+#pragma HLS UNROLL
+            buf_prev_2[col + 1] = buf_prev_1[col + 1];
+            buf_prev_1[col + 1] = buf_curr[col];
+            e_prev[col + 1] = e_curr[col];
+        }
+
+        dir_stream.write(dir_word);
+
+        d_shift: for (int col = 0; col < NP - 1; col++) {
+#pragma HLS UNROLL
+            d_buf[col] = d_buf[col + 1];
+        }
+        d_buf[NP - 1] = d_stream.read();
+    }
+
+    max_final: for (int col = 0; col < NP; col++) {
+#pragma HLS UNROLL
+        if (col < width && max_similarity <= max_value_buf[col]) {
+            max_similarity = max_value_buf[col];
+            max_idx_tmp = max_row_buf[col] * NP + col;
+        }
+    }
+
+    stripe_max = max_similarity;
+    stripe_idx = max_idx_tmp;
+}
+
+// Writes the hit slots of stripe s as { score, row * n + col } pairs, HIT_K per column
+template <int NP>
+static void lsal_store_hits(hls::stream<ap_uint<64> > &hit_stream, axi_word_t *hits, int s, int n)
+{
+    const int per_word = AXI_BYTES / 8;
+    static_assert(NP * HIT_K % (AXI_BYTES / 8) == 0, "a stripe's hits must fill whole AXI words");
+
+    axi_word_t word = 0;
+    hit_write: for (int e = 0; e < NP * HIT_K; e++) {
+#pragma HLS PIPELINE II=1
+        ap_uint<64> hit = hit_stream.read();
+        int row = hit.range(63, 32);
+        int slot = e % per_word;
+        word.range(64 * slot + 31, 64 * slot) = hit.range(31, 0);
+        word.range(64 * slot + 63, 64 * slot + 32) = row * n + s * NP + e / HIT_K;
+        if (slot == per_word - 1) hits[(s * NP * HIT_K + e) / per_word] = word;
+    }
+}
+
+template <int NP, int BITS>
+static void lsal_store(hls::stream<ap_uint<BITS * NP> > &dir_stream, axi_word_t *direction, int s, int width, int m)
+{
+    const int per_word = 8 * AXI_BYTES / BITS;
+    const int rounds_per_word = per_word / NP;
+    int rounds = m + width - 1;
+    int base = s * (lsal_stripe_size(NP, m, per_word) / per_word);
+
+    axi_word_t word = 0;
+    dir_write: for (int row = 0; row < rounds; row++) {
+#pragma HLS LOOP_TRIPCOUNT min=NP max=M_MAX+NP-1
+#pragma HLS PIPELINE II=1
+        int slot = row % rounds_per_word;
+        word.range(BITS * NP * (slot + 1) - 1, BITS * NP * slot) = dir_stream.read();
+
+        if (slot == rounds_per_word - 1 || row == rounds - 1) {
+            direction[base + row / rounds_per_word] = word;
+        }
+    }
+}
+
+template <int NP>
+static void lsal_stripe(const axi_word_t *q, const axi_word_t *d, axi_word_t *direction, score_t *boundary,
+                        int s, int stripes, int width, int m, score_t &stripe_max, int &stripe_idx)
+{
+#pragma HLS DATAFLOW
+    hls::stream<ap_uint<8 * NP> > q_stream("q_stream");
+    hls::stream<char> d_stream("d_stream");
+    hls::stream<ap_uint<DIR_BITS * NP> > dir_stream("dir_stream");
+    hls::stream<ap_uint<64> > hit_stream("hit_stream");               // never written
+#pragma HLS STREAM variable=q_stream depth=2
+#pragma HLS STREAM variable=d_stream depth=2*AXI_BYTES
+#pragma HLS STREAM variable=dir_stream depth=2*DIR_PER_WORD/NP
+
+    lsal_load<NP>(q, d, q_stream, d_stream, s, width, m);
+    lsal_pe_array<NP, true, false>(q_stream, d_stream, dir_stream, hit_stream, boundary, s, stripes, width, m, 0,
+                                   stripe_max, stripe_idx);
+    lsal_store<NP, DIR_BITS>(dir_stream, direction, s, width, m);
+}
+
+template <int NP>
+static void lsal_stripe_score(const axi_word_t *q, const axi_word_t *d, score_t *boundary,
+                              int s, int stripes, int width, int m, score_t &stripe_max, int &stripe_idx)
+{
+#pragma HLS DATAFLOW
+    hls::stream<ap_uint<8 * NP> > q_stream("q_stream");
+    hls::stream<char> d_stream("d_stream");
+    hls::stream<ap_uint<DIR_BITS * NP> > dir_stream("dir_stream");    // never written
+    hls::stream<ap_uint<64> > hit_stream("hit_stream");               // never written
+#pragma HLS STREAM variable=q_stream depth=2
+#pragma HLS STREAM variable=d_stream depth=2*AXI_BYTES
+
+    lsal_load<NP>(q, d, q_stream, d_stream, s, width, m);
+    lsal_pe_array<NP, false, false>(q_stream, d_stream, dir_stream, hit_stream, boundary, s, stripes, width, m, 0,
+                                    stripe_max, stripe_idx);
+}
+
+template <int NP>
+static void lsal_stripe_record(const axi_word_t *q, const axi_word_t *d, score_t *boundary,
+                               int start, int s, int stripes, int width, int m, score_t &stripe_max, int &stripe_idx)
+{
+#pragma HLS DATAFLOW
+    hls::stream<ap_uint<8 * NP> > q_stream("q_stream");
+    hls::stream<char> d_stream("d_stream");
+    hls::stream<ap_uint<DIR_BITS * NP> > dir_stream("dir_stream");    // never written
+    hls::stream<ap_uint<64> > hit_stream("hit_stream");               // never written
+#pragma HLS STREAM variable=q_stream depth=2
+#pragma HLS STREAM variable=d_stream depth=2*AXI_BYTES
+
+    lsal_load_record<NP>(q, d, q_stream, d_stream, start, s, width, m);
+    lsal_pe_array<NP, false, false>(q_stream, d_stream, dir_stream, hit_stream, boundary, s, stripes, width, m, 0,
+                                    stripe_max, stripe_idx);
+}
+
+template <int NP, int L>
+static void lsal_stripe_lanes(const axi_word_t *q, const axi_word_t *d, score_t boundary[L][M_MAX],
+                              int first, int queries, int query_words, int s, int stripes, int width, int m,
+                              score_t stripe_max[L], int stripe_idx[L])
+{
+#pragma HLS DATAFLOW
+    hls::stream<ap_uint<8 * NP> > q_streams[L];
+    hls::stream<char> d_streams[L];
+    hls::stream<ap_uint<DIR_BITS * NP> > dir_streams[L];    // never written
+    hls::stream<ap_uint<64> > hit_streams[L];               // never written
+#pragma HLS STREAM variable=q_streams depth=2
+#pragma HLS STREAM variable=d_streams depth=2*AXI_BYTES
+
+    lsal_load_lanes<NP, L>(q, d, q_streams, d_streams, first, queries, query_words, s, width, m);
+    pe_lanes: for (int l = 0; l < L; l++) {
+#pragma HLS UNROLL
+        lsal_pe_array<NP, false, false>(q_streams[l], d_streams[l], dir_streams[l], hit_streams[l], boundary[l],
+                                        s, stripes, width, m, 0, stripe_max[l], stripe_idx[l]);
+    }
+}
+
+template <int NP>
+static void lsal_systolic(const axi_word_t *q, const axi_word_t *d, int *max_idx, int *max_score, axi_word_t *direction, int n, int m)
+{
+    static_assert(AXI_BYTES % NP == 0, "NP must divide the AXI word width in bytes");
+
+    score_t boundary[M_MAX];
+#pragma HLS BIND_STORAGE variable=boundary type=ram_t2p impl=bram
+
+    score_t max_similarity = 0;
+    int max_idx_tmp = 0;
+
+    int stripes = (n + NP - 1) / NP;
+    int stripe_size = lsal_stripe_size(NP, m, DIR_PER_WORD);
+
+    Stripe: for (int s = 0; s < stripes; s++) {
+#pragma HLS LOOP_TRIPCOUNT min=1 max=Q_MAX/NP
+        int width = (n - s * NP < NP) ? n - s * NP : NP;
+        score_t stripe_max;
+        int stripe_idx;
+
+        lsal_stripe<NP>(q, d, direction, boundary, s, stripes, width, m, stripe_max, stripe_idx);
+
+        if (max_similarity <= stripe_max) {
+            max_similarity = stripe_max;
+            max_idx_tmp = s * stripe_size + stripe_idx;
+        }
+    }
+
+    *max_idx = max_idx_tmp;
+    *max_score = max_similarity;
+}
+
+template <int NP>
+static void lsal_systolic_score(const axi_word_t *q, const axi_word_t *d, int *max_idx, int *max_score, int n, int m)
+{
+    static_assert(AXI_BYTES % NP == 0, "NP must divide the AXI word width in bytes");
+
+    score_t boundary[M_MAX];
+#pragma HLS BIND_STORAGE variable=boundary type=ram_t2p impl=bram
+
+    score_t max_similarity = 0;
+    int max_idx_tmp = 0;
+
+    int stripes = (n + NP - 1) / NP;
+
+    Stripe: for (int s = 0; s < stripes; s++) {
+#pragma HLS LOOP_TRIPCOUNT min=1 max=Q_MAX/NP
+        int width = (n - s * NP < NP) ? n - s * NP : NP;
+        score_t stripe_max;
+        int stripe_idx;
+
+        lsal_stripe_score<NP>(q, d, boundary, s, stripes, width, m, stripe_max, stripe_idx);
+
+        // stripe_idx is round * NP + col, and PE col finishes row round - col in that round
+        if (max_similarity <= stripe_max) {
+            int col = stripe_idx % NP;
+            int row = stripe_idx / NP - col;
+            max_similarity = stripe_max;
+            max_idx_tmp = row * n + s * NP + col;
+        }
+    }
+
     *max_idx = max_idx_tmp;
+    *max_score = max_similarity;
+}
+
+// Best score and row-major cell of one record, over all the query stripes
+template <int NP>
+static void lsal_align_record(const axi_word_t *q, const axi_word_t *d, score_t *boundary,
+                              int start, int n, int m, int &record_max, int &record_idx)
+{
+    score_t max_similarity = 0;
+    int max_idx_tmp = 0;
+
+    int stripes = (n + NP - 1) / NP;
+
+    Stripe: for (int s = 0; s < stripes; s++) {
+#pragma HLS LOOP_TRIPCOUNT min=1 max=Q_MAX/NP
+        int width = (n - s * NP < NP) ? n - s * NP : NP;
+        score_t stripe_max;
+        int stripe_idx;
+
+        lsal_stripe_record<NP>(q, d, boundary, start, s, stripes, width, m, stripe_max, stripe_idx);
+
+        if (max_similarity <= stripe_max) {
+            int col = stripe_idx % NP;
+            int row = stripe_idx / NP - col;
+            max_similarity = stripe_max;
+            max_idx_tmp = row * n + s * NP + col;
+        }
+    }
+
+    record_max = max_similarity;
+    record_idx = max_idx_tmp;
+}
+
+template <int NP>
+static void lsal_systolic_batch(const axi_word_t *q, const axi_word_t *d, const int *offsets, int *results, int n, int records)
+{
+    static_assert(AXI_BYTES % NP == 0, "NP must divide the AXI word width in bytes");
+
+    score_t boundary[M_MAX];
+#pragma HLS BIND_STORAGE variable=boundary type=ram_t2p impl=bram
+
+    int start = offsets[0];
+
+    Record: for (int r = 0; r < records; r++) {
+#pragma HLS LOOP_TRIPCOUNT min=1 max=4096
+        int end = offsets[r + 1];
+        int record_max = 0;
+        int record_idx = 0;
+
+        if (end > start) lsal_align_record<NP>(q, d, boundary, start, n, end - start, record_max, record_idx);
+
+        results[2 * r] = record_max;
+        results[2 * r + 1] = record_idx;
+        start = end;
+    }
+}
+
+template <int NP, int L>
+static void lsal_systolic_lanes(const axi_word_t *q, const axi_word_t *d, int *results, int n, int m, int queries)
+{
+    static_assert(AXI_BYTES % NP == 0, "NP must divide the AXI word width in bytes");
+
+    score_t boundary[L][M_MAX];
+#pragma HLS ARRAY_PARTITION variable=boundary dim=1 complete
+#pragma HLS BIND_STORAGE variable=boundary type=ram_t2p impl=bram
+
+    int stripes = (n + NP - 1) / NP;
+    int query_words = (stripes * NP + AXI_BYTES - 1) / AXI_BYTES;
+
+    Group: for (int first = 0; first < queries; first += L) {
+#pragma HLS LOOP_TRIPCOUNT min=1 max=4096/L
+        score_t lane_max[L];
+        int lane_idx[L];
+#pragma HLS ARRAY_PARTITION variable=lane_max dim=1 complete
+#pragma HLS ARRAY_PARTITION variable=lane_idx dim=1 complete
+
+        lane_init: for (int l = 0; l < L; l++) {
+#pragma HLS UNROLL
+            lane_max[l] = 0;
+            lane_idx[l] = 0;
+        }
+
+        Stripe: for (int s = 0; s < stripes; s++) {
+#pragma HLS LOOP_TRIPCOUNT min=1 max=Q_MAX/NP
+            int width = (n - s * NP < NP) ? n - s * NP : NP;
+            score_t stripe_max[L];
+            int stripe_idx[L];
+#pragma HLS ARRAY_PARTITION variable=stripe_max dim=1 complete
+#pragma HLS ARRAY_PARTITION variable=stripe_idx dim=1 complete
+
+            lsal_stripe_lanes<NP, L>(q, d, boundary, first, queries, query_words, s, stripes, width, m, stripe_max, stripe_idx);
+
+            lane_merge: for (int l = 0; l < L; l++) {
+#pragma HLS UNROLL
+                if (lane_max[l] <= stripe_max[l]) {
+                    int col = stripe_idx[l] % NP;
+                    int row = stripe_idx[l] / NP - col;
+                    lane_max[l] = stripe_max[l];
+                    lane_idx[l] = row * n + s * NP + col;
+                }
+            }
+        }
+
+        lane_write: for (int l = 0; l < L; l++) {
+            if (first + l < queries) {
+                results[2 * (first + l)] = lane_max[l];
+                results[2 * (first + l) + 1] = lane_idx[l];
+            }
+        }
+    }
+}
+
+template <int NP>
+static void lsal_stripe_hits(const axi_word_t *q, const axi_word_t *d, axi_word_t *hits, score_t *boundary,
+                             int s, int stripes, int width, int n, int m, score_t threshold, score_t &stripe_max, int &stripe_idx)
+{
+#pragma HLS DATAFLOW
+    hls::stream<ap_uint<8 * NP> > q_stream("q_stream");
+    hls::stream<char> d_stream("d_stream");
+    hls::stream<ap_uint<DIR_BITS * NP> > dir_stream("dir_stream");    // never written
+    hls::stream<ap_uint<64> > hit_stream("hit_stream");
+#pragma HLS STREAM variable=q_stream depth=2
+#pragma HLS STREAM variable=d_stream depth=2*AXI_BYTES
+#pragma HLS STREAM variable=hit_stream depth=2*AXI_BYTES/8
+
+    lsal_load<NP>(q, d, q_stream, d_stream, s, width, m);
+    lsal_pe_array<NP, false, true>(q_stream, d_stream, dir_stream, hit_stream, boundary, s, stripes, width, m, threshold,
+                                   stripe_max, stripe_idx);
+    lsal_store_hits<NP>(hit_stream, hits, s, n);
+}
+
+template <int NP>
+static void lsal_systolic_hits(const axi_word_t *q, const axi_word_t *d, axi_word_t *hits, int n, int m, int threshold)
+{
+    static_assert(AXI_BYTES % NP == 0, "NP must divide the AXI word width in bytes");
+
+    score_t boundary[M_MAX];
+#pragma HLS BIND_STORAGE variable=boundary type=ram_t2p impl=bram
+
+    // A positive open score is what marks a region open, so the threshold is at least 1
+    score_t min_score = threshold > 0 ? threshold : 1;
+    int stripes = (n + NP - 1) / NP;
+
+    Stripe: for (int s = 0; s < stripes; s++) {
+#pragma HLS LOOP_TRIPCOUNT min=1 max=Q_MAX/NP
+        int width = (n - s * NP < NP) ? n - s * NP : NP;
+        score_t stripe_max;
+        int stripe_idx;
+
+        lsal_stripe_hits<NP>(q, d, hits, boundary, s, stripes, width, n, m, min_score, stripe_max, stripe_idx);
+    }
+}
+
+template <int NP>
+static void lsal_stripe_affine(const axi_word_t *q, const axi_word_t *d, axi_word_t *direction, score_t *boundary,
+                               score_t *boundary_e, int s, int stripes, int width, int m, score_t &stripe_max, int &stripe_idx)
+{
+#pragma HLS DATAFLOW
+    hls::stream<ap_uint<8 * NP> > q_stream("q_stream");
+    hls::stream<char> d_stream("d_stream");
+    hls::stream<ap_uint<AFF_BITS * NP> > dir_stream("dir_stream");
+#pragma HLS STREAM variable=q_stream depth=2
+#pragma HLS STREAM variable=d_stream depth=2*AXI_BYTES
+#pragma HLS STREAM variable=dir_stream depth=2*AFF_PER_WORD/NP
+
+    lsal_load<NP>(q, d, q_stream, d_stream, s, width, m);
+    lsal_pe_array_affine<NP>(q_stream, d_stream, dir_stream, boundary, boundary_e, s, stripes, width, m, stripe_max, stripe_idx);
+    lsal_store<NP, AFF_BITS>(dir_stream, direction, s, width, m);
+}
+
+template <int NP>
+static void lsal_systolic_affine(const axi_word_t *q, const axi_word_t *d, int *max_idx, int *max_score, axi_word_t *direction, int n, int m)
+{
+    static_assert(AXI_BYTES % NP == 0, "NP must divide the AXI word width in bytes");
+
+    score_t boundary[M_MAX], boundary_e[M_MAX];
+#pragma HLS BIND_STORAGE variable=boundary type=ram_t2p impl=bram
+#pragma HLS BIND_STORAGE variable=boundary_e type=ram_t2p impl=bram
+
+    score_t max_similarity = 0;
+    int max_idx_tmp = 0;
+
+    int stripes = (n + NP - 1) / NP;
+    int stripe_size = lsal_stripe_size(NP, m, AFF_PER_WORD);
+
+    Stripe: for (int s = 0; s < stripes; s++) {
+#pragma HLS LOOP_TRIPCOUNT min=1 max=Q_MAX/NP
+        int width = (n - s * NP < NP) ? n - s * NP : NP;
+        score_t stripe_max;
+        int stripe_idx;
+
+        lsal_stripe_affine<NP>(q, d, direction, boundary, boundary_e, s, stripes, width, m, stripe_max, stripe_idx);
+
+        if (max_similarity <= stripe_max) {
+            max_similarity = stripe_max;
+            max_idx_tmp = s * stripe_size + stripe_idx;
+        }
+    }
+
+    *max_idx = max_idx_tmp;
+    *max_score = max_similarity;
+}
+
+void lsal_compute_matrices_aug(const axi_word_t *q,
+							   const axi_word_t *d,
+							   int *max_idx,
+							   int *max_score,
+							   axi_word_t *direction,
+							   int n,
+							   int m)
+{
+#pragma HLS TOP name=lsal_compute_matrices_aug
+#pragma HLS INTERFACE m_axi port=max_idx bundle=hp1 offset=slave
+#pragma HLS INTERFACE m_axi port=max_score bundle=hp1 offset=slave
+#pragma HLS INTERFACE m_axi port=d bundle=hp0 offset=slave max_read_burst_length=64 num_read_outstanding=4
+#pragma HLS INTERFACE m_axi port=q bundle=hp1 offset=slave
+#pragma HLS INTERFACE m_axi port=direction bundle=hp2 offset=slave max_write_burst_length=64 num_write_outstanding=4
+#pragma HLS INTERFACE s_axilite port=n
+#pragma HLS INTERFACE s_axilite port=m
+#pragma HLS INTERFACE s_axilite port=return
+
+    lsal_systolic<N_MAX>(q, d, max_idx, max_score, direction, n, m);
+}
+
+void lsal_compute_score_aug(const axi_word_t *q,
+							const axi_word_t *d,
+							int *max_idx,
+							int *max_score,
+							int n,
+							int m)
+{
+#pragma HLS TOP name=lsal_compute_score_aug
+#pragma HLS INTERFACE m_axi port=max_idx bundle=hp1 offset=slave
+#pragma HLS INTERFACE m_axi port=max_score bundle=hp1 offset=slave
+#pragma HLS INTERFACE m_axi port=d bundle=hp0 offset=slave max_read_burst_length=64 num_read_outstanding=4
+#pragma HLS INTERFACE m_axi port=q bundle=hp1 offset=slave
+#pragma HLS INTERFACE s_axilite port=n
+#pragma HLS INTERFACE s_axilite port=m
+#pragma HLS INTERFACE s_axilite port=return
+
+    lsal_systolic_score<N_MAX>(q, d, max_idx, max_score, n, m);
+}
+
+void lsal_compute_batch_aug(const axi_word_t *q,
+							const axi_word_t *d,
+							const int *offsets,
+							int *results,
+							int n,
+							int records)
+{
+#pragma HLS TOP name=lsal_compute_batch_aug
+#pragma HLS INTERFACE m_axi port=d bundle=hp0 offset=slave max_read_burst_length=64 num_read_outstanding=4
+#pragma HLS INTERFACE m_axi port=q bundle=hp1 offset=slave
+#pragma HLS INTERFACE m_axi port=offsets bundle=hp1 offset=slave
+#pragma HLS INTERFACE m_axi port=results bundle=hp2 offset=slave
+#pragma HLS INTERFACE s_axilite port=n
+#pragma HLS INTERFACE s_axilite port=records
+#pragma HLS INTERFACE s_axilite port=return
+
+    lsal_systolic_batch<N_MAX>(q, d, offsets, results, n, records);
+}
+
+void lsal_compute_lanes_aug(const axi_word_t *q,
+							const axi_word_t *d,
+							int *results,
+							int n,
+							int m,
+							int queries)
+{
+#pragma HLS TOP name=lsal_compute_lanes_aug
+#pragma HLS INTERFACE m_axi port=d bundle=hp0 offset=slave max_read_burst_length=64 num_read_outstanding=4
+#pragma HLS INTERFACE m_axi port=q bundle=hp1 offset=slave
+#pragma HLS INTERFACE m_axi port=results bundle=hp2 offset=slave
+#pragma HLS INTERFACE s_axilite port=n
+#pragma HLS INTERFACE s_axilite port=m
+#pragma HLS INTERFACE s_axilite port=queries
+#pragma HLS INTERFACE s_axilite port=return
+
+    lsal_systolic_lanes<N_MAX, LANES>(q, d, results, n, m, queries);
+}
+
+void lsal_compute_affine_aug(const axi_word_t *q,
+							 const axi_word_t *d,
+							 int *max_idx,
+							 int *max_score,
+							 axi_word_t *direction,
+							 int n,
+							 int m)
+{
+#pragma HLS TOP name=lsal_compute_affine_aug
+#pragma HLS INTERFACE m_axi port=max_idx bundle=hp1 offset=slave
+#pragma HLS INTERFACE m_axi port=max_score bundle=hp1 offset=slave
+#pragma HLS INTERFACE m_axi port=d bundle=hp0 offset=slave max_read_burst_length=64 num_read_outstanding=4
+#pragma HLS INTERFACE m_axi port=q bundle=hp1 offset=slave
+#pragma HLS INTERFACE m_axi port=direction bundle=hp2 offset=slave max_write_burst_length=64 num_write_outstanding=4
+#pragma HLS INTERFACE s_axilite port=n
+#pragma HLS INTERFACE s_axilite port=m
+#pragma HLS INTERFACE s_axilite port=return
+
+    lsal_systolic_affine<N_MAX>(q, d, max_idx, max_score, direction, n, m);
+}
+
+void lsal_compute_hits_aug(const axi_word_t *q,
+						   const axi_word_t *d,
+						   axi_word_t *hits,
+						   int n,
+						   int m,
+						   int threshold)
+{
+#pragma HLS TOP name=lsal_compute_hits_aug
+#pragma HLS INTERFACE m_axi port=d bundle=hp0 offset=slave max_read_burst_length=64 num_read_outstanding=4
+#pragma HLS INTERFACE m_axi port=q bundle=hp1 offset=slave
+#pragma HLS INTERFACE m_axi port=hits bundle=hp2 offset=slave
+#pragma HLS INTERFACE s_axilite port=n
+#pragma HLS INTERFACE s_axilite port=m
+#pragma HLS INTERFACE s_axilite port=threshold
+#pragma HLS INTERFACE s_axilite port=return
+
+    lsal_systolic_hits<N_MAX>(q, d, hits, n, m, threshold);
 }
@@ -6,8 +6,56 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ap_int.h>
+#include <hls_stream.h>
+
+// Number of processing elements, i.e. the width of one query stripe; must divide 64
+#ifndef N_MAX
+#define N_MAX 32
+#endif
+
+// Longest database a query of more than one stripe can run against (on-chip boundary rows)
+#ifndef M_MAX
+#define M_MAX 65536
+#endif
+
+// Longest query the loop tripcounts are reported for; scores fit 16 bits up to 16383 bases
+#ifndef Q_MAX
+#define Q_MAX 4096
+#endif
+
+// Number of PE arrays in the multi-lane kernel, each aligning its own query
+#ifndef LANES
+#define LANES 4
+#endif
+
+// Hits kernel: regions kept per query column, and the row gap that closes a region
+#ifndef HIT_K
+#define HIT_K 4
+#endif
+#ifndef HIT_SPAN
+#define HIT_SPAN 16
+#endif
+
+// Width of the AXI data ports: 64 bytes per beat
+#define AXI_BYTES 64
+
+// Directions are packed 2 bits per cell, 4 cells per byte
+#define DIR_BITS 2
+#define DIR_PER_WORD (8 * AXI_BYTES / DIR_BITS)
+
+// Affine-gap directions take 4 bits per cell, 2 cells per byte
+#define AFF_BITS 4
+#define AFF_PER_WORD (8 * AXI_BYTES / AFF_BITS)
+
+typedef short score_t;
+typedef ap_uint<8 * AXI_BYTES> axi_word_t;
 
 extern "C" {
-void lsal_compute_matrices_aug(char *q, char *d, int *max_idx, char *direction);
+void lsal_compute_matrices_aug(const axi_word_t *q, const axi_word_t *d, int *max_idx, int *max_score, axi_word_t *direction, int n, int m);
+void lsal_compute_score_aug(const axi_word_t *q, const axi_word_t *d, int *max_idx, int *max_score, int n, int m);
+void lsal_compute_batch_aug(const axi_word_t *q, const axi_word_t *d, const int *offsets, int *results, int n, int records);
+void lsal_compute_affine_aug(const axi_word_t *q, const axi_word_t *d, int *max_idx, int *max_score, axi_word_t *direction, int n, int m);
+void lsal_compute_hits_aug(const axi_word_t *q, const axi_word_t *d, axi_word_t *hits, int n, int m, int threshold);
+void lsal_compute_lanes_aug(const axi_word_t *q, const axi_word_t *d, int *results, int n, int m, int queries);
 }
 #endif
@@ -11,25 +11,64 @@
 #include <unistd.h>
 #include <assert.h>
 #include <stdbool.h>
+#include <time.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <stdint.h>
+#include <signal.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <CL/opencl.h>
 #include <CL/cl_ext.h>
 
-#define N 32
-#define M 65536
+// Must match lsal.h: the number of PEs, i.e. the width of one query stripe, the longest
+// database a multi-stripe query can run against, and the AXI word the buffers are padded to
+#define N_MAX 32
+#define M_MAX 65536
+#define AXI_BYTES 64
+
+// HW directions are packed 2 bits per cell, 4 cells per byte
+#define DIR_BITS 2
+#define DIR_PER_BYTE (8 / DIR_BITS)
+
+#define DIR_D 1
+#define DIR_U 2
+#define DIR_L 3
+#define DIR_NONE 0
+
+// Affine-gap directions: 4 bits per cell, the source of H then the E and F extend bits
+#define AFF_BITS 4
+#define AFF_PER_BYTE (8 / AFF_BITS)
+#define AFF_E_EXT 4
+#define AFF_F_EXT 8
+#define AFF_NEG (-16384)                // E and F of cells outside the matrix
+
+// Must match lsal.h: the PE arrays of the multi-lane kernel
+#define LANES 4
+
+// Must match lsal.h: hit regions kept per query column, and the row gap that closes a region
+#define HIT_K 4
+#define HIT_SPAN 16
+
+// Upper bound on the compute units linked into the xclbin
+#define MAX_CUS 16
 
 const int Match = 2;
 const int Mismatch = -1;
 const int Gap_row = -1;
 const int Gap_col = -1;
+const int Gap_open = -3;
+const int Gap_extend = -1;
 
  /***************************************************************************************
   * This is the golden code which runs in the CPU (and is the same code that you developed for x86 / Arm) 
   * It will be used to verify the correct functionality of the HW implementation.  
   * Its usefulness is mainly when you perform software emulation (sw_emu).
   ***************************************************************************************/
-void lsal_compute_matrices_sw(char *q, char *d, size_t *max_idx, int *similarity, char *direction) {
+void lsal_compute_matrices_sw(char *q, char *d, size_t *max_idx, int *similarity, char *direction, size_t N, size_t M) {
     int max_similarity = 0;
     *max_idx = 0;
 
@@ -61,44 +100,111 @@ void lsal_compute_matrices_sw(char *q, char *d, size_t *max_idx, int *similarity
     }
 }
 
-void lsal_traceback_hw(const char *q, const char *d, char *direction, size_t max_idx) {
-    char aligned_d[512], aligned_q[512];
-    int strpos = 511;
+/*
+ The HW direction matrix holds one block of N_MAX * (M + N_MAX - 1) cells per query stripe,
+ padded to whole AXI words. Each block is skewed: its row r is anti-diagonal r, so cell (r, c)
+ of stripe s is database row r - c and query column s * N_MAX + c. Cells are 2-bit DIR_*
+ codes, cell k in bits 2 * (k % 4) of byte k / 4; indices below count cells, not bytes.
+ */
+size_t lsal_axi_round(size_t bytes) {
+	return (bytes + AXI_BYTES - 1) / AXI_BYTES * AXI_BYTES;
+}
+
+size_t lsal_hw_stripe_size(size_t M) {
+	return lsal_axi_round((N_MAX * (M + N_MAX - 1) + DIR_PER_BYTE - 1) / DIR_PER_BYTE) * DIR_PER_BYTE;
+}
+
+char lsal_hw_direction(const unsigned char *direction, size_t idx) {
+	return (direction[idx / DIR_PER_BYTE] >> (DIR_BITS * (idx % DIR_PER_BYTE))) & 3;
+}
+
+size_t lsal_hw_index(size_t row, size_t col, size_t M) {
+	size_t c = col % N_MAX;
+	return (col / N_MAX) * lsal_hw_stripe_size(M) + (row + c) * N_MAX + c;
+}
+
+void lsal_hw_position(size_t idx, size_t M, size_t *row, size_t *col) {
+	size_t stripe_size = lsal_hw_stripe_size(M);
+	size_t c = idx % stripe_size % N_MAX;
+	*row = idx % stripe_size / N_MAX - c;
+	*col = idx / stripe_size * N_MAX + c;
+}
+
+void lsal_traceback_hw(const char *q, const char *d, const unsigned char *direction, size_t max_idx, size_t N, size_t M) {
+    char *aligned_d = (char *) malloc(N + M + 2);
+    char *aligned_q = (char *) malloc(N + M + 2);
+    int strpos = N + M + 1;
     aligned_d[strpos] = '\0';
     aligned_q[strpos] = '\0';
     strpos--;
 
-    int idx = max_idx;
-    int row = idx / N;
-    int col = idx % N;
+    size_t start_row, start_col;
+    lsal_hw_position(max_idx, M, &start_row, &start_col);
+    long row = start_row, col = start_col;
 
-    while (row >= 0 && col >= 0 && direction[idx] != '-') {
-        if (direction[idx] == 'D') {
+    while (row >= 0 && col >= 0 && lsal_hw_direction(direction, lsal_hw_index(row, col, M)) != DIR_NONE) {
+        char dir = lsal_hw_direction(direction, lsal_hw_index(row, col, M));
+        if (dir == DIR_D) {
             aligned_q[strpos] = q[col];
-            aligned_d[strpos] = d[row + N - 1 - col];
-            row -= 2; col--;
-        } else if (direction[idx] == 'U') {
+            aligned_d[strpos] = d[row];
+            row--; col--;
+        } else if (dir == DIR_U) {
             aligned_q[strpos] = '-';
-            aligned_d[strpos] = d[row + N - 1 - col];
+            aligned_d[strpos] = d[row];
             row--;
-        } else if (direction[idx] == 'L') {
+        } else if (dir == DIR_L) {
             aligned_q[strpos] = q[col];
             aligned_d[strpos] = '-';
-            row--; col--;
+            col--;
         }
 
-        idx = row * N + col;
         strpos--;
     }
 
     printf("\nAligned Sequences:\n");
     printf("Q: %s\n", &aligned_q[strpos + 1]);
     printf("D: %s\n", &aligned_d[strpos + 1]);
+
+    free(aligned_d);
+    free(aligned_q);
+}
+
+/*
+ Checks the whole HW direction matrix of a database window against the SW similarity matrix
+ of the same window: every cell must hold DIR_NONE exactly where the score is 0, and otherwise
+ a direction its score can be derived from. Ties may be broken differently from the SW code,
+ so the directions themselves are not compared. Returns the number of inconsistent cells.
+ */
+size_t lsal_check_directions_hw(const char *q, const char *d, const unsigned char *direction, const int *similarity,
+		size_t N, size_t M) {
+	size_t bad = 0;
+
+	for (size_t row = 0; row < M; row++) {
+		for (size_t col = 0; col < N; col++) {
+			int score = similarity[row * N + col];
+			int diag = (row > 0 && col > 0) ? similarity[(row - 1) * N + col - 1] : 0;
+			int up = row > 0 ? similarity[(row - 1) * N + col] : 0;
+			int left = col > 0 ? similarity[row * N + col - 1] : 0;
+			char dir = lsal_hw_direction(direction, lsal_hw_index(row, col, M));
+
+			int ok;
+			if (dir == DIR_NONE) ok = score == 0;
+			else if (dir == DIR_D) ok = score > 0 && score == diag + ((d[row] == q[col]) ? Match : Mismatch);
+			else if (dir == DIR_U) ok = score > 0 && score == up + Gap_row;
+			else ok = score > 0 && score == left + Gap_col;
+
+			if (!ok && bad++ < 5) {
+				printf("Error, HW direction %d at (%lu, %lu) does not give score %d\n", dir, row, col, score);
+			}
+		}
+	}
+	return bad;
 }
 
-void lsal_traceback_sw(const char *q, const char *d, int *similarity, char *direction, size_t max_idx) {
-  char aligned_d[512], aligned_q[512];
-  int strpos = 511;
+void lsal_traceback_sw(const char *q, const char *d, int *similarity, char *direction, size_t max_idx, size_t N, size_t M) {
+  char *aligned_d = (char *) malloc(N + M + 2);
+  char *aligned_q = (char *) malloc(N + M + 2);
+  int strpos = N + M + 1;
   aligned_d[strpos] = '\0';
   aligned_q[strpos] = '\0';
   strpos--;
@@ -129,6 +235,37 @@ void lsal_traceback_sw(const char *q, const char *d, int *similarity, char *dire
   printf("\nAligned Sequences:\n");
   printf("Q: %s\n", &aligned_q[strpos + 1]);
   printf("D: %s\n", &aligned_d[strpos + 1]);
+
+  free(aligned_d);
+  free(aligned_q);
+}
+
+/*
+ Rebuilds the alignment ending at (row, col) for the score-only kernel. Its a matches,
+ b mismatches and g gaps score 2a - b - g = score over at most a + b + g rows, with
+ a <= col + 1, so it starts no more than 3 * (col + 1) - score rows above `row`. The
+ directions are recomputed on the CPU for that window only, which holds the alignment
+ whole and therefore reproduces its score at (row, col).
+ */
+void lsal_traceback_window(const char *q, const char *d, size_t row, size_t col, int score) {
+	size_t cols = col + 1;
+	size_t span = 3 * cols > (size_t) score ? 3 * cols - score : 1;
+	size_t rows = span < row + 1 ? span : row + 1;
+	const char *d_window = d + row + 1 - rows;
+
+	int *similarity = (int *) malloc(sizeof(int) * rows * cols);
+	char *direction = (char *) malloc(sizeof(char) * rows * cols);
+	size_t max_idx;
+
+	lsal_compute_matrices_sw((char *) q, (char *) d_window, &max_idx, similarity, direction, cols, rows);
+	if (similarity[rows * cols - 1] != score) {
+		printf("Error, window score %d at (%lu, %lu) does not match the HW score %d\n",
+				similarity[rows * cols - 1], row, col, score);
+	}
+	lsal_traceback_sw(q, d_window, similarity, direction, rows * cols - 1, cols, rows);
+
+	free(similarity);
+	free(direction);
 }
 
 /*
@@ -150,6 +287,184 @@ double getTimeDifference(cl_event event) {
 }
 
 
+/*
+ Given the events of tasks that ran concurrently, this function returns the time in ms
+ from the first start to the last end
+ */
+double getTimeSpan(cl_event *events, int count) {
+	cl_ulong first_start = 0;
+	cl_ulong last_end = 0;
+
+	for (int i = 0; i < count; i++) {
+		cl_ulong time_start = 0;
+		cl_ulong time_end = 0;
+
+		clGetEventProfilingInfo(events[i],
+		CL_PROFILING_COMMAND_START, sizeof(time_start), &time_start,
+		NULL);
+		clGetEventProfilingInfo(events[i],
+		CL_PROFILING_COMMAND_END, sizeof(time_end), &time_end,
+		NULL);
+		if (i == 0 || time_start < first_start) first_start = time_start;
+		if (time_end > last_end) last_end = time_end;
+	}
+	return (last_end - first_start) / 1000000.0; // To convert nanoseconds to milliseconds
+}
+
+cl_ulong lsal_event_time(cl_event event, cl_profiling_info info) {
+	cl_ulong t = 0;
+	clGetEventProfilingInfo(event, info, sizeof(t), &t, NULL);
+	return t;
+}
+
+double lsal_wall_ms(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+/*
+ Profile of one run: every host phase, timed with the monotonic clock, and every OpenCL
+ command with its queued/submit/start/end timestamps. Set LSAL_PROFILE to a file name (or
+ "-" for stdout) to get it as JSON at exit. Phases are in ms since the program started,
+ commands in ms since the first command was queued.
+ */
+#define LSAL_PROF_MAX 4096
+#define LSAL_PROF_LABEL 64
+
+typedef struct {
+	char name[LSAL_PROF_LABEL];
+	double start_ms, end_ms;
+} lsal_prof_phase_t;
+
+typedef struct {
+	char name[LSAL_PROF_LABEL];
+	cl_ulong queued, submit, start, end;
+} lsal_prof_command_t;
+
+typedef struct {
+	double origin_ms;
+	int num_phases, num_commands;
+	lsal_prof_phase_t phases[LSAL_PROF_MAX];
+	lsal_prof_command_t commands[LSAL_PROF_MAX];
+} lsal_profile_t;
+
+static lsal_profile_t lsal_prof;
+
+void lsal_prof_init(void) {
+	lsal_prof.origin_ms = lsal_wall_ms();
+	lsal_prof.num_phases = 0;
+	lsal_prof.num_commands = 0;
+}
+
+// Starts a host phase, returns its handle for lsal_prof_end
+int lsal_prof_begin(const char *fmt, ...) {
+	if (lsal_prof.num_phases == LSAL_PROF_MAX) return -1;
+
+	lsal_prof_phase_t *ph = &lsal_prof.phases[lsal_prof.num_phases];
+	va_list ap;
+	va_start(ap, fmt);
+	vsnprintf(ph->name, sizeof(ph->name), fmt, ap);
+	va_end(ap);
+	ph->start_ms = ph->end_ms = lsal_wall_ms() - lsal_prof.origin_ms;
+	return lsal_prof.num_phases++;
+}
+
+void lsal_prof_end(int phase) {
+	if (phase >= 0) lsal_prof.phases[phase].end_ms = lsal_wall_ms() - lsal_prof.origin_ms;
+}
+
+// Records a completed command, before its event is released
+void lsal_prof_command(cl_event event, const char *fmt, ...) {
+	if (lsal_prof.num_commands == LSAL_PROF_MAX) return;
+
+	lsal_prof_command_t *c = &lsal_prof.commands[lsal_prof.num_commands++];
+	va_list ap;
+	va_start(ap, fmt);
+	vsnprintf(c->name, sizeof(c->name), fmt, ap);
+	va_end(ap);
+	c->queued = lsal_event_time(event, CL_PROFILING_COMMAND_QUEUED);
+	c->submit = lsal_event_time(event, CL_PROFILING_COMMAND_SUBMIT);
+	c->start = lsal_event_time(event, CL_PROFILING_COMMAND_START);
+	c->end = lsal_event_time(event, CL_PROFILING_COMMAND_END);
+}
+
+void lsal_prof_write(const char *mode, int N, long M) {
+	const char *path = getenv("LSAL_PROFILE");
+	if (!path || !*path) return;
+
+	FILE *f = strcmp(path, "-") ? fopen(path, "w") : stdout;
+	if (!f) {
+		printf("Error: cannot write the profile to %s\n", path);
+		return;
+	}
+
+	cl_ulong base = 0;
+	for (int i = 0; i < lsal_prof.num_commands; i++) {
+		if (i == 0 || lsal_prof.commands[i].queued < base) base = lsal_prof.commands[i].queued;
+	}
+
+	fprintf(f, "{\n  \"mode\": \"%s\", \"N\": %d, \"M\": %ld,\n  \"phases\": [", mode, N, M);
+	for (int i = 0; i < lsal_prof.num_phases; i++) {
+		lsal_prof_phase_t *ph = &lsal_prof.phases[i];
+		fprintf(f, "%s\n    {\"name\": \"%s\", \"start_ms\": %.3f, \"duration_ms\": %.3f}", i ? "," : "",
+				ph->name, ph->start_ms, ph->end_ms - ph->start_ms);
+	}
+	fprintf(f, "\n  ],\n  \"commands\": [");
+	for (int i = 0; i < lsal_prof.num_commands; i++) {
+		lsal_prof_command_t *c = &lsal_prof.commands[i];
+		fprintf(f, "%s\n    {\"name\": \"%s\", \"queued_ms\": %.3f, \"submit_ms\": %.3f, \"start_ms\": %.3f, "
+				"\"end_ms\": %.3f, \"wait_ms\": %.3f, \"run_ms\": %.3f}", i ? "," : "", c->name,
+				(c->queued - base) / 1e6, (c->submit - base) / 1e6, (c->start - base) / 1e6,
+				(c->end - base) / 1e6, (c->start - c->queued) / 1e6, (c->end - c->start) / 1e6);
+	}
+	fprintf(f, "\n  ]\n}\n");
+
+	if (f != stdout) fclose(f);
+}
+
+/*
+ The database is split into shards, at least one per compute unit, dealt round-robin over
+ the CUs. A shard owns the rows [own_start, own_end) and is computed together with the 3N
+ rows before it: a positive-scoring local alignment against an N-long query spans fewer
+ than 3N rows, so every alignment ending in the owned rows is found exactly by this shard
+ alone. The kernel keeps a boundary column of M_MAX rows on chip, so shards are also cut
+ to at most M_MAX rows.
+ */
+typedef struct {
+	size_t own_start, own_end;
+	size_t win_start, rows;         // the computed window, rows = own_end - win_start
+	size_t database_size;           // window padded with N_MAX - 1 'X' in front and N_MAX behind
+	size_t matrix_size;             // bytes of packed directions
+	unsigned char *direction;       // the mapped direction buffer
+	cl_int max_index, max_score;
+	cl_kernel kernel;               // the CU this shard runs on
+	cl_mem database_buf, direction_buf, max_index_buf, max_score_buf;
+	cl_event write_event, kernel_event, read_events[3];
+} lsal_shard_t;
+
+int lsal_count_shards(int num_cus, size_t N, size_t M) {
+	size_t count = num_cus;
+	size_t own_max = M_MAX - 3 * N;
+	size_t needed = (M + own_max - 1) / own_max;
+	if (needed > count) count = needed;
+	return count < M ? count : M;
+}
+
+void lsal_plan_shards(lsal_shard_t *shards, int count, size_t N, size_t M, size_t stripes) {
+	size_t overlap = 3 * N;
+
+	for (int s = 0; s < count; s++) {
+		lsal_shard_t *sh = &shards[s];
+		sh->own_start = M * s / count;
+		sh->own_end = M * (s + 1) / count;
+		sh->win_start = sh->own_start > overlap ? sh->own_start - overlap : 0;
+		sh->rows = sh->own_end - sh->win_start;
+		sh->database_size = lsal_axi_round(sh->rows + 2 * N_MAX - 1);
+		sh->matrix_size = stripes * lsal_hw_stripe_size(sh->rows) / DIR_PER_BYTE;
+	}
+}
+
 /*
  return a random number between 0 and limit inclusive.
  */
@@ -203,69 +518,22 @@ int load_file_to_memory(const char *filename, char **result) {
 }
 
 /*******************************************************************************
- *   Host program running on the Arm CPU. 
- *   The code is written using the OpenCL API. 
- *   We have provided multiple comments for you to understand where each thing  
+ *   Steps 1 to 5: finds the FPGA, creates a context and an out-of-order,
+ *   profiling command queue on it, and builds the program from the xclbin.
+ *   Returns 0 on success, -1 after printing what failed.
 *******************************************************************************/
-int main(int argc, char** argv) {
-	printf("starting HOST code \n");
-	fflush(stdout);
+int lsal_cl_setup(const char *xclbin, cl_context *context_out, cl_command_queue *commands_out,
+		cl_program *program_out) {
 	int err;                            // error code returned from api calls
-	cl_uint matrix_size;
-
-	if (argc != 2) {
-		printf("%s <input xclbin file>\n", argv[0]);
-		return EXIT_FAILURE;
-	}
-
-    // if (argc != 4) {
-	// 	printf("%s <input xclbin file> <Query Size N> <DataBase Size M>\n", argv[0]);
-	// 	return EXIT_FAILURE;
-	// }
-	
-    // cl_uint N = atoi(argv[2]); 
-    // cl_uint M = atoi(argv[3]);
-    // if (N <= 0 || M <= 0) {
-    // 	printf("N and M should be positive numbers. \n");
-	// 	return EXIT_FAILURE;
-	// }
-
-    matrix_size = N*M;
-    matrix_size_hw = N * (M + N - 1);
-
-	char *query = (char*) malloc(sizeof(char) * N);
-	char *database = (char*) malloc(sizeof(char) * M);
-	char *database_hw = (char*) malloc(sizeof(char) * (M + 2 * (N - 1)));
-	char *direction_matrix_hw = (char*) malloc(sizeof(char) * matrix_size_hw);
-    size_t *max_index_hw = (size_t *) malloc(sizeof(size_t));
-
-	printf("array defined! \n");
-    fflush(stdout);
-
 	cl_platform_id platform_id;         // platform id
 	cl_device_id device_id;             // compute device id
 	cl_context context;                 // compute context
 	cl_command_queue commands;          // compute command queue
 	cl_program program;                 // compute program
-	cl_kernel kernel;                   // compute kernel
 
 	char cl_platform_vendor[1001];
 	char cl_platform_name[1001];
 
-	cl_mem input_query;
-	cl_mem input_database;
-	cl_mem output_similarity_matrix;
-	cl_mem output_direction_matrix;
-	cl_mem output_max_index;
-
-	fillRandom(query, N);
-	fillRandom(database, M);
-
-	memset(database_hw, 'X', sizeof(char) * (M + 2 * (N - 1)));
-	memcpy(database_hw + N - 1, database, sizeof(char) * M);
-	
-	memset(direction_matrix_hw, 0, sizeof(short) * matrix_size_hw);
-
 /**********************************************
  * 			Xilinx OpenCL Initialization
  *
@@ -284,12 +552,13 @@ int main(int argc, char** argv) {
    * If the underlying platform has other accelerators
    * available, we could use them too (e.g. GPU, CPU).
 	**************************************************/
+	int phase = lsal_prof_begin("platform_device");
 	printf("GET platform \n");
 	err = clGetPlatformIDs(1, &platform_id, NULL);
 	if (err != CL_SUCCESS) {
 		printf("Error: Failed to find an OpenCL platform!\n");
 		printf("Test failed\n");
-		return EXIT_FAILURE;
+		return -1;
 	}
 	printf("GET platform vendor \n");
 	err = clGetPlatformInfo(platform_id, CL_PLATFORM_VENDOR, 1000,
@@ -297,7 +566,7 @@ int main(int argc, char** argv) {
 	if (err != CL_SUCCESS) {
 		printf("Error: clGetPlatformInfo(CL_PLATFORM_VENDOR) failed!\n");
 		printf("Test failed\n");
-		return EXIT_FAILURE;
+		return -1;
 	}
 	printf("CL_PLATFORM_VENDOR %s\n", cl_platform_vendor);
 	printf("GET platform name \n");
@@ -306,7 +575,7 @@ int main(int argc, char** argv) {
 	if (err != CL_SUCCESS) {
 		printf("Error: clGetPlatformInfo(CL_PLATFORM_NAME) failed!\n");
 		printf("Test failed\n");
-		return EXIT_FAILURE;
+		return -1;
 	}
 	printf("CL_PLATFORM_NAME %s\n", cl_platform_name);
 
@@ -321,31 +590,33 @@ int main(int argc, char** argv) {
 	if (err != CL_SUCCESS) {
 		printf("Error: Failed to create a device group!\n");
 		printf("Test failed\n");
-		return EXIT_FAILURE;
+		return -1;
 	}
 
 	/*********************************************
 	 * Step 2 : Create Context
 	 *********************************************/
+	lsal_prof_end(phase);
+	phase = lsal_prof_begin("context_queue");
 	printf("create context \n");
 	context = clCreateContext(0, 1, &device_id, NULL, NULL, &err);
 	if (!context) {
 		printf("Error: Failed to create a compute context!\n");
 		printf("Test failed\n");
-		return EXIT_FAILURE;
+		return -1;
 	}
 
    /*********************************************
-	 * Step 3 : Create Command Queue
+	 * Step 3 : Create Command Queue, out of order so the CUs run concurrently
 	 *********************************************/
 	printf("create queue \n");
 	commands = clCreateCommandQueue(context, device_id,
-	CL_QUEUE_PROFILING_ENABLE, &err);
+	CL_QUEUE_PROFILING_ENABLE | CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE, &err);
 	if (!commands) {
 		printf("Error: Failed to create a command commands!\n");
 		printf("Error: code %i\n", err);
 		printf("Test failed\n");
-		return EXIT_FAILURE;
+		return -1;
 	}
 
 	cl_int binary_status;
@@ -354,13 +625,14 @@ int main(int argc, char** argv) {
 	 * Step 4 : Load Hardware Binary File (*.xclbin) from disk
 	 **********************************************/
 	unsigned char *kernelbinary;
-	char *xclbin = argv[1];
+	lsal_prof_end(phase);
+	phase = lsal_prof_begin("xclbin_load");
 	printf("loading %s\n", xclbin);
 	int n_i = load_file_to_memory(xclbin, (char **) &kernelbinary);
 	if (n_i < 0) {
 		printf("failed to load kernel from xclbin: %s\n", xclbin);
 		printf("Test failed\n");
-		return EXIT_FAILURE;
+		return -1;
 	}
 
   /********************************************************
@@ -368,6 +640,8 @@ int main(int argc, char** argv) {
 	********************************************************/
 	size_t n = n_i;
 	// Create the compute program from offline
+	lsal_prof_end(phase);
+	phase = lsal_prof_begin("program_create");
 	printf("create program with binary \n");
 	program = clCreateProgramWithBinary(context, 1, &device_id, &n,
 			(const unsigned char **) &kernelbinary, &binary_status, &err);
@@ -377,14 +651,11 @@ int main(int argc, char** argv) {
 		printf("Error: Failed to create compute program from binary %d!\n",
 				err);
 		printf("Test failed\n");
-		return EXIT_FAILURE;
+		return -1;
 	}
 
-	/**************************************************************
-	 *  Step 6 for 1 Compute Unit: Create Kernels - the actual handler of the kernel that
-    *           we will be using. We first create a program, and then
-    *           obtain the kernel handler from the program.
-	 **************************************************************/
+	lsal_prof_end(phase);
+	phase = lsal_prof_begin("program_build");
 	printf("build program \n");
 	err = clBuildProgram(program, 0, NULL, NULL, NULL, NULL);
 	if (err != CL_SUCCESS) {
@@ -396,238 +667,2461 @@ int main(int argc, char** argv) {
 				sizeof(buffer), buffer, &len);
 		printf("%s\n", buffer);
 		printf("Test failed\n");
-		return EXIT_FAILURE;
+		return -1;
 	}
 
-	// Create the compute kernel in the program we wish to run
-	//
-	printf("create kernel \n");
-	kernel = clCreateKernel(program, "compute_matrices", &err);
-	if (!kernel || err != CL_SUCCESS) {
-		printf("Error: Failed to create compute kernel!\n");
-		printf("Test failed\n");
+	lsal_prof_end(phase);
+
+	*context_out = context;
+	*commands_out = commands;
+	*program_out = program;
+	return 0;
+}
+
+/*
+ Step 6: creates one kernel handle per compute unit. With several CUs (v++ --connectivity.nk
+ <kernel>:<count>) every handle is bound to one instance, so the tasks cannot all land on
+ the same CU. Returns 0 on success, -1 after printing what failed.
+ */
+int lsal_cl_kernels(cl_program program, const char *kernel_base, int num_cus, cl_kernel *kernels) {
+	int err;
+
+	for (int cu = 0; cu < num_cus; cu++) {
+		char kernel_name[128];
+		if (num_cus == 1) {
+			snprintf(kernel_name, sizeof(kernel_name), "%s", kernel_base);
+		} else {
+			snprintf(kernel_name, sizeof(kernel_name), "%s:{%s_%d}", kernel_base, kernel_base, cu + 1);
+		}
+
+		printf("create kernel %s \n", kernel_name);
+		kernels[cu] = clCreateKernel(program, kernel_name, &err);
+		if (!kernels[cu] || err != CL_SUCCESS) {
+			printf("Error: Failed to create compute kernel %s!\n", kernel_name);
+			printf("Test failed\n");
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/*
+ Buffers are allocated by the runtime (CL_MEM_ALLOC_HOST_PTR). On the MPSoC that memory is
+ the DDR shared by the ARM and the FPGA, so mapping a buffer gives the host a pointer to the
+ very bytes the kernel reads or writes: inputs are built and results read in place, with no
+ clEnqueueWriteBuffer / clEnqueueReadBuffer copies. A buffer is unmapped before a kernel uses it.
+ */
+cl_mem lsal_shared_buffer(cl_context context, cl_mem_flags flags, size_t size) {
+	return clCreateBuffer(context, flags | CL_MEM_ALLOC_HOST_PTR, size, NULL, NULL);
+}
+
+// Maps the whole buffer: blocking without an event, otherwise once the wait list is done
+void *lsal_map(cl_command_queue commands, cl_mem buffer, cl_map_flags flags, size_t size,
+		cl_uint num_wait, const cl_event *wait, cl_event *event) {
+	cl_int err;
+	void *ptr = clEnqueueMapBuffer(commands, buffer, event ? CL_FALSE : CL_TRUE, flags, 0, size,
+			num_wait, wait, event, &err);
+	return err == CL_SUCCESS ? ptr : NULL;
+}
+
+/*
+ Batch mode: many database records per launch. The records are packed back to back into one
+ buffer per compute unit, record r of a batch being database[offsets[r] .. offsets[r + 1]),
+ and the kernel writes { score, row * N + col } per record into results.
+ */
+typedef struct {
+	int first, count;                   // records [first, first + count) of the run
+	size_t database_size;               // packed bytes, padded to an AXI word
+	cl_int *results;                    // 2 * count entries, mapped after the kernel
+	cl_kernel kernel;
+	cl_mem database_buf, offsets_buf, results_buf;
+	cl_event write_events[2], kernel_event, read_event;
+} lsal_batch_t;
+
+int lsal_run_batch(int argc, char **argv) {
+	int err;
+
+	if (argc != 5 && argc != 6) {
+		printf("%s -b <input xclbin file> <Query Size N> <Records> <Max Record Length> [<Compute Units>]\n", argv[0]);
 		return EXIT_FAILURE;
 	}
 
-    /**************************************************************-
-    * Step 7 : Create buffers.
-    * We do not need to allocate separate memory space (malloc), because
-    * on a MPSoC system (e.g. ZCU102 board), we map the memory space that is
-    * allocated at clCreateBuffer, to a usable memory space for our
-    * host application. We also do not need to use free for any reason.
-    * See Xilinx UG1393 for detailed information.
-    **************************************************************/
-	input_query = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(char) * N,
-	NULL, NULL);
-	input_database = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(char) * (M + 2 * (N - 1)),
-	NULL, NULL);
-	// output_similarity_matrix = clCreateBuffer(context, CL_MEM_READ_WRITE,
-	// 		sizeof(int) * M * N, NULL, NULL);
-	output_direction_matrix = clCreateBuffer(context, CL_MEM_READ_WRITE,
-			sizeof(char) * matrix_size_hw, NULL, NULL);
-	output_max_index = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(size_t),
-	NULL, NULL);
-
-	if (!input_query || !input_database || !output_similarity_matrix
-			|| !output_direction_matrix || !output_max_index) {
-		printf("Error: Failed to allocate device memory!\n");
-		printf("Test failed\n");
+	cl_int N = atoi(argv[2]);
+	int num_records = atoi(argv[3]);
+	int max_length = atoi(argv[4]);
+	int num_cus = argc == 6 ? atoi(argv[5]) : 1;
+	if (N <= 0 || num_records <= 0 || max_length <= 0) {
+		printf("N, the record count and the record length should be positive numbers. \n");
+		return EXIT_FAILURE;
+	}
+	if (N > 16383) {
+		printf("N should be at most 16383, the HW scores are 16 bits wide. \n");
+		return EXIT_FAILURE;
+	}
+	if (num_cus <= 0 || num_cus > MAX_CUS) {
+		printf("The number of compute units should be between 1 and %d. \n", MAX_CUS);
 		return EXIT_FAILURE;
 	}
+	if (num_cus > num_records) num_cus = num_records;
 
-   /**************************************************************
-    * Step 8 : Write the Input Data to the Write Buffers of the device memory
-    **************************************************************/
-	err = clEnqueueWriteBuffer(commands, input_query, CL_TRUE, 0,
-			sizeof(char) * N, query, 0, NULL, NULL);
-	if (err != CL_SUCCESS) {
-		printf("Error: Failed to write to source array a!\n");
-		printf("Test failed\n");
+	// The kernel keeps one boundary score per record row on chip
+	cl_int stripes = (N + N_MAX - 1) / N_MAX;
+	if (max_length > M_MAX) {
+		printf("Records should be at most %d long. \n", M_MAX);
 		return EXIT_FAILURE;
 	}
 
-	err = clEnqueueWriteBuffer(commands, input_database, CL_TRUE, 0,
-			sizeof(char) * (M + 2 * (N - 1)), database_hw, 0, NULL, NULL);
-	if (err != CL_SUCCESS) {
-		printf("Error: Failed to write to source array a!\n");
+	size_t query_size_hw = lsal_axi_round((size_t) stripes * N_MAX);
+	char *query = (char*) malloc(sizeof(char) * query_size_hw);
+	memset(query, 'X', sizeof(char) * query_size_hw);
+	fillRandom(query, N);
+
+	// Random record lengths in [1, max_length], all records in one host buffer
+	size_t *start = (size_t *) malloc(sizeof(size_t) * (num_records + 1));
+	start[0] = 0;
+	for (int r = 0; r < num_records; r++) start[r + 1] = start[r] + 1 + rand() % max_length;
+	size_t total = start[num_records];
+	char *database = (char*) malloc(sizeof(char) * total);
+	fillRandom(database, total);
+
+	// Contiguous runs of records with about the same number of characters per CU
+	lsal_batch_t batches[MAX_CUS];
+	memset(batches, 0, sizeof(batches));
+	int r = 0;
+	for (int b = 0; b < num_cus; b++) {
+		lsal_batch_t *ba = &batches[b];
+		size_t target = total * (b + 1) / num_cus;
+		ba->first = r;
+		// At least one record per batch, and one left for each of the following batches
+		while (r < num_records && num_records - r > num_cus - 1 - b
+				&& (r == ba->first || start[r + 1] <= target || b == num_cus - 1)) r++;
+		ba->count = r - ba->first;
+
+		size_t bytes = start[r] - start[ba->first];
+		if (bytes > 0x7fffffff - AXI_BYTES) {
+			printf("Batch %d does not fit 32-bit record offsets. \n", b);
+			return EXIT_FAILURE;
+		}
+		ba->database_size = lsal_axi_round(bytes + 1);
+	}
+
+	cl_context context;
+	cl_command_queue commands;
+	cl_program program;
+	cl_kernel kernels[MAX_CUS];
+
+	if (lsal_cl_setup(argv[1], &context, &commands, &program)) return EXIT_FAILURE;
+	if (lsal_cl_kernels(program, "lsal_compute_batch_aug", num_cus, kernels)) return EXIT_FAILURE;
+
+	cl_mem input_query = lsal_shared_buffer(context, CL_MEM_READ_ONLY, sizeof(char) * query_size_hw);
+	if (!input_query) {
+		printf("Error: Failed to allocate device memory!\n");
 		printf("Test failed\n");
 		return EXIT_FAILURE;
 	}
 
-	// err = clEnqueueWriteBuffer(commands, output_similarity_matrix, CL_TRUE, 0,
-	// 		sizeof(int) * matrix_size, similarity_matrix, 0, NULL, NULL);
-	// if (err != CL_SUCCESS) {
-	// 	printf("Error: Failed to write to source array a!\n");
-	// 	printf("Test failed\n");
-	// 	return EXIT_FAILURE;
-	// }
+	for (int b = 0; b < num_cus; b++) {
+		lsal_batch_t *ba = &batches[b];
+		ba->kernel = kernels[b];
+		ba->database_buf = lsal_shared_buffer(context, CL_MEM_READ_ONLY, sizeof(char) * ba->database_size);
+		ba->offsets_buf = lsal_shared_buffer(context, CL_MEM_READ_ONLY, sizeof(cl_int) * (ba->count + 1));
+		ba->results_buf = lsal_shared_buffer(context, CL_MEM_WRITE_ONLY, sizeof(cl_int) * 2 * ba->count);
+		if (!ba->database_buf || !ba->offsets_buf || !ba->results_buf) {
+			printf("Error: Failed to allocate device memory for batch %d!\n", b);
+			printf("Test failed\n");
+			return EXIT_FAILURE;
+		}
+	}
 
-	err = clEnqueueWriteBuffer(commands, output_direction_matrix, CL_TRUE, 0,
-				sizeof(char) * matrix_size_hw, direction_matrix_hw, 0, NULL, NULL);
+	cl_event write_query;
+	char *query_hw = (char*) lsal_map(commands, input_query, CL_MAP_WRITE_INVALIDATE_REGION,
+			sizeof(char) * query_size_hw, 0, NULL, NULL);
+	if (!query_hw) {
+		printf("Error: Failed to map the query!\n");
+		printf("Test failed\n");
+		return EXIT_FAILURE;
+	}
+	memcpy(query_hw, query, sizeof(char) * query_size_hw);
+	clEnqueueUnmapMemObject(commands, input_query, query_hw, 0, NULL, &write_query);
+
+	// One task per CU covers all of its records, packed in place in its mapped buffers
+	printf("LAUNCH %d records in %d batch(es) \n", num_records, num_cus);
+	int phase = lsal_prof_begin("input_build_enqueue");
+	for (int b = 0; b < num_cus; b++) {
+		lsal_batch_t *ba = &batches[b];
+		cl_int count = ba->count;
+
+		char *database_hw = (char*) lsal_map(commands, ba->database_buf, CL_MAP_WRITE_INVALIDATE_REGION,
+				sizeof(char) * ba->database_size, 0, NULL, NULL);
+		cl_int *offsets_hw = (cl_int*) lsal_map(commands, ba->offsets_buf, CL_MAP_WRITE_INVALIDATE_REGION,
+				sizeof(cl_int) * (ba->count + 1), 0, NULL, NULL);
+		if (!database_hw || !offsets_hw) {
+			printf("Error: Failed to map the inputs of batch %d!\n", b);
+			printf("Test failed\n");
+			return EXIT_FAILURE;
+		}
+		size_t bytes = start[ba->first + ba->count] - start[ba->first];
+		memset(database_hw + bytes, 'X', sizeof(char) * (ba->database_size - bytes));
+		memcpy(database_hw, database + start[ba->first], sizeof(char) * bytes);
+		for (int i = 0; i <= ba->count; i++) offsets_hw[i] = start[ba->first + i] - start[ba->first];
+
+		err = clEnqueueUnmapMemObject(commands, ba->database_buf, database_hw, 0, NULL, &ba->write_events[0]);
+		err |= clEnqueueUnmapMemObject(commands, ba->offsets_buf, offsets_hw, 0, NULL, &ba->write_events[1]);
+
+		err |= clSetKernelArg(ba->kernel, 0, sizeof(cl_mem), &input_query);
+		err |= clSetKernelArg(ba->kernel, 1, sizeof(cl_mem), &ba->database_buf);
+		err |= clSetKernelArg(ba->kernel, 2, sizeof(cl_mem), &ba->offsets_buf);
+		err |= clSetKernelArg(ba->kernel, 3, sizeof(cl_mem), &ba->results_buf);
+		err |= clSetKernelArg(ba->kernel, 4, sizeof(cl_int), &N);
+		err |= clSetKernelArg(ba->kernel, 5, sizeof(cl_int), &count);
+
+		cl_event inputs[3] = { write_query, ba->write_events[0], ba->write_events[1] };
+		err |= clEnqueueTask(commands, ba->kernel, 3, inputs, &ba->kernel_event);
+		cl_int map_err;
+		ba->results = (cl_int*) clEnqueueMapBuffer(commands, ba->results_buf, CL_FALSE, CL_MAP_READ, 0,
+				sizeof(cl_int) * 2 * ba->count, 1, &ba->kernel_event, &ba->read_event, &map_err);
+		err |= map_err;
 		if (err != CL_SUCCESS) {
-			printf("Error: Failed to write to source array a!\n");
+			printf("Error: Failed to launch batch %d! %d\n", b, err);
 			printf("Test failed\n");
 			return EXIT_FAILURE;
 		}
+	}
+	clFlush(commands);
+	lsal_prof_end(phase);
+
+	phase = lsal_prof_begin("device_wait");
+	cl_event kernel_events[MAX_CUS];
+	for (int b = 0; b < num_cus; b++) {
+		clWaitForEvents(1, &batches[b].read_event);
+		kernel_events[b] = batches[b].kernel_event;
+	}
+	lsal_prof_end(phase);
+	double executionTime = getTimeSpan(kernel_events, num_cus);
+
+	for (int b = 0; b < num_cus; b++) {
+		lsal_batch_t *ba = &batches[b];
+		lsal_prof_command(ba->write_events[0], "unmap database batch %d", b);
+		lsal_prof_command(ba->write_events[1], "unmap offsets batch %d", b);
+		lsal_prof_command(ba->kernel_event, "kernel batch %d", b);
+		lsal_prof_command(ba->read_event, "map results batch %d", b);
+		clReleaseEvent(ba->write_events[0]);
+		clReleaseEvent(ba->write_events[1]);
+		clReleaseEvent(ba->kernel_event);
+		clReleaseEvent(ba->read_event);
+		clReleaseMemObject(ba->database_buf);
+		clReleaseMemObject(ba->offsets_buf);
+		clReleaseKernel(kernels[b]);
+	}
+	lsal_prof_command(write_query, "unmap query");
+	clReleaseEvent(write_query);
+	clReleaseMemObject(input_query);
 
 	/**************************************************************
-	 * Step 9: Set the arguments to our compute kernel
+	 * Verify every record against the SW golden code
 	 **************************************************************/
-	err = 0;
-	printf("set arg 0 \n");
-	err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &input_query);
-	if (err != CL_SUCCESS) {
-		printf("Error: Failed to set kernel arguments 0! %d\n", err);
-		printf("Test failed\n");
+	phase = lsal_prof_begin("sw_golden");
+	int mismatches = 0, best_record = 0, best_score = -1;
+	size_t max_rows = 0;
+	for (int i = 0; i < num_records; i++) {
+		if (start[i + 1] - start[i] > max_rows) max_rows = start[i + 1] - start[i];
+	}
+	int * similarity_matrix_sw = ( int *) malloc(sizeof(int) * N * max_rows);
+	char * direction_matrix_sw = ( char*) malloc(sizeof(char) * N * max_rows);
+
+	for (int b = 0; b < num_cus; b++) {
+		lsal_batch_t *ba = &batches[b];
+		for (int i = 0; i < ba->count; i++) {
+			int rec = ba->first + i;
+			size_t rows = start[rec + 1] - start[rec], max_index_sw;
+			lsal_compute_matrices_sw(query, database + start[rec], &max_index_sw,
+					similarity_matrix_sw, direction_matrix_sw, N, rows);
+
+			int score_hw = ba->results[2 * i];
+			if (score_hw != similarity_matrix_sw[max_index_sw]) {
+				if (mismatches++ < 10) {
+					printf("Error, record %d: SW score %d, HW %d \n", rec,
+							similarity_matrix_sw[max_index_sw], score_hw);
+				}
+			}
+			if (score_hw > best_score) {
+				best_score = score_hw;
+				best_record = rec;
+			}
+		}
+	}
+
+	lsal_prof_end(phase);
+
+	double seconds = executionTime / 1000.0;
+	printf(" execution time is %lf ms on %d compute unit(s) \n", executionTime, num_cus);
+	printf(" %d records, %.0lf alignments/s, %.3lf GCUPS \n", num_records,
+			num_records / seconds, (double) N * total / seconds / 1e9);
+
+	lsal_batch_t *bb = &batches[0];
+	while (best_record >= bb->first + bb->count) bb++;
+	cl_int best_index = bb->results[2 * (best_record - bb->first) + 1];
+	printf("HW: Best record %d, score %d at (%d, %d)\n", best_record, best_score,
+			best_index / N, best_index % N);
+	phase = lsal_prof_begin("traceback_hw");
+	if (best_score > 0) {
+		lsal_traceback_window(query, database + start[best_record], best_index / N, best_index % N, best_score);
+	}
+	lsal_prof_end(phase);
+
+	if (mismatches == 0) {
+		printf("computation ended!- RESULTS CORRECT \n");
+	} else {
+		printf("Error, %d of %d records mismatch \n", mismatches, num_records);
+	}
+
+	for (int b = 0; b < num_cus; b++) {
+		clEnqueueUnmapMemObject(commands, batches[b].results_buf, batches[b].results, 0, NULL, NULL);
+	}
+	clFinish(commands);
+	for (int b = 0; b < num_cus; b++) clReleaseMemObject(batches[b].results_buf);
+	clReleaseProgram(program);
+	clReleaseCommandQueue(commands);
+	clReleaseContext(context);
+
+	lsal_prof_write("batch", N, (long) total);
+
+	free(query);
+	free(database);
+	free(start);
+	free(similarity_matrix_sw);
+	free(direction_matrix_sw);
+
+	return EXIT_SUCCESS;
+}
+
+/*
+ Lanes mode: many queries of the same length against one database, LANES of them per pass of
+ the database through the multi-lane kernel. Query k sits at byte k * query_size_hw of the
+ query buffer, and the kernel writes { score, row * N + col } per query into results.
+ */
+int lsal_run_lanes(int argc, char **argv) {
+	int err;
+
+	if (argc != 5) {
+		printf("%s -l <input xclbin file> <Query Size N> <DataBase Size M> <Queries>\n", argv[0]);
 		return EXIT_FAILURE;
 	}
-	printf("set arg 1 \n");
-	err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &input_database);
-	if (err != CL_SUCCESS) {
-		printf("Error: Failed to set kernel arguments 1! %d\n", err);
-		printf("Test failed\n");
+
+	cl_int N = atoi(argv[2]);
+	cl_int M = atoi(argv[3]);
+	cl_int num_queries = atoi(argv[4]);
+	if (N <= 0 || M <= 0 || num_queries <= 0) {
+		printf("N, M and the query count should be positive numbers. \n");
 		return EXIT_FAILURE;
 	}
-	printf("set arg 2 \n");
-	err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &output_max_index);
-	if (err != CL_SUCCESS) {
-		printf("Error: Failed to set kernel arguments 2! %d\n", err);
-		printf("Test failed\n");
+	if (N > 16383) {
+		printf("N should be at most 16383, the HW scores are 16 bits wide. \n");
 		return EXIT_FAILURE;
 	}
-	// printf("set arg 3 \n");
-	// err |= clSetKernelArg(kernel, 3, sizeof(cl_mem), &output_similarity_matrix);
-	// if (err != CL_SUCCESS) {
-	// 	printf("Error: Failed to set kernel arguments 3! %d\n", err);
-	// 	printf("Test failed\n");
-	// 	return EXIT_FAILURE;
-	// }
-	printf("set arg 3 \n");
-	err |= clSetKernelArg(kernel, 3, sizeof(cl_mem),
-			&output_direction_matrix);
-	if (err != CL_SUCCESS) {
-		printf("Error: Failed to set kernel arguments 3! %d\n", err);
-		printf("Test failed\n");
+
+	// Every lane keeps its own boundary column on chip
+	cl_int stripes = (N + N_MAX - 1) / N_MAX;
+	if (M > M_MAX) {
+		printf("M should be at most %d. \n", M_MAX);
 		return EXIT_FAILURE;
 	}
-	// printf("set arg 4 \n");
-	// err |= clSetKernelArg(kernel, 4, sizeof(cl_uint),
-	// 		&N);
-	// if (err != CL_SUCCESS) {
-	// 	printf("Error: Failed to set kernel arguments 5! %d\n", err);
-	// 	printf("Test failed\n");
-	// 	return EXIT_FAILURE;
-	// }
-	// printf("set arg 6 \n");
-	// err |= clSetKernelArg(kernel, 6, sizeof(cl_uint),
-	// 		&M);
-	// if (err != CL_SUCCESS) {
-	// 	printf("Error: Failed to set kernel arguments 6! %d\n", err);
-	// 	printf("Test failed\n");
-	// 	return EXIT_FAILURE;
-	// }
-
-	
-	/**************************************************************
-	 * Step 10: Place the Kernel in the Queue for Execution
-	 **************************************************************/
-	cl_event enqueue_kernel;
-	printf("LAUNCH task \n");
-	err = clEnqueueTask(commands, kernel, 0, NULL, &enqueue_kernel);
 
-	if (err) {
-		printf("Error: Failed to execute kernel! %d\n", err);
+	size_t query_size_hw = lsal_axi_round((size_t) stripes * N_MAX);
+	size_t database_size = lsal_axi_round(M + 2 * N_MAX - 1);
+
+	char *queries = (char*) malloc(sizeof(char) * query_size_hw * num_queries);
+	memset(queries, 'X', sizeof(char) * query_size_hw * num_queries);
+	for (int k = 0; k < num_queries; k++) fillRandom(queries + query_size_hw * k, N);
+	char *database = (char*) malloc(sizeof(char) * M);
+	fillRandom(database, M);
+
+	cl_context context;
+	cl_command_queue commands;
+	cl_program program;
+	cl_kernel kernel;
+
+	if (lsal_cl_setup(argv[1], &context, &commands, &program)) return EXIT_FAILURE;
+	if (lsal_cl_kernels(program, "lsal_compute_lanes_aug", 1, &kernel)) return EXIT_FAILURE;
+
+	cl_mem query_buf = lsal_shared_buffer(context, CL_MEM_READ_ONLY, sizeof(char) * query_size_hw * num_queries);
+	cl_mem database_buf = lsal_shared_buffer(context, CL_MEM_READ_ONLY, sizeof(char) * database_size);
+	cl_mem results_buf = lsal_shared_buffer(context, CL_MEM_WRITE_ONLY, sizeof(cl_int) * 2 * num_queries);
+	if (!query_buf || !database_buf || !results_buf) {
+		printf("Error: Failed to allocate device memory!\n");
 		printf("Test failed\n");
 		return EXIT_FAILURE;
 	}
-	clWaitForEvents(1, &enqueue_kernel);
 
-	/**************************************************************
-	 * Step 11: Read back the results from the device to verify the output
-	 **************************************************************/
-	cl_event readMax, readSimilarity, readDirections;
-	// err = clEnqueueReadBuffer(commands, output_similarity_matrix, CL_TRUE, 0,
-	// 		sizeof(int) * N * M, similarity_matrix, 0, NULL, &readSimilarity);
-	// if (err != CL_SUCCESS) {
-	// 	printf("Error: Failed to read array! %d\n", err);
-	// 	printf("Test failed\n");
-	// 	return EXIT_FAILURE;
-	// }
-
-	err = clEnqueueReadBuffer(commands, output_direction_matrix, CL_TRUE, 0,
-			sizeof(char) * matrix_size_hw, direction_matrix_hw, 0, NULL,
-			&readDirections);
-	if (err != CL_SUCCESS) {
-		printf("Error: Failed to read array! %d\n", err);
+	printf("LAUNCH %d queries on %d lanes \n", num_queries, LANES);
+	int phase = lsal_prof_begin("input_build_enqueue");
+	char *query_hw = (char*) lsal_map(commands, query_buf, CL_MAP_WRITE_INVALIDATE_REGION,
+			sizeof(char) * query_size_hw * num_queries, 0, NULL, NULL);
+	char *database_hw = (char*) lsal_map(commands, database_buf, CL_MAP_WRITE_INVALIDATE_REGION,
+			sizeof(char) * database_size, 0, NULL, NULL);
+	if (!query_hw || !database_hw) {
+		printf("Error: Failed to map the inputs!\n");
 		printf("Test failed\n");
 		return EXIT_FAILURE;
 	}
-	err = clEnqueueReadBuffer(commands, output_max_index, CL_TRUE, 0,
-			sizeof(size_t), max_index_hw, 0, NULL, &readMax);
+	memcpy(query_hw, queries, sizeof(char) * query_size_hw * num_queries);
+	memset(database_hw, 'X', sizeof(char) * database_size);
+	memcpy(database_hw + N_MAX - 1, database, sizeof(char) * M);
+
+	cl_event write_events[2], kernel_event, read_event;
+	err = clEnqueueUnmapMemObject(commands, query_buf, query_hw, 0, NULL, &write_events[0]);
+	err |= clEnqueueUnmapMemObject(commands, database_buf, database_hw, 0, NULL, &write_events[1]);
+
+	err |= clSetKernelArg(kernel, 0, sizeof(cl_mem), &query_buf);
+	err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &database_buf);
+	err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &results_buf);
+	err |= clSetKernelArg(kernel, 3, sizeof(cl_int), &N);
+	err |= clSetKernelArg(kernel, 4, sizeof(cl_int), &M);
+	err |= clSetKernelArg(kernel, 5, sizeof(cl_int), &num_queries);
+	err |= clEnqueueTask(commands, kernel, 2, write_events, &kernel_event);
+
+	cl_int map_err;
+	cl_int *results = (cl_int*) clEnqueueMapBuffer(commands, results_buf, CL_FALSE, CL_MAP_READ, 0,
+			sizeof(cl_int) * 2 * num_queries, 1, &kernel_event, &read_event, &map_err);
+	err |= map_err;
 	if (err != CL_SUCCESS) {
-		printf("Error: Failed to read array! %d\n", err);
+		printf("Error: Failed to launch the kernel! %d\n", err);
 		printf("Test failed\n");
 		return EXIT_FAILURE;
 	}
+	clFlush(commands);
+	lsal_prof_end(phase);
+
+	phase = lsal_prof_begin("device_wait");
+	clWaitForEvents(1, &read_event);
+	lsal_prof_end(phase);
+	double executionTime = getTimeDifference(kernel_event);
+
+	lsal_prof_command(write_events[0], "unmap queries");
+	lsal_prof_command(write_events[1], "unmap database");
+	lsal_prof_command(kernel_event, "kernel");
+	lsal_prof_command(read_event, "map results");
+	clReleaseEvent(write_events[0]);
+	clReleaseEvent(write_events[1]);
+	clReleaseEvent(kernel_event);
+	clReleaseEvent(read_event);
 
-	// clWaitForEvents(1, &readSimilarity);
-	clWaitForEvents(1, &readDirections);
-	clWaitForEvents(1, &readMax);
+	/**************************************************************
+	 * Verify every query against the SW golden code
+	 **************************************************************/
+	phase = lsal_prof_begin("sw_golden");
+	int mismatches = 0, best_query = 0, best_score = -1;
+	int * similarity_matrix_sw = ( int *) malloc(sizeof(int) * N * M);
+	char * direction_matrix_sw = ( char*) malloc(sizeof(char) * N * M);
+	for (int k = 0; k < num_queries; k++) {
+		size_t max_index_sw;
+		lsal_compute_matrices_sw(queries + query_size_hw * k, database, &max_index_sw,
+				similarity_matrix_sw, direction_matrix_sw, N, M);
+		if (results[2 * k] != similarity_matrix_sw[max_index_sw]) {
+			if (mismatches++ < 10) {
+				printf("Error, query %d: SW score %d, HW %d \n", k, similarity_matrix_sw[max_index_sw],
+						results[2 * k]);
+			}
+		}
+		if (results[2 * k] > best_score) {
+			best_score = results[2 * k];
+			best_query = k;
+		}
+	}
+	lsal_prof_end(phase);
+
+	// Each group of LANES queries reads the padded database once per stripe
+	int groups = (num_queries + LANES - 1) / LANES;
+	double seconds = executionTime / 1000.0;
+	printf(" execution time is %lf ms for %d queries on %d lanes \n", executionTime, num_queries, LANES);
+	printf(" %.3lf GCUPS, %.1lf database bytes read per query \n",
+			(double) N * M * num_queries / seconds / 1e9,
+			(double) database_size * groups * stripes / num_queries);
+
+	cl_int best_index = results[2 * best_query + 1];
+	printf("HW: Best query %d, score %d at (%d, %d)\n", best_query, best_score, best_index / N, best_index % N);
+	phase = lsal_prof_begin("traceback_hw");
+	if (best_score > 0) {
+		lsal_traceback_window(queries + query_size_hw * best_query, database, best_index / N, best_index % N,
+				best_score);
+	}
+	lsal_prof_end(phase);
 
-	double executionTime = getTimeDifference(enqueue_kernel);
+	if (mismatches == 0) {
+		printf("computation ended!- RESULTS CORRECT \n");
+	} else {
+		printf("Error, %d of %d queries mismatch \n", mismatches, num_queries);
+	}
 
-   	clReleaseMemObject(input_database);
-	clReleaseMemObject(input_query);
-	clReleaseMemObject(output_direction_matrix);
-	clReleaseMemObject(output_max_index);
-	// clReleaseMemObject(output_similarity_matrix);
-	clReleaseProgram(program);
+	clEnqueueUnmapMemObject(commands, results_buf, results, 0, NULL, NULL);
+	clFinish(commands);
+	clReleaseMemObject(query_buf);
+	clReleaseMemObject(database_buf);
+	clReleaseMemObject(results_buf);
 	clReleaseKernel(kernel);
+	clReleaseProgram(program);
 	clReleaseCommandQueue(commands);
 	clReleaseContext(context);
 
-/**************************************************************
- * Run the same algorithm in the Host Unit and compare for verification
- **************************************************************/
-	int * similarity_matrix_sw = ( int *) malloc(sizeof(int) * matrix_size);
-	char * direction_matrix_sw = ( char*) malloc(sizeof(char) * matrix_size);
-	size_t * max_index_sw = ( size_t *) malloc(sizeof(size_t));
+	lsal_prof_write("lanes", N, M);
 
-	for(cl_uint i = 0; i < matrix_size; i++){
-		similarity_matrix_sw[i] = 0;
-	}
+	free(queries);
+	free(database);
+	free(similarity_matrix_sw);
+	free(direction_matrix_sw);
 
-	lsal_compute_matrices_sw(query, database, max_index_sw, similarity_matrix_sw, direction_matrix_sw);
+	return EXIT_SUCCESS;
+}
 
-	printf("both ended\n");
+/*
+ Hits mode: the kernel keeps the HIT_K best regions of every query column instead of only
+ the best cell (see lsal_compute_hits_aug). The CPU builds the same slots from the golden
+ similarity matrix to check them, then merges the hits that neighbouring columns report for
+ one alignment: taken best first, a hit is dropped when a kept one lies within HIT_SPAN
+ diagonals of it and within N + HIT_SPAN rows.
+ */
+typedef struct {
+	int score;
+	long row, col;
+} lsal_hit_t;
+
+int lsal_hit_cmp(const void *a, const void *b) {
+	const lsal_hit_t *x = (const lsal_hit_t *) a, *y = (const lsal_hit_t *) b;
+	if (x->score != y->score) return y->score - x->score;
+	if (x->row != y->row) return x->row < y->row ? -1 : 1;
+	return x->col < y->col ? -1 : (x->col > y->col);
+}
 
-	printf(" execution time is %lf ms \n", executionTime);
+void lsal_hit_commit_sw(int score, int row, int *slot_score, int *slot_row) {
+	int weakest = 0;
+	for (int k = 1; k < HIT_K; k++) {
+		if (slot_score[k] < slot_score[weakest]) weakest = k;
+	}
+	if (score > slot_score[weakest]) {
+		slot_score[weakest] = score;
+		slot_row[weakest] = row;
+	}
+}
 
-	printf("HW: Max index at (%lu, %lu)\n", max_index_hw / N, max_index_hw % N);
-	printf("SW: Max index at (%lu, %lu)\n", max_index_sw / N, max_index_sw % N);
+// The per-column tracking of the PEs, HIT_K slots of { score, row } per column
+void lsal_compute_hits_sw(const int *similarity, int *slots, size_t N, size_t M, int threshold) {
+	for (size_t col = 0; col < N; col++) {
+		int slot_score[HIT_K] = { 0 }, slot_row[HIT_K] = { 0 };
+		int open_score = 0, open_row = 0, open_last = 0;
+
+		for (size_t row = 0; row < M; row++) {
+			int best = similarity[row * N + col];
+			if (best < threshold) continue;
+			if (open_score > 0 && (int) row - open_last <= HIT_SPAN) {
+				if (best > open_score) {
+					open_score = best;
+					open_row = row;
+				}
+			} else {
+				if (open_score > 0) lsal_hit_commit_sw(open_score, open_row, slot_score, slot_row);
+				open_score = best;
+				open_row = row;
+			}
+			open_last = row;
+		}
+		if (open_score > 0) lsal_hit_commit_sw(open_score, open_row, slot_score, slot_row);
 
-	lsal_traceback_hw(query, database_hw, direction_matrix_hw, max_index_hw);
-	lsal_traceback_sw(query, database, similarity_matrix_sw, direction_matrix_sw, max_index_sw);
+		for (int k = 0; k < HIT_K; k++) {
+			slots[2 * (col * HIT_K + k)] = slot_score[k];
+			slots[2 * (col * HIT_K + k) + 1] = slot_row[k];
+		}
+	}
+}
 
-	// for (int i = 0; i < matrix_size; i++) {
-	// 	if (direction_matrix_sw[i] != direction_matrix[i]) {
-	// 		printf("Error, mismatch in the results, i + %d, SW: %d, HW %d \n",
-	// 				i, direction_matrix_sw[i], direction_matrix[i]);
-	// 		return EXIT_FAILURE;
-	// 	}
-	// }
+// Sorts hits best first and keeps one per alignment, returns how many are kept at the front
+int lsal_merge_hits(lsal_hit_t *hits, int count, size_t N) {
+	qsort(hits, count, sizeof(lsal_hit_t), lsal_hit_cmp);
+
+	int kept = 0;
+	for (int i = 0; i < count; i++) {
+		bool distinct = true;
+		for (int j = 0; j < kept && distinct; j++) {
+			long diag = labs((hits[i].row - hits[i].col) - (hits[j].row - hits[j].col));
+			long rows = labs(hits[i].row - hits[j].row);
+			if (diag <= HIT_SPAN && rows <= (long) N + HIT_SPAN) distinct = false;
+		}
+		if (distinct) hits[kept++] = hits[i];
+	}
+	return kept;
+}
 
-	// printf("computation ended!- RESULTS CORRECT \n");
+int lsal_run_hits(int argc, char **argv) {
+	int err;
+
+	if (argc != 5 && argc != 6) {
+		printf("%s -k <input xclbin file> <Query Size N> <DataBase Size M> <Threshold> [Hits shown]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	cl_int N = atoi(argv[2]);
+	cl_int M = atoi(argv[3]);
+	cl_int threshold = atoi(argv[4]);
+	int shown = argc == 6 ? atoi(argv[5]) : 10;
+	if (N <= 0 || M <= 0 || threshold <= 0) {
+		printf("N, M and the threshold should be positive numbers. \n");
+		return EXIT_FAILURE;
+	}
+	if (N > 16383) {
+		printf("N should be at most 16383, the HW scores are 16 bits wide. \n");
+		return EXIT_FAILURE;
+	}
+
+	cl_int stripes = (N + N_MAX - 1) / N_MAX;
+	if (M > M_MAX) {
+		printf("M should be at most %d. \n", M_MAX);
+		return EXIT_FAILURE;
+	}
+
+	size_t query_size_hw = lsal_axi_round((size_t) stripes * N_MAX);
+	size_t database_size = lsal_axi_round(M + 2 * N_MAX - 1);
+	size_t hit_entries = (size_t) stripes * N_MAX * HIT_K;
+
+	char *query = (char*) malloc(sizeof(char) * N);
+	char *database = (char*) malloc(sizeof(char) * M);
+	fillRandom(query, N);
+	fillRandom(database, M);
+
+	cl_context context;
+	cl_command_queue commands;
+	cl_program program;
+	cl_kernel kernel;
+
+	if (lsal_cl_setup(argv[1], &context, &commands, &program)) return EXIT_FAILURE;
+	if (lsal_cl_kernels(program, "lsal_compute_hits_aug", 1, &kernel)) return EXIT_FAILURE;
+
+	cl_mem query_buf = lsal_shared_buffer(context, CL_MEM_READ_ONLY, sizeof(char) * query_size_hw);
+	cl_mem database_buf = lsal_shared_buffer(context, CL_MEM_READ_ONLY, sizeof(char) * database_size);
+	cl_mem hits_buf = lsal_shared_buffer(context, CL_MEM_WRITE_ONLY, sizeof(cl_int) * 2 * hit_entries);
+	if (!query_buf || !database_buf || !hits_buf) {
+		printf("Error: Failed to allocate device memory!\n");
+		printf("Test failed\n");
+		return EXIT_FAILURE;
+	}
+
+	printf("LAUNCH hits kernel, threshold %d, %d slots per column \n", threshold, HIT_K);
+	int phase = lsal_prof_begin("input_build_enqueue");
+	char *query_hw = (char*) lsal_map(commands, query_buf, CL_MAP_WRITE_INVALIDATE_REGION,
+			sizeof(char) * query_size_hw, 0, NULL, NULL);
+	char *database_hw = (char*) lsal_map(commands, database_buf, CL_MAP_WRITE_INVALIDATE_REGION,
+			sizeof(char) * database_size, 0, NULL, NULL);
+	if (!query_hw || !database_hw) {
+		printf("Error: Failed to map the inputs!\n");
+		printf("Test failed\n");
+		return EXIT_FAILURE;
+	}
+	memset(query_hw, 'X', sizeof(char) * query_size_hw);
+	memcpy(query_hw, query, sizeof(char) * N);
+	memset(database_hw, 'X', sizeof(char) * database_size);
+	memcpy(database_hw + N_MAX - 1, database, sizeof(char) * M);
+
+	cl_event write_events[2], kernel_event, read_event;
+	err = clEnqueueUnmapMemObject(commands, query_buf, query_hw, 0, NULL, &write_events[0]);
+	err |= clEnqueueUnmapMemObject(commands, database_buf, database_hw, 0, NULL, &write_events[1]);
+
+	err |= clSetKernelArg(kernel, 0, sizeof(cl_mem), &query_buf);
+	err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &database_buf);
+	err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &hits_buf);
+	err |= clSetKernelArg(kernel, 3, sizeof(cl_int), &N);
+	err |= clSetKernelArg(kernel, 4, sizeof(cl_int), &M);
+	err |= clSetKernelArg(kernel, 5, sizeof(cl_int), &threshold);
+	err |= clEnqueueTask(commands, kernel, 2, write_events, &kernel_event);
+
+	cl_int map_err;
+	cl_int *hits_hw = (cl_int*) clEnqueueMapBuffer(commands, hits_buf, CL_FALSE, CL_MAP_READ, 0,
+			sizeof(cl_int) * 2 * hit_entries, 1, &kernel_event, &read_event, &map_err);
+	err |= map_err;
+	if (err != CL_SUCCESS) {
+		printf("Error: Failed to launch the kernel! %d\n", err);
+		printf("Test failed\n");
+		return EXIT_FAILURE;
+	}
+	clFlush(commands);
+	lsal_prof_end(phase);
+
+	phase = lsal_prof_begin("device_wait");
+	clWaitForEvents(1, &read_event);
+	lsal_prof_end(phase);
+	double executionTime = getTimeDifference(kernel_event);
+
+	lsal_prof_command(write_events[0], "unmap query");
+	lsal_prof_command(write_events[1], "unmap database");
+	lsal_prof_command(kernel_event, "kernel");
+	lsal_prof_command(read_event, "map hits");
+	clReleaseEvent(write_events[0]);
+	clReleaseEvent(write_events[1]);
+	clReleaseEvent(kernel_event);
+	clReleaseEvent(read_event);
+
+	/**************************************************************
+	 * Verify every slot against the SW golden code
+	 **************************************************************/
+	phase = lsal_prof_begin("sw_golden");
+	int * similarity_matrix_sw = ( int *) malloc(sizeof(int) * N * M);
+	char * direction_matrix_sw = ( char*) malloc(sizeof(char) * N * M);
+	int * slots_sw = ( int *) malloc(sizeof(int) * 2 * N * HIT_K);
+	size_t max_index_sw;
+	lsal_compute_matrices_sw(query, database, &max_index_sw, similarity_matrix_sw, direction_matrix_sw, N, M);
+	lsal_compute_hits_sw(similarity_matrix_sw, slots_sw, N, M, threshold);
+
+	int mismatches = 0, count = 0;
+	lsal_hit_t *hits = (lsal_hit_t *) malloc(sizeof(lsal_hit_t) * N * HIT_K);
+	for (size_t e = 0; e < hit_entries; e++) {
+		size_t col = e / HIT_K;
+		int score = hits_hw[2 * e], index = hits_hw[2 * e + 1];
+		int score_sw = col < (size_t) N ? slots_sw[2 * e] : 0;
+		bool same = score == score_sw;
+		if (same && score > 0) same = index == slots_sw[2 * e + 1] * N + (int) col;
+		if (!same) {
+			if (mismatches++ < 10) {
+				printf("Error, column %lu slot %lu: SW score %d at row %d, HW score %d at row %d \n", col, e % HIT_K,
+						score_sw, col < (size_t) N ? slots_sw[2 * e + 1] : 0, score, index / N);
+			}
+		}
+		if (score > 0 && col < (size_t) N) {
+			hits[count].score = score;
+			hits[count].row = index / N;
+			hits[count].col = index % N;
+			count++;
+		}
+	}
+	lsal_prof_end(phase);
+
+	phase = lsal_prof_begin("merge_hits");
+	int distinct = lsal_merge_hits(hits, count, N);
+	lsal_prof_end(phase);
+
+	double seconds = executionTime / 1000.0;
+	printf(" execution time is %lf ms, %.3lf GCUPS \n", executionTime, (double) N * M / seconds / 1e9);
+	printf("HW: %d column hits, %d distinct alignments scoring at least %d \n", count, distinct, threshold);
+	for (int i = 0; i < distinct && i < shown; i++) {
+		printf("  hit %d: score %d at (%ld, %ld)\n", i, hits[i].score, hits[i].row, hits[i].col);
+	}
+
+	phase = lsal_prof_begin("traceback_hw");
+	for (int i = 0; i < distinct && i < 3; i++) {
+		lsal_traceback_window(query, database, hits[i].row, hits[i].col, hits[i].score);
+	}
+	lsal_prof_end(phase);
+
+	if (mismatches == 0) {
+		printf("computation ended!- RESULTS CORRECT \n");
+	} else {
+		printf("Error, %d of %lu hit slots mismatch \n", mismatches, hit_entries);
+	}
+
+	clEnqueueUnmapMemObject(commands, hits_buf, hits_hw, 0, NULL, NULL);
+	clFinish(commands);
+	clReleaseMemObject(query_buf);
+	clReleaseMemObject(database_buf);
+	clReleaseMemObject(hits_buf);
+	clReleaseKernel(kernel);
+	clReleaseProgram(program);
+	clReleaseCommandQueue(commands);
+	clReleaseContext(context);
+
+	lsal_prof_write("hits", N, M);
+
+	free(query);
+	free(database);
+	free(similarity_matrix_sw);
+	free(direction_matrix_sw);
+	free(slots_sw);
+	free(hits);
+
+	return EXIT_SUCCESS;
+}
+
+/*
+ Affine-gap mode. A gap of k positions costs Gap_open + (k - 1) * Gap_extend. Directions are
+ AFF_BITS codes: the source of H in the low DIR_BITS (DIR_L: a gap in the database, DIR_U: a
+ gap in the query), plus AFF_E_EXT / AFF_F_EXT when that cell's E / F extends the gap of its
+ left / upper neighbour instead of opening a new one. On the HW they are packed 2 per byte
+ in the same skewed stripes as the linear-gap directions.
+ */
+int lsal_compute_affine_sw(const char *q, const char *d, size_t *max_idx, int *similarity, unsigned char *direction,
+		size_t N, size_t M) {
+	int max_similarity = 0;
+	*max_idx = 0;
+
+	// F of the row above, per column; E of the cell to the left
+	int *f = (int *) malloc(sizeof(int) * N);
+	for (size_t col = 0; col < N; col++) f[col] = AFF_NEG;
+
+	for (size_t row = 0; row < M; row++) {
+		int e = AFF_NEG;
+		for (size_t col = 0; col < N; col++) {
+			size_t idx = row * N + col;
+
+			int score = (d[row] == q[col]) ? Match : Mismatch;
+			int h_diag = (row > 0 && col > 0) ? similarity[idx - N - 1] : 0;
+			int h_up = (row > 0) ? similarity[idx - N] : 0;
+			int h_left = (col > 0) ? similarity[idx - 1] : 0;
+
+			// Same rules as the PEs: a gap extends only when that is strictly better
+			int e_extends = e + Gap_extend > h_left + Gap_open;
+			int f_extends = f[col] + Gap_extend > h_up + Gap_open;
+			e = e_extends ? e + Gap_extend : h_left + Gap_open;
+			f[col] = f_extends ? f[col] + Gap_extend : h_up + Gap_open;
+
+			int D = h_diag + score;
+			int best1 = D > 0 ? D : 0;
+			int dir1 = D > 0 ? DIR_D : DIR_NONE;
+			int best2 = f[col] > e ? f[col] : e;
+			int dir2 = f[col] > e ? DIR_U : DIR_L;
+
+			int best = best1, dir = dir1;
+			if (!(best1 > best2 || best2 <= 0)) {
+				best = best2;
+				dir = dir2;
+			}
+
+			similarity[idx] = best;
+			direction[idx] = dir | (e_extends ? AFF_E_EXT : 0) | (f_extends ? AFF_F_EXT : 0);
+
+			if (best > max_similarity) {
+				max_similarity = best;
+				*max_idx = idx;
+			}
+		}
+	}
+
+	free(f);
+	return max_similarity;
+}
+
+size_t lsal_aff_stripe_size(size_t M) {
+	return lsal_axi_round((N_MAX * (M + N_MAX - 1) + AFF_PER_BYTE - 1) / AFF_PER_BYTE) * AFF_PER_BYTE;
+}
+
+// Code of cell (row, col): row-major for the SW matrix, skewed and packed for the HW one
+unsigned lsal_aff_code(const unsigned char *direction, bool hw, size_t row, size_t col, size_t N, size_t M) {
+	if (!hw) return direction[row * N + col];
+
+	size_t c = col % N_MAX;
+	size_t idx = (col / N_MAX) * lsal_aff_stripe_size(M) + (row + c) * N_MAX + c;
+	return (direction[idx / AFF_PER_BYTE] >> (AFF_BITS * (idx % AFF_PER_BYTE))) & ((1 << AFF_BITS) - 1);
+}
+
+/*
+ Follows the alignment back from (row, col) through three states. In H the cell's low bits
+ say where H came from, and a gap source enters the E or F state at the same cell. A gap
+ state emits one gap position per cell, staying in the gap while the cell's extend bit is
+ set and returning to H at the cell that opened it. Prints the alignment and returns its
+ score, recomputed from the aligned sequences.
+ */
+int lsal_traceback_affine(const char *q, const char *d, const unsigned char *direction, bool hw,
+		size_t row, size_t col, size_t N, size_t M) {
+	char *aligned_d = (char *) malloc(N + M + 2);
+	char *aligned_q = (char *) malloc(N + M + 2);
+	int strpos = N + M + 1;
+	aligned_d[strpos] = '\0';
+	aligned_q[strpos] = '\0';
+	strpos--;
+
+	long r = row, c = col;
+	int state = DIR_D;                  // DIR_D for H, DIR_L for E, DIR_U for F
+	while (r >= 0 && c >= 0) {
+		unsigned code = lsal_aff_code(direction, hw, r, c, N, M);
+
+		if (state == DIR_D) {
+			int source = code & ((1 << DIR_BITS) - 1);
+			if (source == DIR_NONE) break;
+			if (source != DIR_D) {
+				state = source;
+				continue;
+			}
+			aligned_q[strpos] = q[c];
+			aligned_d[strpos] = d[r];
+			r--; c--;
+		} else if (state == DIR_L) {
+			aligned_q[strpos] = q[c];
+			aligned_d[strpos] = '-';
+			if (!(code & AFF_E_EXT)) state = DIR_D;
+			c--;
+		} else {
+			aligned_q[strpos] = '-';
+			aligned_d[strpos] = d[r];
+			if (!(code & AFF_F_EXT)) state = DIR_D;
+			r--;
+		}
+		strpos--;
+	}
+
+	printf("\nAligned Sequences:\n");
+	printf("Q: %s\n", &aligned_q[strpos + 1]);
+	printf("D: %s\n", &aligned_d[strpos + 1]);
+
+	int score = 0;
+	for (int i = strpos + 1; aligned_q[i]; i++) {
+		if (aligned_q[i] == '-') {
+			score += (i > strpos + 1 && aligned_q[i - 1] == '-') ? Gap_extend : Gap_open;
+		} else if (aligned_d[i] == '-') {
+			score += (i > strpos + 1 && aligned_d[i - 1] == '-') ? Gap_extend : Gap_open;
+		} else {
+			score += aligned_q[i] == aligned_d[i] ? Match : Mismatch;
+		}
+	}
+
+	free(aligned_d);
+	free(aligned_q);
+	return score;
+}
+
+int lsal_run_affine(int argc, char **argv) {
+	int err;
+
+	if (argc != 4) {
+		printf("%s -a <input xclbin file> <Query Size N> <DataBase Size M>\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	cl_int N = atoi(argv[2]);
+	cl_int M = atoi(argv[3]);
+	if (N <= 0 || M <= 0) {
+		printf("N and M should be positive numbers. \n");
+		return EXIT_FAILURE;
+	}
+	if (N > 16383) {
+		printf("N should be at most 16383, the HW scores are 16 bits wide. \n");
+		return EXIT_FAILURE;
+	}
+
+	cl_int stripes = (N + N_MAX - 1) / N_MAX;
+	if (M > M_MAX) {
+		printf("M should be at most %d. \n", M_MAX);
+		return EXIT_FAILURE;
+	}
+
+	size_t query_size_hw = lsal_axi_round((size_t) stripes * N_MAX);
+	size_t database_size = lsal_axi_round(M + 2 * N_MAX - 1);
+	size_t matrix_size = stripes * lsal_aff_stripe_size(M) / AFF_PER_BYTE;
+
+	char *query = (char*) malloc(sizeof(char) * query_size_hw);
+	char *database = (char*) malloc(sizeof(char) * M);
+	memset(query, 'X', sizeof(char) * query_size_hw);
+	fillRandom(query, N);
+	fillRandom(database, M);
+
+	cl_context context;
+	cl_command_queue commands;
+	cl_program program;
+	cl_kernel kernel;
+
+	if (lsal_cl_setup(argv[1], &context, &commands, &program)) return EXIT_FAILURE;
+	if (lsal_cl_kernels(program, "lsal_compute_affine_aug", 1, &kernel)) return EXIT_FAILURE;
+
+	cl_mem query_buf = lsal_shared_buffer(context, CL_MEM_READ_ONLY, sizeof(char) * query_size_hw);
+	cl_mem database_buf = lsal_shared_buffer(context, CL_MEM_READ_ONLY, sizeof(char) * database_size);
+	cl_mem direction_buf = lsal_shared_buffer(context, CL_MEM_READ_WRITE, sizeof(char) * matrix_size);
+	cl_mem max_index_buf = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_int), NULL, NULL);
+	cl_mem max_score_buf = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_int), NULL, NULL);
+	if (!query_buf || !database_buf || !direction_buf || !max_index_buf || !max_score_buf) {
+		printf("Error: Failed to allocate device memory!\n");
+		printf("Test failed\n");
+		return EXIT_FAILURE;
+	}
+
+	printf("LAUNCH affine-gap kernel \n");
+	int phase = lsal_prof_begin("input_build_enqueue");
+	char *query_hw = (char*) lsal_map(commands, query_buf, CL_MAP_WRITE_INVALIDATE_REGION,
+			sizeof(char) * query_size_hw, 0, NULL, NULL);
+	char *database_hw = (char*) lsal_map(commands, database_buf, CL_MAP_WRITE_INVALIDATE_REGION,
+			sizeof(char) * database_size, 0, NULL, NULL);
+	if (!query_hw || !database_hw) {
+		printf("Error: Failed to map the inputs!\n");
+		printf("Test failed\n");
+		return EXIT_FAILURE;
+	}
+	memcpy(query_hw, query, sizeof(char) * query_size_hw);
+	memset(database_hw, 'X', sizeof(char) * database_size);
+	memcpy(database_hw + N_MAX - 1, database, sizeof(char) * M);
+
+	cl_event write_events[2], kernel_event, read_events[3];
+	cl_int max_index_hw, max_score_hw;
+	err = clEnqueueUnmapMemObject(commands, query_buf, query_hw, 0, NULL, &write_events[0]);
+	err |= clEnqueueUnmapMemObject(commands, database_buf, database_hw, 0, NULL, &write_events[1]);
+
+	err |= clSetKernelArg(kernel, 0, sizeof(cl_mem), &query_buf);
+	err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &database_buf);
+	err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &max_index_buf);
+	err |= clSetKernelArg(kernel, 3, sizeof(cl_mem), &max_score_buf);
+	err |= clSetKernelArg(kernel, 4, sizeof(cl_mem), &direction_buf);
+	err |= clSetKernelArg(kernel, 5, sizeof(cl_int), &N);
+	err |= clSetKernelArg(kernel, 6, sizeof(cl_int), &M);
+	err |= clEnqueueTask(commands, kernel, 2, write_events, &kernel_event);
+
+	err |= clEnqueueReadBuffer(commands, max_index_buf, CL_FALSE, 0, sizeof(cl_int), &max_index_hw,
+			1, &kernel_event, &read_events[0]);
+	err |= clEnqueueReadBuffer(commands, max_score_buf, CL_FALSE, 0, sizeof(cl_int), &max_score_hw,
+			1, &kernel_event, &read_events[1]);
+	cl_int map_err;
+	unsigned char *direction_hw = (unsigned char*) clEnqueueMapBuffer(commands, direction_buf, CL_FALSE,
+			CL_MAP_READ, 0, sizeof(char) * matrix_size, 1, &kernel_event, &read_events[2], &map_err);
+	err |= map_err;
+	if (err != CL_SUCCESS) {
+		printf("Error: Failed to launch the kernel! %d\n", err);
+		printf("Test failed\n");
+		return EXIT_FAILURE;
+	}
+	clFlush(commands);
+	lsal_prof_end(phase);
+
+	phase = lsal_prof_begin("device_wait");
+	clWaitForEvents(3, read_events);
+	lsal_prof_end(phase);
+	double executionTime = getTimeDifference(kernel_event);
+
+	lsal_prof_command(write_events[0], "unmap query");
+	lsal_prof_command(write_events[1], "unmap database");
+	lsal_prof_command(kernel_event, "kernel");
+	lsal_prof_command(read_events[0], "read max_index");
+	lsal_prof_command(read_events[1], "read max_score");
+	lsal_prof_command(read_events[2], "map directions");
+	clReleaseEvent(write_events[0]);
+	clReleaseEvent(write_events[1]);
+	clReleaseEvent(kernel_event);
+	for (int e = 0; e < 3; e++) clReleaseEvent(read_events[e]);
+
+	/**************************************************************
+	 * Run the same algorithm in the Host Unit and compare for verification
+	 **************************************************************/
+	phase = lsal_prof_begin("sw_golden");
+	int * similarity_matrix_sw = ( int *) malloc(sizeof(int) * N * M);
+	unsigned char * direction_matrix_sw = ( unsigned char*) malloc(sizeof(char) * N * M);
+	size_t max_index_sw;
+	int max_score_sw = lsal_compute_affine_sw(query, database, &max_index_sw, similarity_matrix_sw,
+			direction_matrix_sw, N, M);
+	lsal_prof_end(phase);
+
+	// Every cell's code, gap-extend bits included, must match the SW one
+	phase = lsal_prof_begin("direction_check");
+	size_t bad_directions = 0;
+	for (size_t row = 0; row < (size_t) M; row++) {
+		for (size_t col = 0; col < (size_t) N; col++) {
+			unsigned hw = lsal_aff_code(direction_hw, true, row, col, N, M);
+			unsigned sw = direction_matrix_sw[row * N + col];
+			if (hw != sw && bad_directions++ < 10) {
+				printf("Error, direction at (%lu, %lu): HW %u, SW %u\n", row, col, hw, sw);
+			}
+		}
+	}
+	lsal_prof_end(phase);
+
+	size_t stripe_size = lsal_aff_stripe_size(M);
+	size_t c = max_index_hw % stripe_size % N_MAX;
+	size_t max_row_hw = max_index_hw % stripe_size / N_MAX - c;
+	size_t max_col_hw = max_index_hw / stripe_size * N_MAX + c;
+
+	printf(" execution time is %lf ms \n", executionTime);
+	printf("HW: Max score %d at (%lu, %lu)\n", max_score_hw, max_row_hw, max_col_hw);
+	printf("SW: Max score %d at (%lu, %lu)\n", max_score_sw, max_index_sw / N, max_index_sw % N);
+
+	phase = lsal_prof_begin("traceback_hw");
+	int traced_hw = lsal_traceback_affine(query, database, direction_hw, true, max_row_hw, max_col_hw, N, M);
+	lsal_prof_end(phase);
+	phase = lsal_prof_begin("traceback_sw");
+	int traced_sw = lsal_traceback_affine(query, database, direction_matrix_sw, false,
+			max_index_sw / N, max_index_sw % N, N, M);
+	lsal_prof_end(phase);
+
+	if (max_score_hw != max_score_sw || traced_hw != max_score_hw || traced_sw != max_score_sw) {
+		printf("Error, scores: HW %d, SW %d, HW alignment %d, SW alignment %d \n", max_score_hw,
+				max_score_sw, traced_hw, traced_sw);
+	} else if (bad_directions) {
+		printf("Error, %lu direction codes differ \n", bad_directions);
+	} else {
+		printf("computation ended!- RESULTS CORRECT \n");
+	}
+
+	clEnqueueUnmapMemObject(commands, direction_buf, direction_hw, 0, NULL, NULL);
+	clFinish(commands);
+	clReleaseMemObject(query_buf);
+	clReleaseMemObject(database_buf);
+	clReleaseMemObject(direction_buf);
+	clReleaseMemObject(max_index_buf);
+	clReleaseMemObject(max_score_buf);
+	clReleaseKernel(kernel);
+	clReleaseProgram(program);
+	clReleaseCommandQueue(commands);
+	clReleaseContext(context);
+
+	lsal_prof_write("affine", N, M);
+
+	free(query);
+	free(database);
+	free(similarity_matrix_sw);
+	free(direction_matrix_sw);
+
+	return EXIT_SUCCESS;
+}
+
+/*
+ Pipeline mode: a stream of independent jobs, each one query against its own database,
+ through a ring of buffer sets on one CU. Job i is written, run and read back as a chain
+ of events; while its kernel runs, the host fills and queues job i + 1 and traces back
+ job i - 1, so the FPGA never waits for the ARM and the ARM never waits for the FPGA.
+ */
+typedef struct {
+	unsigned char *direction;           // mapped while the job is traced back
+	cl_int max_index, max_score;
+	cl_mem database_buf, direction_buf, max_index_buf, max_score_buf;
+	cl_event write_event, kernel_event, read_events[3];
+	cl_event unmap_event;               // directions handed back to the device, NULL at first
+} lsal_slot_t;
+
+int lsal_run_pipeline(int argc, char **argv) {
+	int err;
+
+	if (argc != 5 && argc != 6) {
+		printf("%s -p <input xclbin file> <Query Size N> <DataBase Size M> <Jobs> [<Buffer Sets>]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	cl_int N = atoi(argv[2]);
+	cl_int M = atoi(argv[3]);
+	int jobs = atoi(argv[4]);
+	int sets = argc == 6 ? atoi(argv[5]) : 2;
+	if (N <= 0 || M <= 0 || jobs <= 0) {
+		printf("N, M and the job count should be positive numbers. \n");
+		return EXIT_FAILURE;
+	}
+	if (N > 16383) {
+		printf("N should be at most 16383, the HW scores are 16 bits wide. \n");
+		return EXIT_FAILURE;
+	}
+	if (sets < 2) {
+		printf("Overlapping needs at least 2 buffer sets. \n");
+		return EXIT_FAILURE;
+	}
+
+	// Every job is one task, so its database has to fit the on-chip boundary column
+	cl_int stripes = (N + N_MAX - 1) / N_MAX;
+	if (M > M_MAX) {
+		printf("M should be at most %d. \n", M_MAX);
+		return EXIT_FAILURE;
+	}
+
+	size_t query_size_hw = lsal_axi_round((size_t) stripes * N_MAX);
+	size_t database_size = lsal_axi_round(M + 2 * N_MAX - 1);
+	size_t matrix_size = stripes * lsal_hw_stripe_size(M) / DIR_PER_BYTE;
+
+	char *query = (char*) malloc(sizeof(char) * query_size_hw);
+	memset(query, 'X', sizeof(char) * query_size_hw);
+	fillRandom(query, N);
+
+	// The jobs' databases are kept for the verification at the end
+	char *databases = (char*) malloc(sizeof(char) * M * jobs);
+	cl_int *max_scores = (cl_int*) malloc(sizeof(cl_int) * jobs);
+
+	lsal_slot_t *slots = (lsal_slot_t *) calloc(sets, sizeof(lsal_slot_t));
+
+	cl_context context;
+	cl_command_queue commands;
+	cl_program program;
+	cl_kernel kernel;
+
+	if (lsal_cl_setup(argv[1], &context, &commands, &program)) return EXIT_FAILURE;
+	if (lsal_cl_kernels(program, "lsal_compute_matrices_aug", 1, &kernel)) return EXIT_FAILURE;
+
+	cl_mem input_query = lsal_shared_buffer(context, CL_MEM_READ_ONLY, sizeof(char) * query_size_hw);
+	for (int b = 0; b < sets; b++) {
+		lsal_slot_t *sl = &slots[b];
+		sl->database_buf = lsal_shared_buffer(context, CL_MEM_READ_ONLY, sizeof(char) * database_size);
+		sl->direction_buf = lsal_shared_buffer(context, CL_MEM_READ_WRITE, sizeof(char) * matrix_size);
+		sl->max_index_buf = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_int),
+		NULL, NULL);
+		sl->max_score_buf = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_int),
+		NULL, NULL);
+		if (!input_query || !sl->database_buf || !sl->direction_buf || !sl->max_index_buf
+				|| !sl->max_score_buf) {
+			printf("Error: Failed to allocate device memory for buffer set %d!\n", b);
+			printf("Test failed\n");
+			return EXIT_FAILURE;
+		}
+	}
+
+	cl_event write_query;
+	char *query_hw = (char*) lsal_map(commands, input_query, CL_MAP_WRITE_INVALIDATE_REGION,
+			sizeof(char) * query_size_hw, 0, NULL, NULL);
+	if (!query_hw) {
+		printf("Error: Failed to map the query!\n");
+		printf("Test failed\n");
+		return EXIT_FAILURE;
+	}
+	memcpy(query_hw, query, sizeof(char) * query_size_hw);
+	clEnqueueUnmapMemObject(commands, input_query, query_hw, 0, NULL, &write_query);
+
+	printf("LAUNCH %d jobs through %d buffer sets \n", jobs, sets);
+	cl_ulong first_start = 0, last_end = 0, busy = 0;
+	double traceback_ms = 0.0;
+	double wall_start = lsal_wall_ms();
+
+	/**************************************************************
+	 * Iteration i queues job i, then finishes job i - 1 while job i
+	 * runs. The set of job i last held job i - sets, whose traceback
+	 * is already done, so it can be refilled without waiting.
+	 **************************************************************/
+	for (int i = 0; i <= jobs; i++) {
+		if (i < jobs) {
+			lsal_slot_t *sl = &slots[i % sets];
+			char *db = databases + (size_t) M * i;
+			fillRandom(db, M);
+
+			// The set's last kernel is done, its database is refilled in place
+			char *database_hw = (char*) lsal_map(commands, sl->database_buf, CL_MAP_WRITE_INVALIDATE_REGION,
+					sizeof(char) * database_size, 0, NULL, NULL);
+			if (!database_hw) {
+				printf("Error: Failed to map the database of job %d!\n", i);
+				printf("Test failed\n");
+				return EXIT_FAILURE;
+			}
+			memset(database_hw, 'X', sizeof(char) * database_size);
+			memcpy(database_hw + N_MAX - 1, db, sizeof(char) * M);
+			err = clEnqueueUnmapMemObject(commands, sl->database_buf, database_hw, 0, NULL, &sl->write_event);
+
+			err |= clSetKernelArg(kernel, 0, sizeof(cl_mem), &input_query);
+			err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &sl->database_buf);
+			err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &sl->max_index_buf);
+			err |= clSetKernelArg(kernel, 3, sizeof(cl_mem), &sl->max_score_buf);
+			err |= clSetKernelArg(kernel, 4, sizeof(cl_mem), &sl->direction_buf);
+			err |= clSetKernelArg(kernel, 5, sizeof(cl_int), &N);
+			err |= clSetKernelArg(kernel, 6, sizeof(cl_int), &M);
+
+			// The kernel also waits for the previous job of the set to hand back its directions
+			cl_event inputs[3] = { write_query, sl->write_event, sl->unmap_event };
+			err |= clEnqueueTask(commands, kernel, sl->unmap_event ? 3 : 2, inputs, &sl->kernel_event);
+
+			err |= clEnqueueReadBuffer(commands, sl->max_index_buf, CL_FALSE, 0,
+					sizeof(cl_int), &sl->max_index, 1, &sl->kernel_event, &sl->read_events[0]);
+			err |= clEnqueueReadBuffer(commands, sl->max_score_buf, CL_FALSE, 0,
+					sizeof(cl_int), &sl->max_score, 1, &sl->kernel_event, &sl->read_events[1]);
+			cl_int map_err;
+			sl->direction = (unsigned char*) clEnqueueMapBuffer(commands, sl->direction_buf, CL_FALSE,
+					CL_MAP_READ, 0, sizeof(char) * matrix_size, 1, &sl->kernel_event,
+					&sl->read_events[2], &map_err);
+			err |= map_err;
+			if (err != CL_SUCCESS) {
+				printf("Error: Failed to queue job %d! %d\n", i, err);
+				printf("Test failed\n");
+				return EXIT_FAILURE;
+			}
+			clFlush(commands);
+		}
+
+		if (i > 0) {
+			int job = i - 1;
+			lsal_slot_t *sl = &slots[job % sets];
+			clWaitForEvents(3, sl->read_events);
+
+			double t0 = lsal_wall_ms();
+			int phase = lsal_prof_begin("traceback_hw job %d", job);
+			printf("Job %d: max score %d\n", job, sl->max_score);
+			lsal_traceback_hw(query, databases + (size_t) M * job, sl->direction, sl->max_index, N, M);
+			lsal_prof_end(phase);
+			traceback_ms += lsal_wall_ms() - t0;
+			max_scores[job] = sl->max_score;
+
+			// FPGA busy time, and the span from the first transfer to the last
+			cl_ulong write_start = lsal_event_time(sl->write_event, CL_PROFILING_COMMAND_START);
+			cl_ulong read_end = lsal_event_time(sl->read_events[2], CL_PROFILING_COMMAND_END);
+			busy += lsal_event_time(sl->kernel_event, CL_PROFILING_COMMAND_END)
+					- lsal_event_time(sl->kernel_event, CL_PROFILING_COMMAND_START);
+			if (job == 0 || write_start < first_start) first_start = write_start;
+			if (read_end > last_end) last_end = read_end;
+
+			lsal_prof_command(sl->write_event, "unmap database job %d", job);
+			lsal_prof_command(sl->kernel_event, "kernel job %d", job);
+			lsal_prof_command(sl->read_events[0], "read max_index job %d", job);
+			lsal_prof_command(sl->read_events[1], "read max_score job %d", job);
+			lsal_prof_command(sl->read_events[2], "map directions job %d", job);
+			if (sl->unmap_event) {
+				lsal_prof_command(sl->unmap_event, "unmap directions job %d", job - sets);
+				clReleaseEvent(sl->unmap_event);
+			}
+			clReleaseEvent(sl->write_event);
+			clReleaseEvent(sl->kernel_event);
+			for (int e = 0; e < 3; e++) clReleaseEvent(sl->read_events[e]);
+			clEnqueueUnmapMemObject(commands, sl->direction_buf, sl->direction, 0, NULL, &sl->unmap_event);
+			clFlush(commands);
+		}
+	}
+	clFinish(commands);
+
+	double wall_ms = lsal_wall_ms() - wall_start;
+	double span_ms = (last_end - first_start) / 1000000.0;
+	double busy_ms = busy / 1000000.0;
+
+	lsal_prof_command(write_query, "unmap query");
+	for (int b = 0; b < sets; b++) {
+		if (slots[b].unmap_event) clReleaseEvent(slots[b].unmap_event);
+		clReleaseMemObject(slots[b].database_buf);
+		clReleaseMemObject(slots[b].direction_buf);
+		clReleaseMemObject(slots[b].max_index_buf);
+		clReleaseMemObject(slots[b].max_score_buf);
+	}
+	clReleaseKernel(kernel);
+	clReleaseEvent(write_query);
+	clReleaseMemObject(input_query);
+	clReleaseProgram(program);
+	clReleaseCommandQueue(commands);
+	clReleaseContext(context);
+
+	printf(" %d jobs in %lf ms wall, %lf ms from first transfer to last \n", jobs, wall_ms, span_ms);
+	printf(" FPGA busy %lf ms, utilization %.1lf%%, host traceback %lf ms \n", busy_ms,
+			span_ms > 0 ? 100.0 * busy_ms / span_ms : 0.0, traceback_ms);
+
+	/**************************************************************
+	 * Verify every job against the SW golden code
+	 **************************************************************/
+	int mismatches = 0;
+	int * similarity_matrix_sw = ( int *) malloc(sizeof(int) * N * M);
+	char * direction_matrix_sw = ( char*) malloc(sizeof(char) * N * M);
+	int golden_phase = lsal_prof_begin("sw_golden");
+	for (int job = 0; job < jobs; job++) {
+		size_t max_index_sw;
+		lsal_compute_matrices_sw(query, databases + (size_t) M * job, &max_index_sw,
+				similarity_matrix_sw, direction_matrix_sw, N, M);
+		if (max_scores[job] != similarity_matrix_sw[max_index_sw]) {
+			printf("Error, job %d: SW score %d, HW %d \n", job, similarity_matrix_sw[max_index_sw],
+					max_scores[job]);
+			mismatches++;
+		}
+	}
+	lsal_prof_end(golden_phase);
+
+	if (mismatches == 0) {
+		printf("computation ended!- RESULTS CORRECT \n");
+	} else {
+		printf("Error, %d of %d jobs mismatch \n", mismatches, jobs);
+	}
+
+	free(query);
+	free(databases);
+	free(max_scores);
+	free(slots);
+	free(similarity_matrix_sw);
+	free(direction_matrix_sw);
+
+	lsal_prof_write("pipeline", N, M);
+	return EXIT_SUCCESS;
+}
+
+/*
+ Co-scheduling mode: each run splits one database between the score-only kernel and the ARM
+ cores. The FPGA owns the rows [0, split), the CPU threads share [split, M), each thread
+ computing its own rows and the 3N rows before them, like the shards above, so hits across
+ the boundary are found exactly. The split follows the throughput each side showed in the
+ previous runs, so both sides finish at about the same time.
+ */
+typedef struct {
+	const char *q, *d;
+	size_t N;
+	size_t own_start, own_end, win_start;
+	int max_score;                      // best cell of the owned rows, first in row-major order
+	size_t max_row, max_col;
+	double ms;
+} lsal_cpu_part_t;
+
+/*
+ Scores the part's window two rows at a time; runs on its own thread. The recurrence is the one
+ of lsal_compute_matrices_p in arm/lsal_par_arm.c, which cannot be reused here since it fills
+ a full matrix of the window, and only the best owned cell is needed.
+ */
+void *lsal_cpu_score(void *arg) {
+	lsal_cpu_part_t *part = (lsal_cpu_part_t *) arg;
+	size_t N = part->N;
+	double start = lsal_wall_ms();
+
+	int *prev = (int *) calloc(N, sizeof(int));
+	int *curr = (int *) calloc(N, sizeof(int));
+	part->max_score = 0;
+	part->max_row = part->own_start;
+	part->max_col = 0;
+
+	for (size_t row = part->win_start; row < part->own_end; row++) {
+		char db = part->d[row];
+		int owned = row >= part->own_start;
+
+		for (size_t col = 0; col < N; col++) {
+			int score = (db == part->q[col]) ? Match : Mismatch;
+
+			int D = (row > part->win_start && col > 0) ? prev[col - 1] + score : score;
+			int U = (row > part->win_start) ? prev[col] + Gap_row : Gap_row;
+			int L = (col > 0) ? curr[col - 1] + Gap_col : Gap_col;
+
+			int best = 0;
+			if (D > best) best = D;
+			if (U > best) best = U;
+			if (L > best) best = L;
+			curr[col] = best;
+
+			if (owned && best > part->max_score) {
+				part->max_score = best;
+				part->max_row = row;
+				part->max_col = col;
+			}
+		}
+
+		int *t = prev;
+		prev = curr;
+		curr = t;
+	}
+
+	free(prev);
+	free(curr);
+	part->ms = lsal_wall_ms() - start;
+	return NULL;
+}
+
+// Deals [own_start, own_end) over count parts, each computed with the 3N rows before it
+void lsal_plan_cpu_parts(lsal_cpu_part_t *parts, int count, const char *q, const char *d,
+		size_t N, size_t own_start, size_t own_end) {
+	size_t overlap = 3 * N;
+	size_t rows = own_end - own_start;
+
+	for (int t = 0; t < count; t++) {
+		lsal_cpu_part_t *part = &parts[t];
+		part->q = q;
+		part->d = d;
+		part->N = N;
+		part->own_start = own_start + rows * t / count;
+		part->own_end = own_start + rows * (t + 1) / count;
+		part->win_start = part->own_start > overlap ? part->own_start - overlap : 0;
+	}
+}
+
+/*
+ Scores the rows [own_start, own_end) on up to `threads` threads and merges their hits into
+ *best: the first best cell in row-major order, with best->ms the wall time of the threads.
+ Returns 0, or -1 if a thread could not be started.
+ */
+int lsal_cpu_search(const char *q, const char *d, size_t N, size_t own_start, size_t own_end,
+		int threads, lsal_cpu_part_t *best) {
+	double start = lsal_wall_ms();
+	size_t rows = own_end - own_start;
+	int count = rows < (size_t) threads ? (int) rows : threads;
+	int err = 0;
+
+	lsal_cpu_part_t *parts = (lsal_cpu_part_t *) calloc(count > 0 ? count : 1, sizeof(lsal_cpu_part_t));
+	pthread_t *tids = (pthread_t *) malloc(sizeof(pthread_t) * (count > 0 ? count : 1));
+	lsal_plan_cpu_parts(parts, count, q, d, N, own_start, own_end);
+
+	int started = 0;
+	for (; started < count; started++) {
+		if (pthread_create(&tids[started], NULL, lsal_cpu_score, &parts[started])) {
+			printf("Error: Failed to start CPU thread %d!\n", started);
+			err = -1;
+			break;
+		}
+	}
+	for (int t = 0; t < started; t++) pthread_join(tids[t], NULL);
+
+	// Parts are in row order, so only a strictly better score replaces the best
+	best->max_score = 0;
+	best->max_row = own_start;
+	best->max_col = 0;
+	for (int t = 0; t < started; t++) {
+		if (parts[t].max_score > best->max_score) {
+			best->max_score = parts[t].max_score;
+			best->max_row = parts[t].max_row;
+			best->max_col = parts[t].max_col;
+		}
+	}
+	best->ms = lsal_wall_ms() - start;
+
+	free(parts);
+	free(tids);
+	return err;
+}
+
+int lsal_run_cosched(int argc, char **argv) {
+	int err;
+
+	if (argc != 5 && argc != 6) {
+		printf("%s -c <input xclbin file> <Query Size N> <DataBase Size M> <Runs> [<CPU Threads>]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	cl_int N = atoi(argv[2]);
+	cl_int M = atoi(argv[3]);
+	int runs = atoi(argv[4]);
+	int threads = argc == 6 ? atoi(argv[5]) : 4;
+	if (N <= 0 || M <= 0 || runs <= 0 || threads <= 0) {
+		printf("N, M, the run count and the thread count should be positive numbers. \n");
+		return EXIT_FAILURE;
+	}
+	if (N > 16383) {
+		printf("N should be at most 16383, the HW scores are 16 bits wide. \n");
+		return EXIT_FAILURE;
+	}
+
+	// The FPGA part is one task, so it stays within the on-chip boundary rows
+	cl_int stripes = (N + N_MAX - 1) / N_MAX;
+	cl_int fpga_max = M > M_MAX ? M_MAX : M;
+
+	size_t query_size_hw = lsal_axi_round((size_t) stripes * N_MAX);
+	size_t database_size = lsal_axi_round(fpga_max + 2 * N_MAX - 1);
+
+	char *query = (char*) malloc(sizeof(char) * query_size_hw);
+	char *database = (char*) malloc(sizeof(char) * M);
+	memset(query, 'X', sizeof(char) * query_size_hw);
+	fillRandom(query, N);
+
+	cl_context context;
+	cl_command_queue commands;
+	cl_program program;
+	cl_kernel kernel;
+
+	if (lsal_cl_setup(argv[1], &context, &commands, &program)) return EXIT_FAILURE;
+	if (lsal_cl_kernels(program, "lsal_compute_score_aug", 1, &kernel)) return EXIT_FAILURE;
+
+	cl_mem input_query = lsal_shared_buffer(context, CL_MEM_READ_ONLY, sizeof(char) * query_size_hw);
+	cl_mem database_buf = lsal_shared_buffer(context, CL_MEM_READ_ONLY, sizeof(char) * database_size);
+	cl_mem max_index_buf = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_int), NULL, NULL);
+	cl_mem max_score_buf = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_int), NULL, NULL);
+	if (!input_query || !database_buf || !max_index_buf || !max_score_buf) {
+		printf("Error: Failed to allocate device memory!\n");
+		printf("Test failed\n");
+		return EXIT_FAILURE;
+	}
+
+	cl_event write_query;
+	char *query_hw = (char*) lsal_map(commands, input_query, CL_MAP_WRITE_INVALIDATE_REGION,
+			sizeof(char) * query_size_hw, 0, NULL, NULL);
+	if (!query_hw) {
+		printf("Error: Failed to map the query!\n");
+		printf("Test failed\n");
+		return EXIT_FAILURE;
+	}
+	memcpy(query_hw, query, sizeof(char) * query_size_hw);
+	clEnqueueUnmapMemObject(commands, input_query, query_hw, 0, NULL, &write_query);
+
+	// Share of the rows given to the FPGA; each side keeps a few percent so it stays measured
+	double fraction = 0.5;
+	int mismatches = 0;
+	double total_ms = 0.0;
+
+	printf("LAUNCH %d runs on the FPGA and %d CPU threads \n", runs, threads);
+	for (int r = 0; r < runs; r++) {
+		fillRandom(database, M);
+
+		cl_int split = (cl_int) (fraction * M + 0.5);
+		if (split > fpga_max) split = fpga_max;
+		if (split < 1) split = 1;
+		double run_start = lsal_wall_ms();
+
+		char *database_hw = (char*) lsal_map(commands, database_buf, CL_MAP_WRITE_INVALIDATE_REGION,
+				sizeof(char) * database_size, 0, NULL, NULL);
+		if (!database_hw) {
+			printf("Error: Failed to map the database of run %d!\n", r);
+			printf("Test failed\n");
+			return EXIT_FAILURE;
+		}
+		memset(database_hw, 'X', sizeof(char) * database_size);
+		memcpy(database_hw + N_MAX - 1, database, sizeof(char) * split);
+
+		cl_event write_event, kernel_event, read_events[2];
+		cl_int max_index_hw, max_score_hw;
+		err = clEnqueueUnmapMemObject(commands, database_buf, database_hw, 0, NULL, &write_event);
+
+		err |= clSetKernelArg(kernel, 0, sizeof(cl_mem), &input_query);
+		err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &database_buf);
+		err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &max_index_buf);
+		err |= clSetKernelArg(kernel, 3, sizeof(cl_mem), &max_score_buf);
+		err |= clSetKernelArg(kernel, 4, sizeof(cl_int), &N);
+		err |= clSetKernelArg(kernel, 5, sizeof(cl_int), &split);
+
+		cl_event inputs[2] = { write_query, write_event };
+		err |= clEnqueueTask(commands, kernel, 2, inputs, &kernel_event);
+		err |= clEnqueueReadBuffer(commands, max_index_buf, CL_FALSE, 0, sizeof(cl_int),
+				&max_index_hw, 1, &kernel_event, &read_events[0]);
+		err |= clEnqueueReadBuffer(commands, max_score_buf, CL_FALSE, 0, sizeof(cl_int),
+				&max_score_hw, 1, &kernel_event, &read_events[1]);
+		if (err != CL_SUCCESS) {
+			printf("Error: Failed to queue run %d! %d\n", r, err);
+			printf("Test failed\n");
+			return EXIT_FAILURE;
+		}
+		clFlush(commands);
+
+		// The ARM cores take the rest of the database while the kernel runs
+		int phase = lsal_prof_begin("cpu_part run %d", r);
+		lsal_cpu_part_t cpu;
+		if (lsal_cpu_search(query, database, N, split, M, threads, &cpu)) return EXIT_FAILURE;
+		double cpu_ms = cpu.ms;
+		lsal_prof_end(phase);
+
+		phase = lsal_prof_begin("device_wait run %d", r);
+		clWaitForEvents(2, read_events);
+		lsal_prof_end(phase);
+		double run_ms = lsal_wall_ms() - run_start;
+		total_ms += run_ms;
+
+		// FPGA time counts its transfer too, from the database unmap to the end of the kernel
+		double fpga_ms = (lsal_event_time(kernel_event, CL_PROFILING_COMMAND_END)
+				- lsal_event_time(write_event, CL_PROFILING_COMMAND_START)) / 1000000.0;
+
+		/**************************************************************
+		 * Merge: the FPGA owns the first rows, the CPU the next ones,
+		 * so taking a strictly better score keeps the first best cell
+		 * in row-major order
+		 **************************************************************/
+		int best_score = max_score_hw;
+		size_t best_row = max_index_hw / N, best_col = max_index_hw % N;
+		const char *best_side = "FPGA";
+		if (cpu.max_score > best_score) {
+			best_score = cpu.max_score;
+			best_row = cpu.max_row;
+			best_col = cpu.max_col;
+			best_side = "CPU";
+		}
+
+		printf("Run %d: FPGA rows [0, %d) in %lf ms, CPU rows [%d, %d) in %lf ms, %lf ms total \n",
+				r, split, fpga_ms, split, M, cpu_ms, run_ms);
+		printf("Run %d: max score %d at (%lu, %lu) from the %s \n", r, best_score, best_row, best_col, best_side);
+
+		// Rows per ms of each side set the next split
+		if (split < M && fpga_ms > 0 && cpu_ms > 0) {
+			double fpga_rate = split / fpga_ms;
+			double cpu_rate = (M - split) / cpu_ms;
+			double balanced = fpga_rate / (fpga_rate + cpu_rate);
+			fraction = 0.5 * fraction + 0.5 * balanced;
+			if (fraction < 0.02) fraction = 0.02;
+			if (fraction > 0.98) fraction = 0.98;
+		}
+
+		// Check against one CPU pass over the whole database
+		phase = lsal_prof_begin("sw_golden run %d", r);
+		lsal_cpu_part_t whole;
+		lsal_plan_cpu_parts(&whole, 1, query, database, N, 0, M);
+		lsal_cpu_score(&whole);
+		lsal_prof_end(phase);
+		if (whole.max_score != best_score) {
+			printf("Error, run %d: SW score %d, merged %d \n", r, whole.max_score, best_score);
+			mismatches++;
+		}
+
+		lsal_prof_command(write_event, "unmap database run %d", r);
+		lsal_prof_command(kernel_event, "kernel run %d", r);
+		lsal_prof_command(read_events[0], "read max_index run %d", r);
+		lsal_prof_command(read_events[1], "read max_score run %d", r);
+		clReleaseEvent(write_event);
+		clReleaseEvent(kernel_event);
+		clReleaseEvent(read_events[0]);
+		clReleaseEvent(read_events[1]);
+
+		if (r == runs - 1) {
+			phase = lsal_prof_begin("traceback");
+			lsal_traceback_window(query, database, best_row, best_col, best_score);
+			lsal_prof_end(phase);
+		}
+	}
+	clFinish(commands);
+
+	printf(" %d runs in %lf ms, final FPGA share %.1lf%% \n", runs, total_ms, 100.0 * fraction);
+
+	lsal_prof_command(write_query, "unmap query");
+	clReleaseEvent(write_query);
+	clReleaseMemObject(input_query);
+	clReleaseMemObject(database_buf);
+	clReleaseMemObject(max_index_buf);
+	clReleaseMemObject(max_score_buf);
+	clReleaseKernel(kernel);
+	clReleaseProgram(program);
+	clReleaseCommandQueue(commands);
+	clReleaseContext(context);
+
+	if (mismatches == 0) {
+		printf("computation ended!- RESULTS CORRECT \n");
+	} else {
+		printf("Error, %d of %d runs mismatch \n", mismatches, runs);
+	}
+
+	free(query);
+	free(database);
+
+	lsal_prof_write("cosched", N, M);
+	return EXIT_SUCCESS;
+}
+
+/*
+ Server mode: the platform, the program and the kernel are set up once, then alignment jobs
+ arrive over a UNIX stream socket, so a job costs its transfers and its kernel only. The
+ device buffers are kept between jobs and only grow when a bigger job arrives. Without a
+ device, or for a job the kernel cannot take, the job runs on the CPU threads instead.
+
+ Protocol, client -> server, host byte order: one lsal_job_request_t, the query, then the
+ database. The server answers every request with one lsal_job_reply_t. A connection can
+ carry any number of jobs; the server closes it after a malformed request.
+ */
+#define LSAL_JOB_MAGIC 0x4c53414cu
+#define LSAL_JOB_VERSION 1
+#define LSAL_JOB_CPU 1                  // request flag: run on the CPU even with a device
+
+#define LSAL_BACKEND_FPGA 0
+#define LSAL_BACKEND_CPU 1
+
+// Largest job the server accepts
+#define LSAL_JOB_MAX_QUERY 16383
+#define LSAL_JOB_MAX_DATABASE (1u << 30)
+
+typedef struct {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t flags;
+	uint32_t query_length;
+	uint32_t database_length;
+} lsal_job_request_t;
+
+typedef struct {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t backend;                   // LSAL_BACKEND_*
+	uint32_t status;                    // 0 on success, an errno value otherwise
+	int32_t score;
+	uint64_t row;                       // database row of the best cell, first in row-major order
+	uint32_t col;
+	uint32_t compute_us;                // time the server spent on the job
+} lsal_job_reply_t;
+
+typedef struct {
+	int has_device;
+	int threads;
+	cl_context context;
+	cl_command_queue commands;
+	cl_program program;
+	cl_kernel kernel;
+	cl_mem query_buf, database_buf, max_index_buf, max_score_buf;
+	size_t query_capacity, database_capacity;
+	char *query, *database;             // host copies of the job being served
+	size_t query_alloc, database_alloc;
+} lsal_server_t;
+
+static volatile sig_atomic_t lsal_server_stop = 0;
+
+void lsal_server_signal(int sig) {
+	(void) sig;
+	lsal_server_stop = 1;
+}
+
+int lsal_read_full(int fd, void *buf, size_t len) {
+	char *p = (char *) buf;
+	while (len > 0) {
+		ssize_t n = read(fd, p, len);
+		if (n < 0 && errno == EINTR && !lsal_server_stop) continue;
+		if (n <= 0) return -1;
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+int lsal_write_full(int fd, const void *buf, size_t len) {
+	const char *p = (const char *) buf;
+	while (len > 0) {
+		ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) return -1;
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+// Grows a pooled device buffer to hold at least size bytes; capacities double
+int lsal_server_reserve(lsal_server_t *srv, cl_mem *buf, size_t *capacity, size_t size) {
+	if (size <= *capacity) return 0;
+
+	size_t grown = *capacity ? *capacity : AXI_BYTES;
+	while (grown < size) grown *= 2;
+	if (*buf) clReleaseMemObject(*buf);
+	*buf = lsal_shared_buffer(srv->context, CL_MEM_READ_ONLY, grown);
+	*capacity = *buf ? grown : 0;
+	return *buf ? 0 : -1;
+}
+
+// Runs the job on the score-only kernel; the query and database are already in srv
+int lsal_server_fpga(lsal_server_t *srv, cl_int N, cl_int M, lsal_cpu_part_t *best) {
+	cl_int stripes = (N + N_MAX - 1) / N_MAX;
+	size_t query_size_hw = lsal_axi_round((size_t) stripes * N_MAX);
+	size_t database_size = lsal_axi_round(M + 2 * N_MAX - 1);
+
+	if (lsal_server_reserve(srv, &srv->query_buf, &srv->query_capacity, query_size_hw)
+			|| lsal_server_reserve(srv, &srv->database_buf, &srv->database_capacity, database_size)) {
+		printf("Error: Failed to allocate device memory for a %d x %d job!\n", N, M);
+		return -1;
+	}
+
+	char *query_hw = (char*) lsal_map(srv->commands, srv->query_buf, CL_MAP_WRITE_INVALIDATE_REGION,
+			query_size_hw, 0, NULL, NULL);
+	char *database_hw = (char*) lsal_map(srv->commands, srv->database_buf, CL_MAP_WRITE_INVALIDATE_REGION,
+			database_size, 0, NULL, NULL);
+	if (!query_hw || !database_hw) {
+		printf("Error: Failed to map the job buffers!\n");
+		// Unmapped here, or the next job would map them a second time
+		if (query_hw) clEnqueueUnmapMemObject(srv->commands, srv->query_buf, query_hw, 0, NULL, NULL);
+		if (database_hw) clEnqueueUnmapMemObject(srv->commands, srv->database_buf, database_hw, 0, NULL, NULL);
+		clFinish(srv->commands);
+		return -1;
+	}
+	memset(query_hw, 'X', query_size_hw);
+	memcpy(query_hw, srv->query, N);
+	memset(database_hw, 'X', database_size);
+	memcpy(database_hw + N_MAX - 1, srv->database, M);
+
+	cl_event write_events[2], kernel_event;
+	cl_int max_index_hw, max_score_hw;
+	int err = clEnqueueUnmapMemObject(srv->commands, srv->query_buf, query_hw, 0, NULL, &write_events[0]);
+	err |= clEnqueueUnmapMemObject(srv->commands, srv->database_buf, database_hw, 0, NULL, &write_events[1]);
+
+	err |= clSetKernelArg(srv->kernel, 0, sizeof(cl_mem), &srv->query_buf);
+	err |= clSetKernelArg(srv->kernel, 1, sizeof(cl_mem), &srv->database_buf);
+	err |= clSetKernelArg(srv->kernel, 2, sizeof(cl_mem), &srv->max_index_buf);
+	err |= clSetKernelArg(srv->kernel, 3, sizeof(cl_mem), &srv->max_score_buf);
+	err |= clSetKernelArg(srv->kernel, 4, sizeof(cl_int), &N);
+	err |= clSetKernelArg(srv->kernel, 5, sizeof(cl_int), &M);
+	err |= clEnqueueTask(srv->commands, srv->kernel, 2, write_events, &kernel_event);
+	err |= clEnqueueReadBuffer(srv->commands, srv->max_index_buf, CL_TRUE, 0, sizeof(cl_int),
+			&max_index_hw, 1, &kernel_event, NULL);
+	err |= clEnqueueReadBuffer(srv->commands, srv->max_score_buf, CL_TRUE, 0, sizeof(cl_int),
+			&max_score_hw, 1, &kernel_event, NULL);
+
+	clReleaseEvent(write_events[0]);
+	clReleaseEvent(write_events[1]);
+	clReleaseEvent(kernel_event);
+	if (err != CL_SUCCESS) {
+		printf("Error: Failed to run a %d x %d job! %d\n", N, M, err);
+		return -1;
+	}
+
+	best->max_score = max_score_hw;
+	best->max_row = max_index_hw / N;
+	best->max_col = max_index_hw % N;
+	return 0;
+}
+
+// Reads one job from the connection and answers it; returns -1 when the connection is done
+int lsal_server_job(lsal_server_t *srv, int fd) {
+	lsal_job_request_t req;
+	lsal_job_reply_t reply;
+	memset(&reply, 0, sizeof(reply));
+	reply.magic = LSAL_JOB_MAGIC;
+	reply.version = LSAL_JOB_VERSION;
+
+	if (lsal_read_full(fd, &req, sizeof(req))) return -1;
+	if (req.magic != LSAL_JOB_MAGIC || req.version != LSAL_JOB_VERSION || req.query_length == 0
+			|| req.query_length > LSAL_JOB_MAX_QUERY || req.database_length == 0
+			|| req.database_length > LSAL_JOB_MAX_DATABASE) {
+		reply.status = EINVAL;
+		lsal_write_full(fd, &reply, sizeof(reply));
+		return -1;
+	}
+
+	size_t N = req.query_length, M = req.database_length;
+	if (N > srv->query_alloc) {
+		free(srv->query);
+		srv->query = (char *) malloc(N);
+		srv->query_alloc = srv->query ? N : 0;
+	}
+	if (M > srv->database_alloc) {
+		free(srv->database);
+		srv->database = (char *) malloc(M);
+		srv->database_alloc = srv->database ? M : 0;
+	}
+	if (!srv->query || !srv->database) {
+		reply.status = ENOMEM;
+		lsal_write_full(fd, &reply, sizeof(reply));
+		return -1;
+	}
+	if (lsal_read_full(fd, srv->query, N) || lsal_read_full(fd, srv->database, M)) return -1;
+
+	double start = lsal_wall_ms();
+	lsal_cpu_part_t best;
+	memset(&best, 0, sizeof(best));
+	int use_fpga = srv->has_device && !(req.flags & LSAL_JOB_CPU) && M <= M_MAX;
+
+	if (use_fpga && lsal_server_fpga(srv, N, M, &best) == 0) {
+		reply.backend = LSAL_BACKEND_FPGA;
+	} else if (lsal_cpu_search(srv->query, srv->database, N, 0, M, srv->threads, &best) == 0) {
+		reply.backend = LSAL_BACKEND_CPU;
+	} else {
+		reply.status = EAGAIN;
+	}
+
+	reply.score = best.max_score;
+	reply.row = best.max_row;
+	reply.col = best.max_col;
+	reply.compute_us = (uint32_t) ((lsal_wall_ms() - start) * 1000.0);
+	return lsal_write_full(fd, &reply, sizeof(reply));
+}
+
+int lsal_run_server(int argc, char **argv) {
+	if (argc != 3 && argc != 4) {
+		printf("%s -d <input xclbin file> <Socket Path> [<CPU Threads>]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	lsal_server_t srv;
+	memset(&srv, 0, sizeof(srv));
+	srv.threads = argc == 4 ? atoi(argv[3]) : 4;
+	if (srv.threads <= 0) {
+		printf("The thread count should be a positive number. \n");
+		return EXIT_FAILURE;
+	}
+
+	// Set-up happens once; without a device every job runs on the CPU
+	srv.has_device = lsal_cl_setup(argv[1], &srv.context, &srv.commands, &srv.program) == 0
+			&& lsal_cl_kernels(srv.program, "lsal_compute_score_aug", 1, &srv.kernel) == 0;
+	if (srv.has_device) {
+		srv.max_index_buf = clCreateBuffer(srv.context, CL_MEM_READ_WRITE, sizeof(cl_int), NULL, NULL);
+		srv.max_score_buf = clCreateBuffer(srv.context, CL_MEM_READ_WRITE, sizeof(cl_int), NULL, NULL);
+		srv.has_device = srv.max_index_buf && srv.max_score_buf;
+	}
+	printf("serving on the %s \n", srv.has_device ? "FPGA" : "CPU only");
+
+	int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(argv[2]) >= sizeof(addr.sun_path)) {
+		printf("Error: socket path %s is too long\n", argv[2]);
+		return EXIT_FAILURE;
+	}
+	strcpy(addr.sun_path, argv[2]);
+	unlink(argv[2]);
+	if (listener < 0 || bind(listener, (struct sockaddr *) &addr, sizeof(addr)) || listen(listener, 16)) {
+		perror("socket");
+		return EXIT_FAILURE;
+	}
+
+	// No SA_RESTART: the signal interrupts accept and read, and the loop ends
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = lsal_server_signal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	printf("listening on %s \n", argv[2]);
+	fflush(stdout);
+	long jobs = 0;
+	while (!lsal_server_stop) {
+		int fd = accept(listener, NULL, NULL);
+		if (fd < 0) {
+			if (errno == EINTR) continue;
+			perror("accept");
+			break;
+		}
+		while (!lsal_server_stop && lsal_server_job(&srv, fd) == 0) jobs++;
+		close(fd);
+	}
+
+	printf("served %ld jobs \n", jobs);
+	close(listener);
+	unlink(argv[2]);
+
+	if (srv.query_buf) clReleaseMemObject(srv.query_buf);
+	if (srv.database_buf) clReleaseMemObject(srv.database_buf);
+	if (srv.has_device) {
+		clReleaseMemObject(srv.max_index_buf);
+		clReleaseMemObject(srv.max_score_buf);
+		clReleaseKernel(srv.kernel);
+		clReleaseProgram(srv.program);
+		clReleaseCommandQueue(srv.commands);
+		clReleaseContext(srv.context);
+	}
+	free(srv.query);
+	free(srv.database);
+	return EXIT_SUCCESS;
+}
+
+/*
+ Client mode: sends random jobs to a server, checks every reply against the CPU and reports
+ the round-trip latency next to the time the server spent computing.
+ */
+/*
+ Sends one job and checks the reply against the CPU: the score must match, and a positive
+ score must sit on a cell of the matrix. Returns -1 if the connection failed, else 1 on a
+ mismatch and 0 otherwise.
+ */
+int lsal_client_job(int fd, uint16_t flags, const char *query, int N, const char *database, int M,
+		lsal_job_reply_t *reply, double *ms) {
+	lsal_job_request_t req = { LSAL_JOB_MAGIC, LSAL_JOB_VERSION, flags, (uint32_t) N, (uint32_t) M };
+
+	double start = lsal_wall_ms();
+	if (lsal_write_full(fd, &req, sizeof(req)) || lsal_write_full(fd, query, N)
+			|| lsal_write_full(fd, database, M) || lsal_read_full(fd, reply, sizeof(*reply))) {
+		return -1;
+	}
+	*ms = lsal_wall_ms() - start;
+
+	lsal_cpu_part_t whole;
+	lsal_plan_cpu_parts(&whole, 1, query, database, N, 0, M);
+	lsal_cpu_score(&whole);
+
+	int bad_cell = reply->score > 0 && (reply->row >= (uint64_t) M || reply->col >= (uint32_t) N);
+	if (reply->magic != LSAL_JOB_MAGIC || reply->status != 0 || reply->score != whole.max_score || bad_cell) {
+		printf("Error, %.*s vs %.*s%s: status %u, score %d at (%lu, %u), SW %d \n", N < 32 ? N : 32, query,
+				M < 32 ? M : 32, database, N > 32 || M > 32 ? "..." : "", reply->status, reply->score,
+				(unsigned long) reply->row, reply->col, whole.max_score);
+		return 1;
+	}
+	return 0;
+}
+
+int lsal_run_client(int argc, char **argv) {
+	if (argc != 5 && argc != 6) {
+		printf("%s -j <Socket Path> <Query Size N> <DataBase Size M> <Jobs> [cpu]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	int N = atoi(argv[2]);
+	int M = atoi(argv[3]);
+	int jobs = atoi(argv[4]);
+	if (N <= 0 || M <= 0 || jobs <= 0 || N > LSAL_JOB_MAX_QUERY) {
+		printf("N, M and the job count should be positive numbers, N at most %d. \n", LSAL_JOB_MAX_QUERY);
+		return EXIT_FAILURE;
+	}
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, argv[1], sizeof(addr.sun_path) - 1);
+	if (fd < 0 || connect(fd, (struct sockaddr *) &addr, sizeof(addr))) {
+		perror("connect");
+		return EXIT_FAILURE;
+	}
+
+	char *query = (char*) malloc(N);
+	char *database = (char*) malloc(M);
+	uint16_t flags = argc == 6 ? LSAL_JOB_CPU : 0;
+
+	// 'X' is also the byte the kernel pads the database with, and unknown residues use it
+	static const char *const edge_cases[][2] = {
+		{ "XXXX", "AAAA" }, { "AXXA", "CCCCCC" }, { "ACGTXACGT", "XXXXACGTXXXX" }, { "X", "X" },
+	};
+
+	int mismatches = 0;
+	lsal_job_reply_t reply;
+	double ms;
+	for (size_t e = 0; e < sizeof(edge_cases) / sizeof(edge_cases[0]); e++) {
+		const char *q = edge_cases[e][0], *d = edge_cases[e][1];
+		int res = lsal_client_job(fd, flags, q, strlen(q), d, strlen(d), &reply, &ms);
+		if (res < 0) {
+			printf("Error: the server closed the connection at edge case %zu\n", e);
+			return EXIT_FAILURE;
+		}
+		mismatches += res;
+	}
+
+	double total_ms = 0.0, max_ms = 0.0, compute_ms = 0.0;
+	for (int j = 0; j < jobs; j++) {
+		fillRandom(query, N);
+		fillRandom(database, M);
+		// Every fourth query has a masked run, as in soft-masked DNA
+		if (j % 4 == 3) memset(query + N / 4, 'X', N / 4);
+
+		int res = lsal_client_job(fd, flags, query, N, database, M, &reply, &ms);
+		if (res < 0) {
+			printf("Error: the server closed the connection at job %d\n", j);
+			return EXIT_FAILURE;
+		}
+		mismatches += res;
+		total_ms += ms;
+		compute_ms += reply.compute_us / 1000.0;
+		if (ms > max_ms) max_ms = ms;
+
+		if (j == 0) {
+			printf("Job 0 on the %s: max score %d at (%lu, %u) \n",
+					reply.backend == LSAL_BACKEND_FPGA ? "FPGA" : "CPU", reply.score,
+					(unsigned long) reply.row, reply.col);
+		}
+	}
+	close(fd);
+
+	printf(" %d jobs: %lf ms mean round trip, %lf ms max, %lf ms mean in the server \n", jobs,
+			total_ms / jobs, max_ms, compute_ms / jobs);
+	if (mismatches == 0) {
+		printf("computation ended!- RESULTS CORRECT \n");
+	} else {
+		printf("Error, %d of %zu jobs mismatch \n", mismatches, jobs + sizeof(edge_cases) / sizeof(edge_cases[0]));
+	}
+
+	free(query);
+	free(database);
+	return mismatches ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/*******************************************************************************
+ *   Host program running on the Arm CPU. 
+ *   The code is written using the OpenCL API. 
+ *   We have provided multiple comments for you to understand where each thing  
+*******************************************************************************/
+int main(int argc, char** argv) {
+	printf("starting HOST code \n");
+	fflush(stdout);
+	int err;                            // error code returned from api calls
+	size_t matrix_size, query_size_hw;
+
+	lsal_prof_init();
+
+	// -b runs many database records per kernel launch
+	if (argc > 1 && !strcmp(argv[1], "-b")) return lsal_run_batch(argc - 1, argv + 1);
+	// -l aligns many queries against one database, LANES per pass of the database
+	if (argc > 1 && !strcmp(argv[1], "-l")) return lsal_run_lanes(argc - 1, argv + 1);
+	// -k reports the best few hits of every query column above a threshold
+	if (argc > 1 && !strcmp(argv[1], "-k")) return lsal_run_hits(argc - 1, argv + 1);
+	// -a runs the affine-gap kernel
+	if (argc > 1 && !strcmp(argv[1], "-a")) return lsal_run_affine(argc - 1, argv + 1);
+	// -p streams jobs through double-buffered, overlapped transfers and tracebacks
+	if (argc > 1 && !strcmp(argv[1], "-p")) return lsal_run_pipeline(argc - 1, argv + 1);
+	// -c splits every database between the FPGA and threads on the ARM cores
+	if (argc > 1 && !strcmp(argv[1], "-c")) return lsal_run_cosched(argc - 1, argv + 1);
+	// -d keeps the device warm and serves jobs over a UNIX socket, -j sends it jobs
+	if (argc > 1 && !strcmp(argv[1], "-d")) return lsal_run_server(argc - 1, argv + 1);
+	if (argc > 1 && !strcmp(argv[1], "-j")) return lsal_run_client(argc - 1, argv + 1);
+
+	// -s selects the score-only kernel: no direction matrix, the CPU rebuilds the alignment
+	int score_only = argc > 1 && !strcmp(argv[1], "-s");
+	if (score_only) {
+		argc--;
+		argv++;
+	}
+
+    if (argc != 4 && argc != 5) {
+		printf("%s [-s] <input xclbin file> <Query Size N> <DataBase Size M> [<Compute Units>]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+    cl_int N = atoi(argv[2]);
+    cl_int M = atoi(argv[3]);
+    int num_cus = argc == 5 ? atoi(argv[4]) : 1;
+    if (N <= 0 || M <= 0) {
+    	printf("N and M should be positive numbers. \n");
+		return EXIT_FAILURE;
+	}
+    if (N > 16383 || 3 * N >= M_MAX) {
+    	printf("N should be at most 16383, the HW scores are 16 bits wide. \n");
+		return EXIT_FAILURE;
+	}
+    if (num_cus <= 0 || num_cus > MAX_CUS) {
+    	printf("The number of compute units should be between 1 and %d. \n", MAX_CUS);
+		return EXIT_FAILURE;
+	}
+    if (num_cus > M) num_cus = M;
+
+    // The query is processed in stripes of N_MAX columns, the last one padded
+    cl_int stripes = (N + N_MAX - 1) / N_MAX;
+    matrix_size = (size_t) N * M;
+    query_size_hw = lsal_axi_round((size_t) stripes * N_MAX);
+
+	int phase = lsal_prof_begin("input_generation");
+	char *query = (char*) malloc(sizeof(char) * query_size_hw);
+	char *database = (char*) malloc(sizeof(char) * M);
+
+	memset(query, 'X', sizeof(char) * query_size_hw);
+	fillRandom(query, N);
+	fillRandom(database, M);
+
+	int num_shards = lsal_count_shards(num_cus, N, M);
+	lsal_shard_t *shards = (lsal_shard_t *) calloc(num_shards, sizeof(lsal_shard_t));
+	lsal_plan_shards(shards, num_shards, N, M, stripes);
+	lsal_prof_end(phase);
+
+	printf("array defined! \n");
+    fflush(stdout);
+
+	cl_context context;                 // compute context
+	cl_command_queue commands;          // compute command queue
+	cl_program program;                 // compute program
+	cl_kernel kernels[MAX_CUS];         // one compute kernel per CU
+
+	cl_mem input_query;
+
+	if (lsal_cl_setup(argv[1], &context, &commands, &program)) return EXIT_FAILURE;
+
+	/**************************************************************
+	 *  Step 6 for every Compute Unit: Create Kernels - the actual handler of the kernel
+    *           that we will be using. We first create a program, and then
+    *           obtain one kernel handler per compute unit from the program.
+	 **************************************************************/
+	const char *kernel_base = score_only ? "lsal_compute_score_aug" : "lsal_compute_matrices_aug";
+	phase = lsal_prof_begin("kernel_create");
+	if (lsal_cl_kernels(program, kernel_base, num_cus, kernels)) return EXIT_FAILURE;
+	for (int s = 0; s < num_shards; s++) shards[s].kernel = kernels[s % num_cus];
+	lsal_prof_end(phase);
+
+    /**************************************************************-
+    * Step 7 : Create buffers.
+    * We do not need to allocate separate memory space (malloc), because
+    * on a MPSoC system (e.g. ZCU102 board), we map the memory space that is
+    * allocated at clCreateBuffer, to a usable memory space for our
+    * host application. We also do not need to use free for any reason.
+    * See Xilinx UG1393 for detailed information.
+    * The query is shared by all CUs, every shard gets its own buffers.
+    **************************************************************/
+	phase = lsal_prof_begin("buffer_create");
+	input_query = lsal_shared_buffer(context, CL_MEM_READ_ONLY, sizeof(char) * query_size_hw);
+	if (!input_query) {
+		printf("Error: Failed to allocate device memory!\n");
+		printf("Test failed\n");
+		return EXIT_FAILURE;
+	}
+
+	for (int s = 0; s < num_shards; s++) {
+		lsal_shard_t *sh = &shards[s];
+		sh->database_buf = lsal_shared_buffer(context, CL_MEM_READ_ONLY,
+				sizeof(char) * sh->database_size);
+		if (!score_only) {
+			sh->direction_buf = lsal_shared_buffer(context, CL_MEM_READ_WRITE,
+					sizeof(char) * sh->matrix_size);
+		}
+		sh->max_index_buf = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_int),
+		NULL, NULL);
+		sh->max_score_buf = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_int),
+		NULL, NULL);
+
+		if (!sh->database_buf || (!score_only && !sh->direction_buf) || !sh->max_index_buf
+				|| !sh->max_score_buf) {
+			printf("Error: Failed to allocate device memory for shard %d!\n", s);
+			printf("Test failed\n");
+			return EXIT_FAILURE;
+		}
+	}
+	lsal_prof_end(phase);
+
+   /**************************************************************
+    * Step 8 : Build the Input Data in place in the mapped device buffers,
+    * padding included, and unmap them. The queue is out of order, so
+    * every kernel waits on the unmap events of its own inputs.
+    **************************************************************/
+	phase = lsal_prof_begin("input_build");
+	cl_event write_query;
+	char *query_hw = (char*) lsal_map(commands, input_query, CL_MAP_WRITE_INVALIDATE_REGION,
+			sizeof(char) * query_size_hw, 0, NULL, NULL);
+	if (!query_hw) {
+		printf("Error: Failed to map the query!\n");
+		printf("Test failed\n");
+		return EXIT_FAILURE;
+	}
+	memcpy(query_hw, query, sizeof(char) * query_size_hw);
+	clEnqueueUnmapMemObject(commands, input_query, query_hw, 0, NULL, &write_query);
+
+	for (int s = 0; s < num_shards; s++) {
+		lsal_shard_t *sh = &shards[s];
+		char *database_hw = (char*) lsal_map(commands, sh->database_buf, CL_MAP_WRITE_INVALIDATE_REGION,
+				sizeof(char) * sh->database_size, 0, NULL, NULL);
+		if (!database_hw) {
+			printf("Error: Failed to map the database of shard %d!\n", s);
+			printf("Test failed\n");
+			return EXIT_FAILURE;
+		}
+		memset(database_hw, 'X', sizeof(char) * sh->database_size);
+		memcpy(database_hw + N_MAX - 1, database + sh->win_start, sizeof(char) * sh->rows);
+		clEnqueueUnmapMemObject(commands, sh->database_buf, database_hw, 0, NULL, &sh->write_event);
+	}
+	lsal_prof_end(phase);
+
+	/**************************************************************
+	 * Step 9: Set the arguments of the shard's compute kernel. The
+	 * arguments are captured at enqueue time, so a CU can be given the
+	 * next shard's arguments right after its previous task is queued.
+	 **************************************************************/
+	printf("LAUNCH %d tasks on %d compute unit(s) \n", num_shards, num_cus);
+	phase = lsal_prof_begin("enqueue");
+	cl_int map_err;
+	for (int s = 0; s < num_shards; s++) {
+		lsal_shard_t *sh = &shards[s];
+		cl_int rows = sh->rows;
+
+		// The score-only kernel has the same arguments without the direction matrix
+		cl_uint arg = 0;
+		err = clSetKernelArg(sh->kernel, arg++, sizeof(cl_mem), &input_query);
+		err |= clSetKernelArg(sh->kernel, arg++, sizeof(cl_mem), &sh->database_buf);
+		err |= clSetKernelArg(sh->kernel, arg++, sizeof(cl_mem), &sh->max_index_buf);
+		err |= clSetKernelArg(sh->kernel, arg++, sizeof(cl_mem), &sh->max_score_buf);
+		if (!score_only) err |= clSetKernelArg(sh->kernel, arg++, sizeof(cl_mem), &sh->direction_buf);
+		err |= clSetKernelArg(sh->kernel, arg++, sizeof(cl_int), &N);
+		err |= clSetKernelArg(sh->kernel, arg++, sizeof(cl_int), &rows);
+		if (err != CL_SUCCESS) {
+			printf("Error: Failed to set kernel arguments of shard %d! %d\n", s, err);
+			printf("Test failed\n");
+			return EXIT_FAILURE;
+		}
+
+	/**************************************************************
+	 * Step 10: Place the Kernel in the Queue for Execution, then
+	 * queue the reads of its results behind it
+	 **************************************************************/
+		cl_event inputs[2] = { write_query, sh->write_event };
+
+		err = clEnqueueTask(commands, sh->kernel, 2, inputs, &sh->kernel_event);
+		if (err) {
+			printf("Error: Failed to execute kernel of shard %d! %d\n", s, err);
+			printf("Test failed\n");
+			return EXIT_FAILURE;
+		}
+
+	/**************************************************************
+	 * Step 11: Read back the results from the device to verify the output.
+	 * The direction matrix is mapped and traced back in place.
+	 **************************************************************/
+		err = clEnqueueReadBuffer(commands, sh->max_index_buf, CL_FALSE, 0,
+				sizeof(cl_int), &sh->max_index, 1, &sh->kernel_event, &sh->read_events[0]);
+		err |= clEnqueueReadBuffer(commands, sh->max_score_buf, CL_FALSE, 0,
+				sizeof(cl_int), &sh->max_score, 1, &sh->kernel_event, &sh->read_events[1]);
+		if (!score_only) {
+			sh->direction = (unsigned char*) clEnqueueMapBuffer(commands, sh->direction_buf, CL_FALSE,
+					CL_MAP_READ, 0, sizeof(char) * sh->matrix_size, 1, &sh->kernel_event,
+					&sh->read_events[2], &map_err);
+			err |= map_err;
+		}
+		if (err != CL_SUCCESS) {
+			printf("Error: Failed to read the results of shard %d! %d\n", s, err);
+			printf("Test failed\n");
+			return EXIT_FAILURE;
+		}
+	}
+	clFlush(commands);
+	lsal_prof_end(phase);
+
+	phase = lsal_prof_begin("device_wait");
+	int num_reads = score_only ? 2 : 3;
+	for (int s = 0; s < num_shards; s++) {
+		clWaitForEvents(num_reads, shards[s].read_events);
+	}
+	lsal_prof_end(phase);
+
+	cl_event *kernel_events = (cl_event *) malloc(sizeof(cl_event) * num_shards);
+	for (int s = 0; s < num_shards; s++) kernel_events[s] = shards[s].kernel_event;
+	double executionTime = getTimeSpan(kernel_events, num_shards);
+	free(kernel_events);
+
+	/**************************************************************
+	 * Merge the shards: the first shard reaching the best score wins,
+	 * which always reports a cell in its owned rows
+	 **************************************************************/
+	int best_shard = 0;
+	for (int s = 1; s < num_shards; s++) {
+		if (shards[s].max_score > shards[best_shard].max_score) best_shard = s;
+	}
+	lsal_shard_t *best = &shards[best_shard];
+
+	const char *read_names[3] = { "read max_index", "read max_score", "map directions" };
+	lsal_prof_command(write_query, "unmap query");
+	for (int s = 0; s < num_shards; s++) {
+		lsal_prof_command(shards[s].write_event, "unmap database shard %d", s);
+		lsal_prof_command(shards[s].kernel_event, "kernel shard %d", s);
+		for (int e = 0; e < num_reads; e++) lsal_prof_command(shards[s].read_events[e], "%s shard %d", read_names[e], s);
+	}
+
+	for (int s = 0; s < num_shards; s++) {
+		clReleaseEvent(shards[s].write_event);
+		clReleaseEvent(shards[s].kernel_event);
+		for (int e = 0; e < num_reads; e++) clReleaseEvent(shards[s].read_events[e]);
+		clReleaseMemObject(shards[s].database_buf);
+		clReleaseMemObject(shards[s].max_index_buf);
+		clReleaseMemObject(shards[s].max_score_buf);
+	}
+	for (int cu = 0; cu < num_cus; cu++) clReleaseKernel(kernels[cu]);
+	clReleaseEvent(write_query);
+	clReleaseMemObject(input_query);
+
+/**************************************************************
+ * Run the same algorithm in the Host Unit and compare for verification
+ **************************************************************/
+	int * similarity_matrix_sw = ( int *) malloc(sizeof(int) * matrix_size);
+	char * direction_matrix_sw = ( char*) malloc(sizeof(char) * matrix_size);
+	size_t * max_index_sw = ( size_t *) malloc(sizeof(size_t));
+
+	for(size_t i = 0; i < matrix_size; i++){
+		similarity_matrix_sw[i] = 0;
+	}
+
+	phase = lsal_prof_begin("sw_golden");
+	lsal_compute_matrices_sw(query, database, max_index_sw, similarity_matrix_sw, direction_matrix_sw, N, M);
+	lsal_prof_end(phase);
+
+	printf("both ended\n");
+
+	printf(" execution time is %lf ms on %d compute unit(s) \n", executionTime, num_cus);
+
+	// The score-only kernel reports a row-major index instead of a direction buffer index
+	size_t max_row_hw, max_col_hw;
+	if (score_only) {
+		max_row_hw = best->max_index / N;
+		max_col_hw = best->max_index % N;
+	} else {
+		lsal_hw_position(best->max_index, best->rows, &max_row_hw, &max_col_hw);
+	}
+	printf("HW: Max score %d at (%lu, %lu), shard %d\n", best->max_score,
+			best->win_start + max_row_hw, max_col_hw, best_shard);
+	printf("SW: Max score %d at (%lu, %lu)\n", similarity_matrix_sw[*max_index_sw],
+			*max_index_sw / N, *max_index_sw % N);
+
+	phase = lsal_prof_begin("traceback_hw");
+	if (score_only) {
+		lsal_traceback_window(query, database, best->win_start + max_row_hw, max_col_hw, best->max_score);
+	} else {
+		lsal_traceback_hw(query, database + best->win_start, best->direction, best->max_index, N, best->rows);
+	}
+	lsal_prof_end(phase);
+
+	phase = lsal_prof_begin("traceback_sw");
+	lsal_traceback_sw(query, database, similarity_matrix_sw, direction_matrix_sw, *max_index_sw, N, M);
+	lsal_prof_end(phase);
+	int max_score_sw = similarity_matrix_sw[*max_index_sw];
+
+	// Every shard's direction matrix against the SW matrices of its own window
+	size_t bad_directions = 0;
+	phase = lsal_prof_begin("direction_check");
+	if (!score_only) {
+		for (int s = 0; s < num_shards; s++) {
+			lsal_shard_t *sh = &shards[s];
+			size_t window_max;
+			lsal_compute_matrices_sw(query, database + sh->win_start, &window_max, similarity_matrix_sw,
+					direction_matrix_sw, N, sh->rows);
+			bad_directions += lsal_check_directions_hw(query, database + sh->win_start, sh->direction,
+					similarity_matrix_sw, N, sh->rows);
+		}
+	}
+	lsal_prof_end(phase);
+
+	if (best->max_score == max_score_sw && bad_directions == 0) {
+		printf("computation ended!- RESULTS CORRECT \n");
+	} else if (best->max_score != max_score_sw) {
+		printf("Error, mismatch in the max score, SW: %d, HW %d \n", max_score_sw, best->max_score);
+	} else {
+		printf("Error, %lu HW directions are inconsistent with the SW scores \n", bad_directions);
+	}
+
+	/**************************************************************
+	 * Clean up everything and, then, shutdown 
+	 **************************************************************/
+    
+	phase = lsal_prof_begin("cleanup");
+	if (!score_only) {
+		for (int s = 0; s < num_shards; s++) {
+			clEnqueueUnmapMemObject(commands, shards[s].direction_buf, shards[s].direction, 0, NULL, NULL);
+		}
+		clFinish(commands);
+		for (int s = 0; s < num_shards; s++) clReleaseMemObject(shards[s].direction_buf);
+	}
+	clReleaseProgram(program);
+	clReleaseCommandQueue(commands);
+	clReleaseContext(context);
+	lsal_prof_end(phase);
+
+	lsal_prof_write(score_only ? "score" : "matrices", N, M);
 
-	/**************************************************************
-	 * Clean up everything and, then, shutdown 
-	 **************************************************************/
-    
    	free(query);
    	free(database);
-   	free(database_hw);
-	free(direction_matrix_hw);
-	free(max_index_hw);
+	free(shards);
 	free(similarity_matrix_sw);
 	free(direction_matrix_sw);
 	free(max_index_sw);
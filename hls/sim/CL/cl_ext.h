@@ -0,0 +1,8 @@
+#ifndef LSAL_SIM_CL_EXT_H
+#define LSAL_SIM_CL_EXT_H
+
+// The CPU backend has no vendor extensions
+
+#include <CL/opencl.h>
+
+#endif
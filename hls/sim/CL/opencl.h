@@ -0,0 +1,127 @@
+#ifndef LSAL_SIM_OPENCL_H
+#define LSAL_SIM_OPENCL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ The subset of the OpenCL 1.2 API that lsal_host.cpp uses, implemented by lsal_cl_cpu.cpp
+ on top of the C++ model of the kernels. Building the host with -Ihls/sim selects it
+ instead of the platform's OpenCL headers and runtime.
+ */
+
+typedef int16_t cl_short;
+typedef int32_t cl_int;
+typedef uint32_t cl_uint;
+typedef uint64_t cl_ulong;
+typedef cl_uint cl_bool;
+typedef cl_ulong cl_bitfield;
+typedef cl_bitfield cl_mem_flags;
+typedef cl_bitfield cl_map_flags;
+typedef cl_bitfield cl_device_type;
+typedef cl_bitfield cl_command_queue_properties;
+typedef cl_uint cl_platform_info;
+typedef cl_uint cl_program_build_info;
+typedef cl_uint cl_profiling_info;
+typedef intptr_t cl_context_properties;
+
+typedef struct _cl_platform_id *cl_platform_id;
+typedef struct _cl_device_id *cl_device_id;
+typedef struct _cl_context *cl_context;
+typedef struct _cl_command_queue *cl_command_queue;
+typedef struct _cl_program *cl_program;
+typedef struct _cl_kernel *cl_kernel;
+typedef struct _cl_mem *cl_mem;
+typedef struct _cl_event *cl_event;
+
+#define CL_SUCCESS 0
+#define CL_DEVICE_NOT_FOUND -1
+#define CL_OUT_OF_HOST_MEMORY -6
+#define CL_INVALID_VALUE -30
+#define CL_INVALID_KERNEL_NAME -46
+#define CL_INVALID_ARG_INDEX -49
+#define CL_INVALID_KERNEL_ARGS -52
+
+#define CL_FALSE 0
+#define CL_TRUE 1
+
+#define CL_PLATFORM_NAME 0x0902
+#define CL_PLATFORM_VENDOR 0x0903
+
+#define CL_DEVICE_TYPE_CPU (1 << 1)
+#define CL_DEVICE_TYPE_ACCELERATOR (1 << 3)
+
+#define CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE (1 << 0)
+#define CL_QUEUE_PROFILING_ENABLE (1 << 1)
+
+#define CL_MEM_READ_WRITE (1 << 0)
+#define CL_MEM_WRITE_ONLY (1 << 1)
+#define CL_MEM_READ_ONLY (1 << 2)
+#define CL_MEM_USE_HOST_PTR (1 << 3)
+#define CL_MEM_ALLOC_HOST_PTR (1 << 4)
+
+#define CL_MAP_READ (1 << 0)
+#define CL_MAP_WRITE (1 << 1)
+#define CL_MAP_WRITE_INVALIDATE_REGION (1 << 2)
+
+#define CL_PROGRAM_BUILD_LOG 0x1183
+
+#define CL_PROFILING_COMMAND_QUEUED 0x1280
+#define CL_PROFILING_COMMAND_SUBMIT 0x1281
+#define CL_PROFILING_COMMAND_START 0x1282
+#define CL_PROFILING_COMMAND_END 0x1283
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+cl_int clGetPlatformIDs(cl_uint num_entries, cl_platform_id *platforms, cl_uint *num_platforms);
+cl_int clGetPlatformInfo(cl_platform_id platform, cl_platform_info param, size_t size, void *value, size_t *size_ret);
+cl_int clGetDeviceIDs(cl_platform_id platform, cl_device_type type, cl_uint num_entries, cl_device_id *devices,
+                      cl_uint *num_devices);
+
+cl_context clCreateContext(const cl_context_properties *properties, cl_uint num_devices, const cl_device_id *devices,
+                           void (*notify)(const char *, const void *, size_t, void *), void *user_data, cl_int *err);
+cl_command_queue clCreateCommandQueue(cl_context context, cl_device_id device, cl_command_queue_properties properties,
+                                      cl_int *err);
+
+cl_program clCreateProgramWithBinary(cl_context context, cl_uint num_devices, const cl_device_id *devices,
+                                     const size_t *lengths, const unsigned char **binaries, cl_int *status, cl_int *err);
+cl_int clBuildProgram(cl_program program, cl_uint num_devices, const cl_device_id *devices, const char *options,
+                      void (*notify)(cl_program, void *), void *user_data);
+cl_int clGetProgramBuildInfo(cl_program program, cl_device_id device, cl_program_build_info param, size_t size,
+                             void *value, size_t *size_ret);
+
+cl_kernel clCreateKernel(cl_program program, const char *name, cl_int *err);
+cl_int clSetKernelArg(cl_kernel kernel, cl_uint index, size_t size, const void *value);
+
+cl_mem clCreateBuffer(cl_context context, cl_mem_flags flags, size_t size, void *host_ptr, cl_int *err);
+
+cl_int clEnqueueWriteBuffer(cl_command_queue queue, cl_mem buffer, cl_bool blocking, size_t offset, size_t size,
+                            const void *ptr, cl_uint num_wait, const cl_event *wait, cl_event *event);
+cl_int clEnqueueReadBuffer(cl_command_queue queue, cl_mem buffer, cl_bool blocking, size_t offset, size_t size,
+                           void *ptr, cl_uint num_wait, const cl_event *wait, cl_event *event);
+void *clEnqueueMapBuffer(cl_command_queue queue, cl_mem buffer, cl_bool blocking, cl_map_flags flags, size_t offset,
+                         size_t size, cl_uint num_wait, const cl_event *wait, cl_event *event, cl_int *err);
+cl_int clEnqueueUnmapMemObject(cl_command_queue queue, cl_mem buffer, void *ptr, cl_uint num_wait,
+                               const cl_event *wait, cl_event *event);
+cl_int clEnqueueTask(cl_command_queue queue, cl_kernel kernel, cl_uint num_wait, const cl_event *wait,
+                     cl_event *event);
+
+cl_int clWaitForEvents(cl_uint num_events, const cl_event *events);
+cl_int clGetEventProfilingInfo(cl_event event, cl_profiling_info param, size_t size, void *value, size_t *size_ret);
+cl_int clFlush(cl_command_queue queue);
+cl_int clFinish(cl_command_queue queue);
+
+cl_int clReleaseEvent(cl_event event);
+cl_int clReleaseMemObject(cl_mem buffer);
+cl_int clReleaseKernel(cl_kernel kernel);
+cl_int clReleaseProgram(cl_program program);
+cl_int clReleaseCommandQueue(cl_command_queue queue);
+cl_int clReleaseContext(cl_context context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef LSAL_SIM_AP_INT_H
+#define LSAL_SIM_AP_INT_H
+
+#include <stdint.h>
+
+/*
+ Stand-in for the Vitis ap_uint<W>, for building the kernel with plain g++. Only what lsal.cpp
+ uses is modelled: construction from an integer, reading or writing a bit range of at most
+ 64 bits with range(hi, lo), and assigning a whole ap_uint of any width to a range. Bits are
+ stored little-endian in 64-bit words, so an ap_uint<8 * B> has the same memory layout as the
+ B bytes the host hands to an AXI port.
+ */
+template <int W>
+class ap_uint;
+
+template <int W>
+class ap_range_ref {
+public:
+    ap_range_ref(ap_uint<W> *v, int hi, int lo) : v(v), hi(hi), lo(lo) {}
+
+    operator uint64_t() const { return v->get_range(hi, lo); }
+
+    ap_range_ref &operator=(uint64_t x) {
+        v->set_range(hi, lo, x);
+        return *this;
+    }
+
+    ap_range_ref &operator=(const ap_range_ref &other) { return *this = (uint64_t) other; }
+
+    // Wider than 64 bits, e.g. a whole stream word packed into an AXI word; copied 64 at a time
+    template <int V>
+    ap_range_ref &operator=(const ap_uint<V> &x) {
+        for (int b = 0; b <= hi - lo; b += 64) {
+            int top = hi - lo - b < 63 ? hi - lo - b : 63;
+            uint64_t bits = b < V ? x.get_range(b + top < V ? b + top : V - 1, b) : 0;
+            v->set_range(lo + b + top, lo + b, bits);
+        }
+        return *this;
+    }
+
+private:
+    ap_uint<W> *v;
+    int hi, lo;
+};
+
+template <int W>
+class ap_uint {
+public:
+    static const int WORDS = (W + 63) / 64;
+
+    ap_uint(uint64_t x = 0) {
+        for (int i = 0; i < WORDS; i++) w[i] = 0;
+        w[0] = x;
+        if (W < 64) w[0] &= mask(W);
+    }
+
+    ap_range_ref<W> range(int hi, int lo) { return ap_range_ref<W>(this, hi, lo); }
+    uint64_t range(int hi, int lo) const { return get_range(hi, lo); }
+
+    operator uint64_t() const { return w[0]; }
+
+    uint64_t get_range(int hi, int lo) const {
+        int n = hi - lo + 1, i = lo / 64, s = lo % 64;
+        uint64_t x = w[i] >> s;
+        if (s && s + n > 64) x |= w[i + 1] << (64 - s);
+        return x & mask(n);
+    }
+
+    void set_range(int hi, int lo, uint64_t x) {
+        int n = hi - lo + 1, i = lo / 64, s = lo % 64;
+        uint64_t m = mask(n);
+        x &= m;
+        w[i] = (w[i] & ~(m << s)) | (x << s);
+        if (s && s + n > 64) w[i + 1] = (w[i + 1] & ~(m >> (64 - s))) | (x >> (64 - s));
+    }
+
+private:
+    static uint64_t mask(int n) { return n >= 64 ? ~0ull : (1ull << n) - 1; }
+
+    uint64_t w[WORDS];
+};
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef LSAL_SIM_HLS_STREAM_H
+#define LSAL_SIM_HLS_STREAM_H
+
+#include <deque>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ Stand-in for the Vitis hls::stream. The DATAFLOW processes run one after the other in a
+ plain build, so the stream is an unbounded FIFO: the producer finishes before the consumer
+ starts. Reading an empty stream means the processes disagree on the token count and aborts.
+ */
+namespace hls {
+
+template <class T>
+class stream {
+public:
+    stream() : name("stream") {}
+    explicit stream(const char *name) : name(name) {}
+
+    void write(const T &v) { fifo.push_back(v); }
+
+    T read() {
+        if (fifo.empty()) {
+            fprintf(stderr, "hls::stream %s: read from an empty stream\n", name);
+            abort();
+        }
+        T v = fifo.front();
+        fifo.pop_front();
+        return v;
+    }
+
+    bool empty() const { return fifo.empty(); }
+    bool full() const { return false; }
+
+private:
+    const char *name;
+    std::deque<T> fifo;
+};
+
+}
+
+#endif
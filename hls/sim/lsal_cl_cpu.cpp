@@ -0,0 +1,332 @@
+/*
+ CPU backend for lsal_host.cpp: the OpenCL calls the host makes, served by the C++ model of
+ the kernels in lsal.cpp instead of an FPGA. Build with
+
+   g++ -O2 -Ihls/sim -Ihls hls/lsal.cpp hls/lsal_host.cpp hls/sim/lsal_cl_cpu.cpp -o lsal_host_cpu -lpthread
+
+ and run lsal_host_cpu like lsal_host. The xclbin argument is loaded but ignored, so any
+ readable file (e.g. /dev/null) will do.
+
+ Every command runs to completion when it is enqueued, in enqueue order. The host enqueues a
+ command only after the commands it waits on, so that order satisfies every wait list. Events
+ carry CLOCK_MONOTONIC timestamps, which makes the host's profiling report CPU time. Buffers
+ are plain host memory, so mapping one returns a pointer into it.
+ */
+
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <CL/opencl.h>
+
+#include "lsal.h"
+
+#define LSAL_CPU_MAX_ARGS 8
+
+struct _cl_platform_id { int unused; };
+struct _cl_device_id { int unused; };
+struct _cl_context { int unused; };
+struct _cl_command_queue { int unused; };
+struct _cl_program { int unused; };
+
+struct _cl_mem {
+    void *data;
+    size_t size;
+    bool owned;
+};
+
+struct _cl_event {
+    cl_ulong queued, submit, start, end;
+};
+
+struct _cl_kernel {
+    char name[64];
+    unsigned char args[LSAL_CPU_MAX_ARGS][sizeof(cl_ulong)];
+    bool set[LSAL_CPU_MAX_ARGS];
+};
+
+static _cl_platform_id cpu_platform;
+static _cl_device_id cpu_device;
+
+static cl_ulong lsal_cpu_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (cl_ulong) ts.tv_sec * 1000000000ull + (cl_ulong) ts.tv_nsec;
+}
+
+static void lsal_cpu_event(cl_event *event, cl_ulong start) {
+    if (!event) return;
+    *event = new _cl_event;
+    (*event)->queued = (*event)->submit = (*event)->start = start;
+    (*event)->end = lsal_cpu_now();
+}
+
+static void lsal_cpu_err(cl_int *err, cl_int value) {
+    if (err) *err = value;
+}
+
+// Arguments of the model kernels: buffers are passed as cl_mem, scalars as cl_int
+static void *lsal_cpu_mem(cl_kernel kernel, int index) {
+    cl_mem buffer;
+    memcpy(&buffer, kernel->args[index], sizeof(cl_mem));
+    return buffer ? buffer->data : NULL;
+}
+
+static cl_int lsal_cpu_scalar(cl_kernel kernel, int index) {
+    cl_int value;
+    memcpy(&value, kernel->args[index], sizeof(cl_int));
+    return value;
+}
+
+extern "C" {
+
+cl_int clGetPlatformIDs(cl_uint num_entries, cl_platform_id *platforms, cl_uint *num_platforms) {
+    if (platforms && num_entries > 0) platforms[0] = &cpu_platform;
+    if (num_platforms) *num_platforms = 1;
+    return CL_SUCCESS;
+}
+
+cl_int clGetPlatformInfo(cl_platform_id platform, cl_platform_info param, size_t size, void *value, size_t *size_ret) {
+    const char *info = param == CL_PLATFORM_VENDOR ? "lsal" : "CPU model of the HLS kernels";
+    size_t len = strlen(info) + 1;
+    if (value) {
+        if (size < len) return CL_INVALID_VALUE;
+        memcpy(value, info, len);
+    }
+    if (size_ret) *size_ret = len;
+    return CL_SUCCESS;
+}
+
+// The model stands in for whatever device type is asked for
+cl_int clGetDeviceIDs(cl_platform_id platform, cl_device_type type, cl_uint num_entries, cl_device_id *devices,
+                      cl_uint *num_devices) {
+    if (devices && num_entries > 0) devices[0] = &cpu_device;
+    if (num_devices) *num_devices = 1;
+    return CL_SUCCESS;
+}
+
+cl_context clCreateContext(const cl_context_properties *properties, cl_uint num_devices, const cl_device_id *devices,
+                           void (*notify)(const char *, const void *, size_t, void *), void *user_data, cl_int *err) {
+    lsal_cpu_err(err, CL_SUCCESS);
+    return new _cl_context;
+}
+
+cl_command_queue clCreateCommandQueue(cl_context context, cl_device_id device, cl_command_queue_properties properties,
+                                      cl_int *err) {
+    lsal_cpu_err(err, CL_SUCCESS);
+    return new _cl_command_queue;
+}
+
+cl_program clCreateProgramWithBinary(cl_context context, cl_uint num_devices, const cl_device_id *devices,
+                                     const size_t *lengths, const unsigned char **binaries, cl_int *status, cl_int *err) {
+    if (status) *status = CL_SUCCESS;
+    lsal_cpu_err(err, CL_SUCCESS);
+    return new _cl_program;
+}
+
+cl_int clBuildProgram(cl_program program, cl_uint num_devices, const cl_device_id *devices, const char *options,
+                      void (*notify)(cl_program, void *), void *user_data) {
+    return CL_SUCCESS;
+}
+
+cl_int clGetProgramBuildInfo(cl_program program, cl_device_id device, cl_program_build_info param, size_t size,
+                             void *value, size_t *size_ret) {
+    if (value && size > 0) ((char *) value)[0] = '\0';
+    if (size_ret) *size_ret = 1;
+    return CL_SUCCESS;
+}
+
+// "name" or "name:{instance}", the instance is irrelevant on the CPU
+cl_kernel clCreateKernel(cl_program program, const char *name, cl_int *err) {
+    size_t len = strcspn(name, ":");
+    if (len >= sizeof(((_cl_kernel *) 0)->name)) {
+        lsal_cpu_err(err, CL_INVALID_KERNEL_NAME);
+        return NULL;
+    }
+
+    cl_kernel kernel = new _cl_kernel();
+    memcpy(kernel->name, name, len);
+    kernel->name[len] = '\0';
+
+    if (strcmp(kernel->name, "lsal_compute_matrices_aug") && strcmp(kernel->name, "lsal_compute_score_aug")
+        && strcmp(kernel->name, "lsal_compute_batch_aug") && strcmp(kernel->name, "lsal_compute_lanes_aug")
+        && strcmp(kernel->name, "lsal_compute_affine_aug") && strcmp(kernel->name, "lsal_compute_hits_aug")) {
+        delete kernel;
+        lsal_cpu_err(err, CL_INVALID_KERNEL_NAME);
+        return NULL;
+    }
+
+    lsal_cpu_err(err, CL_SUCCESS);
+    return kernel;
+}
+
+cl_int clSetKernelArg(cl_kernel kernel, cl_uint index, size_t size, const void *value) {
+    if (index >= LSAL_CPU_MAX_ARGS) return CL_INVALID_ARG_INDEX;
+    if (size > sizeof(kernel->args[index]) || !value) return CL_INVALID_VALUE;
+
+    memset(kernel->args[index], 0, sizeof(kernel->args[index]));
+    memcpy(kernel->args[index], value, size);
+    kernel->set[index] = true;
+    return CL_SUCCESS;
+}
+
+cl_mem clCreateBuffer(cl_context context, cl_mem_flags flags, size_t size, void *host_ptr, cl_int *err) {
+    cl_mem buffer = new _cl_mem;
+    buffer->size = size;
+    buffer->owned = !(flags & CL_MEM_USE_HOST_PTR);
+
+    // The kernels read whole AXI words, so device buffers are word aligned and padded
+    if (buffer->owned) {
+        size_t padded = (size + AXI_BYTES - 1) / AXI_BYTES * AXI_BYTES;
+        buffer->data = aligned_alloc(AXI_BYTES, padded > 0 ? padded : AXI_BYTES);
+        if (!buffer->data) {
+            delete buffer;
+            lsal_cpu_err(err, CL_OUT_OF_HOST_MEMORY);
+            return NULL;
+        }
+        memset(buffer->data, 0, padded);
+    } else {
+        buffer->data = host_ptr;
+    }
+
+    lsal_cpu_err(err, CL_SUCCESS);
+    return buffer;
+}
+
+cl_int clEnqueueWriteBuffer(cl_command_queue queue, cl_mem buffer, cl_bool blocking, size_t offset, size_t size,
+                            const void *ptr, cl_uint num_wait, const cl_event *wait, cl_event *event) {
+    if (offset + size > buffer->size) return CL_INVALID_VALUE;
+
+    cl_ulong start = lsal_cpu_now();
+    memcpy((char *) buffer->data + offset, ptr, size);
+    lsal_cpu_event(event, start);
+    return CL_SUCCESS;
+}
+
+cl_int clEnqueueReadBuffer(cl_command_queue queue, cl_mem buffer, cl_bool blocking, size_t offset, size_t size,
+                           void *ptr, cl_uint num_wait, const cl_event *wait, cl_event *event) {
+    if (offset + size > buffer->size) return CL_INVALID_VALUE;
+
+    cl_ulong start = lsal_cpu_now();
+    memcpy(ptr, (char *) buffer->data + offset, size);
+    lsal_cpu_event(event, start);
+    return CL_SUCCESS;
+}
+
+void *clEnqueueMapBuffer(cl_command_queue queue, cl_mem buffer, cl_bool blocking, cl_map_flags flags, size_t offset,
+                         size_t size, cl_uint num_wait, const cl_event *wait, cl_event *event, cl_int *err) {
+    if (offset + size > buffer->size) {
+        lsal_cpu_err(err, CL_INVALID_VALUE);
+        return NULL;
+    }
+
+    lsal_cpu_event(event, lsal_cpu_now());
+    lsal_cpu_err(err, CL_SUCCESS);
+    return (char *) buffer->data + offset;
+}
+
+cl_int clEnqueueUnmapMemObject(cl_command_queue queue, cl_mem buffer, void *ptr, cl_uint num_wait,
+                               const cl_event *wait, cl_event *event) {
+    lsal_cpu_event(event, lsal_cpu_now());
+    return CL_SUCCESS;
+}
+
+cl_int clEnqueueTask(cl_command_queue queue, cl_kernel kernel, cl_uint num_wait, const cl_event *wait,
+                     cl_event *event) {
+    bool matrices = !strcmp(kernel->name, "lsal_compute_matrices_aug");
+    bool affine = !strcmp(kernel->name, "lsal_compute_affine_aug");
+    int args = matrices || affine ? 7 : 6;
+    for (int i = 0; i < args; i++) {
+        if (!kernel->set[i]) return CL_INVALID_KERNEL_ARGS;
+    }
+
+    cl_ulong start = lsal_cpu_now();
+    if (matrices) {
+        lsal_compute_matrices_aug((const axi_word_t *) lsal_cpu_mem(kernel, 0), (const axi_word_t *) lsal_cpu_mem(kernel, 1),
+                                  (int *) lsal_cpu_mem(kernel, 2), (int *) lsal_cpu_mem(kernel, 3),
+                                  (axi_word_t *) lsal_cpu_mem(kernel, 4), lsal_cpu_scalar(kernel, 5),
+                                  lsal_cpu_scalar(kernel, 6));
+    } else if (affine) {
+        lsal_compute_affine_aug((const axi_word_t *) lsal_cpu_mem(kernel, 0), (const axi_word_t *) lsal_cpu_mem(kernel, 1),
+                                (int *) lsal_cpu_mem(kernel, 2), (int *) lsal_cpu_mem(kernel, 3),
+                                (axi_word_t *) lsal_cpu_mem(kernel, 4), lsal_cpu_scalar(kernel, 5),
+                                lsal_cpu_scalar(kernel, 6));
+    } else if (!strcmp(kernel->name, "lsal_compute_score_aug")) {
+        lsal_compute_score_aug((const axi_word_t *) lsal_cpu_mem(kernel, 0), (const axi_word_t *) lsal_cpu_mem(kernel, 1),
+                               (int *) lsal_cpu_mem(kernel, 2), (int *) lsal_cpu_mem(kernel, 3),
+                               lsal_cpu_scalar(kernel, 4), lsal_cpu_scalar(kernel, 5));
+    } else if (!strcmp(kernel->name, "lsal_compute_hits_aug")) {
+        lsal_compute_hits_aug((const axi_word_t *) lsal_cpu_mem(kernel, 0), (const axi_word_t *) lsal_cpu_mem(kernel, 1),
+                              (axi_word_t *) lsal_cpu_mem(kernel, 2), lsal_cpu_scalar(kernel, 3),
+                              lsal_cpu_scalar(kernel, 4), lsal_cpu_scalar(kernel, 5));
+    } else if (!strcmp(kernel->name, "lsal_compute_lanes_aug")) {
+        lsal_compute_lanes_aug((const axi_word_t *) lsal_cpu_mem(kernel, 0), (const axi_word_t *) lsal_cpu_mem(kernel, 1),
+                               (int *) lsal_cpu_mem(kernel, 2), lsal_cpu_scalar(kernel, 3),
+                               lsal_cpu_scalar(kernel, 4), lsal_cpu_scalar(kernel, 5));
+    } else {
+        lsal_compute_batch_aug((const axi_word_t *) lsal_cpu_mem(kernel, 0), (const axi_word_t *) lsal_cpu_mem(kernel, 1),
+                               (const int *) lsal_cpu_mem(kernel, 2), (int *) lsal_cpu_mem(kernel, 3),
+                               lsal_cpu_scalar(kernel, 4), lsal_cpu_scalar(kernel, 5));
+    }
+    lsal_cpu_event(event, start);
+    return CL_SUCCESS;
+}
+
+cl_int clWaitForEvents(cl_uint num_events, const cl_event *events) {
+    return CL_SUCCESS;
+}
+
+cl_int clGetEventProfilingInfo(cl_event event, cl_profiling_info param, size_t size, void *value, size_t *size_ret) {
+    cl_ulong t;
+    switch (param) {
+    case CL_PROFILING_COMMAND_QUEUED: t = event->queued; break;
+    case CL_PROFILING_COMMAND_SUBMIT: t = event->submit; break;
+    case CL_PROFILING_COMMAND_START: t = event->start; break;
+    case CL_PROFILING_COMMAND_END: t = event->end; break;
+    default: return CL_INVALID_VALUE;
+    }
+
+    if (value) {
+        if (size < sizeof(t)) return CL_INVALID_VALUE;
+        memcpy(value, &t, sizeof(t));
+    }
+    if (size_ret) *size_ret = sizeof(t);
+    return CL_SUCCESS;
+}
+
+cl_int clFlush(cl_command_queue queue) { return CL_SUCCESS; }
+cl_int clFinish(cl_command_queue queue) { return CL_SUCCESS; }
+
+cl_int clReleaseEvent(cl_event event) {
+    delete event;
+    return CL_SUCCESS;
+}
+
+cl_int clReleaseMemObject(cl_mem buffer) {
+    if (buffer->owned) free(buffer->data);
+    delete buffer;
+    return CL_SUCCESS;
+}
+
+cl_int clReleaseKernel(cl_kernel kernel) {
+    delete kernel;
+    return CL_SUCCESS;
+}
+
+cl_int clReleaseProgram(cl_program program) {
+    delete program;
+    return CL_SUCCESS;
+}
+
+cl_int clReleaseCommandQueue(cl_command_queue queue) {
+    delete queue;
+    return CL_SUCCESS;
+}
+
+cl_int clReleaseContext(cl_context context) {
+    delete context;
+    return CL_SUCCESS;
+}
+
+}
@@ -0,0 +1,561 @@
+#define _GNU_SOURCE
+
+#include <omp.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "lsal_x86.h"
+#include "lsal_alloc.h"
+
+#define MAX_KERNELS 8
+#define MAX_SHAPES 32
+#define MAX_THREADS 32
+#define MAX_ROWS (MAX_KERNELS * MAX_SHAPES * MAX_THREADS)
+
+/*
+ Benchmark driver for the x86 kernels. Every selected kernel runs on every (N, M) shape, and
+ the OpenMP kernel once per thread count as well. A configuration first does `warmup` untimed
+ calls, then `reps` calls that are each timed on the monotonic clock; the table reports the
+ median, p95 and p99 of those (nearest rank) and GCUPS at the median.
+
+ All kernels of a shape run on the same random query and database, and their best scores
+ must agree (the cell each one reports may differ on ties). Results can be written as CSV
+ and JSON. A previous CSV given as the baseline is matched by (kernel, N, M, threads), and a
+ configuration whose median time grew by more than the tolerance counts as a regression;
+ the exit status is 1 if there is one.
+
+ With -p the timed calls also run under the hardware counters of lsal_perf.h: those of the
+ calling thread, or of every pool thread for the OpenMP kernel. The table then adds derived
+ metrics per configuration (IPC, misses per cell, LLC traffic in bytes per cell, stalled share
+ of the cycles, and the share of the wall time the threads were on a CPU), and per thread
+ for the OpenMP kernel. Counters the machine does not offer show as n/a.
+ */
+
+typedef void (*kernel_fn)(const char *q, const char *d, size_t *max_idx, int *similarity, char *direction, size_t N, size_t M);
+
+static void kernel_u(const char *q, const char *d, size_t *max_idx, int *similarity, char *direction, size_t N, size_t M) {
+    lsal_compute_matrices_u((char *) q, (char *) d, max_idx, similarity, direction, N, M);
+}
+
+static void kernel_o(const char *q, const char *d, size_t *max_idx, int *similarity, char *direction, size_t N, size_t M) {
+    lsal_compute_matrices_o((char *) q, (char *) d, max_idx, similarity, direction, N, M);
+}
+
+// The SIMD kernel only fails when its scratch row cannot be mapped, which ends the run
+static void kernel_simd(const char *q, const char *d, size_t *max_idx, int *similarity, char *direction, size_t N, size_t M) {
+    if (lsal_compute_matrices_simd(q, d, max_idx, similarity, direction, N, M)) {
+        fprintf(stderr, "Failed to map the simd scratch row\n");
+        exit(1);
+    }
+}
+
+typedef struct {
+    const char *name;
+    kernel_fn run;
+    int threaded;       // sweeps the thread counts, the others always run on one thread
+} bench_kernel;
+
+static const bench_kernel kernels[] = {
+    { "u", kernel_u, 0 },
+    { "o", kernel_o, 0 },
+    { "omp", lsal_compute_matrices_omp, 1 },
+    { "simd", kernel_simd, 0 },
+};
+
+// Metrics derived from the counters, per matrix cell where that makes sense
+enum {
+    METRIC_IPC,
+    METRIC_L1D,
+    METRIC_LLC,
+    METRIC_BRANCH,
+    METRIC_STALL,
+    METRIC_LLC_BYTES,
+    METRIC_BUSY,
+    METRICS
+};
+
+static const char *const metric_names[METRICS] = {
+    "ipc", "l1d_miss_per_cell", "llc_miss_per_cell", "branch_miss_per_cell", "stall_pct", "llc_bytes_per_cell", "busy_pct"
+};
+
+typedef struct {
+    const char *kernel;
+    size_t N, M;
+    int threads;
+    int reps;
+    int score;
+    double median, p95, p99, min;   // seconds per call
+    double gcups;
+    double baseline;                // baseline median, 0 if there is none
+    int regressed;
+    lsal_perf_counts_t perf;        // summed over the timed calls and all threads
+    lsal_perf_counts_t *thread_perf;    // per thread, for the OpenMP kernel
+    double metric[METRICS];
+    unsigned metric_valid;          // bit i set when metric[i] could be derived
+} bench_row;
+
+typedef struct {
+    size_t N, M;
+} bench_shape;
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of sorted samples
+static double percentile(const double *sorted, int count, double p) {
+    int rank = (int) ceil(p / 100.0 * count);
+    if (rank < 1) rank = 1;
+    if (rank > count) rank = count;
+    return sorted[rank - 1];
+}
+
+// Derives the metrics of counts taken over `cells` cells and `cpu_ns` of thread wall time
+static unsigned derive_metrics(const lsal_perf_counts_t *counts, double cells, double cpu_ns, double *metric) {
+    const uint64_t *v = counts->value;
+    unsigned valid = 0;
+
+    if (lsal_perf_has(counts, LSAL_PERF_CYCLES) && lsal_perf_has(counts, LSAL_PERF_INSTRUCTIONS) && v[LSAL_PERF_CYCLES]) {
+        metric[METRIC_IPC] = (double) v[LSAL_PERF_INSTRUCTIONS] / v[LSAL_PERF_CYCLES];
+        valid |= 1u << METRIC_IPC;
+    }
+    if (lsal_perf_has(counts, LSAL_PERF_L1D_MISSES)) {
+        metric[METRIC_L1D] = v[LSAL_PERF_L1D_MISSES] / cells;
+        valid |= 1u << METRIC_L1D;
+    }
+    if (lsal_perf_has(counts, LSAL_PERF_LLC_MISSES)) {
+        // Every LLC miss moves one 64-byte line from memory
+        metric[METRIC_LLC] = v[LSAL_PERF_LLC_MISSES] / cells;
+        metric[METRIC_LLC_BYTES] = 64.0 * v[LSAL_PERF_LLC_MISSES] / cells;
+        valid |= 1u << METRIC_LLC | 1u << METRIC_LLC_BYTES;
+    }
+    if (lsal_perf_has(counts, LSAL_PERF_BRANCH_MISSES)) {
+        metric[METRIC_BRANCH] = v[LSAL_PERF_BRANCH_MISSES] / cells;
+        valid |= 1u << METRIC_BRANCH;
+    }
+    if (lsal_perf_has(counts, LSAL_PERF_STALLED_CYCLES) && lsal_perf_has(counts, LSAL_PERF_CYCLES) && v[LSAL_PERF_CYCLES]) {
+        metric[METRIC_STALL] = 100.0 * v[LSAL_PERF_STALLED_CYCLES] / v[LSAL_PERF_CYCLES];
+        valid |= 1u << METRIC_STALL;
+    }
+    if (lsal_perf_has(counts, LSAL_PERF_TASK_CLOCK) && cpu_ns > 0) {
+        metric[METRIC_BUSY] = 100.0 * v[LSAL_PERF_TASK_CLOCK] / cpu_ns;
+        valid |= 1u << METRIC_BUSY;
+    }
+    return valid;
+}
+
+static void print_metrics(const char *label, const double *metric, unsigned valid) {
+    static const char *const name[METRICS] = { "IPC", "L1D/cell", "LLC/cell", "br-miss/cell", "stalls", "LLC B/cell", "busy" };
+    static const char *const fmt[METRICS] = { "%.2f", "%.4f", "%.4f", "%.4f", "%.1f%%", "%.3f", "%.1f%%" };
+
+    printf("         %-6s", label);
+    for (int i = 0; i < METRICS; i++) {
+        printf("  %s ", name[i]);
+        if (valid >> i & 1) printf(fmt[i], metric[i]);
+        else printf("n/a");
+    }
+    printf("\n");
+}
+
+static void init_random_buf(char *buf, size_t n) {
+    static const char *choices = "ATGC";
+
+    for (size_t i = 0; i < n; i++) {
+        buf[i] = choices[rand() % 4];
+    }
+}
+
+static const bench_kernel *find_kernel(const char *name) {
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+        if (!strcmp(kernels[k].name, name)) return &kernels[k];
+    }
+    return NULL;
+}
+
+// Splits a comma-separated list in place, returns the number of items
+static int split_list(char *list, char **items, int max_items) {
+    int count = 0;
+    for (char *tok = strtok(list, ","); tok && count < max_items; tok = strtok(NULL, ",")) {
+        items[count++] = tok;
+    }
+    return count;
+}
+
+static int parse_shapes(char *list, bench_shape *shapes) {
+    char *items[MAX_SHAPES];
+    int count = split_list(list, items, MAX_SHAPES);
+
+    for (int i = 0; i < count; i++) {
+        if (sscanf(items[i], "%zux%zu", &shapes[i].N, &shapes[i].M) != 2 || !shapes[i].N || !shapes[i].M) {
+            fprintf(stderr, "Bad shape '%s', expected <N>x<M>\n", items[i]);
+            return -1;
+        }
+    }
+    return count;
+}
+
+static int parse_threads(char *list, int *threads) {
+    char *items[MAX_THREADS];
+    int count = split_list(list, items, MAX_THREADS);
+
+    for (int i = 0; i < count; i++) {
+        threads[i] = atoi(items[i]);
+        if (threads[i] <= 0) {
+            fprintf(stderr, "Bad thread count '%s'\n", items[i]);
+            return -1;
+        }
+    }
+    return count;
+}
+
+/*
+ Reads the median of every configuration in a CSV written by -c into rows[].baseline.
+ Returns the number of baseline lines read, or -1 if the file cannot be opened.
+ */
+static int read_baseline(const char *path, bench_row *rows, int count) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+
+    char line[512], kernel[32];
+    size_t N, M;
+    int threads, lines = 0;
+    double median;
+
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "%31[^,],%zu,%zu,%d,%*d,%*d,%lf", kernel, &N, &M, &threads, &median) != 5) continue;
+        lines++;
+        for (int r = 0; r < count; r++) {
+            if (!strcmp(rows[r].kernel, kernel) && rows[r].N == N && rows[r].M == M && rows[r].threads == threads) {
+                rows[r].baseline = median;
+            }
+        }
+    }
+
+    fclose(f);
+    return lines;
+}
+
+static int write_csv(const char *path, const bench_row *rows, int count) {
+    FILE *f = strcmp(path, "-") ? fopen(path, "w") : stdout;
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+
+    fprintf(f, "kernel,N,M,threads,reps,score,median_s,p95_s,p99_s,min_s,gcups");
+    for (int i = 0; i < METRICS; i++) fprintf(f, ",%s", metric_names[i]);
+    fprintf(f, "\n");
+
+    for (int r = 0; r < count; r++) {
+        const bench_row *row = &rows[r];
+        fprintf(f, "%s,%zu,%zu,%d,%d,%d,%.9f,%.9f,%.9f,%.9f,%.4f", row->kernel, row->N, row->M, row->threads,
+                row->reps, row->score, row->median, row->p95, row->p99, row->min, row->gcups);
+        // Metrics that were not measured are left empty
+        for (int i = 0; i < METRICS; i++) {
+            if (row->metric_valid >> i & 1) fprintf(f, ",%.6f", row->metric[i]);
+            else fprintf(f, ",");
+        }
+        fprintf(f, "\n");
+    }
+
+    if (f != stdout) fclose(f);
+    return 0;
+}
+
+static int write_json(const char *path, const bench_row *rows, int count, int warmup) {
+    FILE *f = strcmp(path, "-") ? fopen(path, "w") : stdout;
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+
+    fprintf(f, "{\n  \"warmup\": %d,\n  \"results\": [", warmup);
+    for (int r = 0; r < count; r++) {
+        const bench_row *row = &rows[r];
+        fprintf(f, "%s\n    {\"kernel\": \"%s\", \"N\": %zu, \"M\": %zu, \"threads\": %d, \"reps\": %d, \"score\": %d, "
+                "\"median_s\": %.9f, \"p95_s\": %.9f, \"p99_s\": %.9f, \"min_s\": %.9f, \"gcups\": %.4f",
+                r ? "," : "", row->kernel, row->N, row->M, row->threads, row->reps, row->score,
+                row->median, row->p95, row->p99, row->min, row->gcups);
+        if (row->baseline > 0) {
+            fprintf(f, ", \"baseline_median_s\": %.9f, \"regressed\": %s", row->baseline, row->regressed ? "true" : "false");
+        }
+        if (row->perf.valid) {
+            fprintf(f, ",\n     \"counters_per_call\": {");
+            for (int e = 0, first = 1; e < LSAL_PERF_EVENTS; e++) {
+                if (!lsal_perf_has(&row->perf, e)) continue;
+                fprintf(f, "%s\"%s\": %.0f", first ? "" : ", ", lsal_perf_names[e], (double) row->perf.value[e] / row->reps);
+                first = 0;
+            }
+            fprintf(f, "}");
+            for (int i = 0; i < METRICS; i++) {
+                if (row->metric_valid >> i & 1) fprintf(f, ", \"%s\": %.6f", metric_names[i], row->metric[i]);
+            }
+        }
+        if (row->thread_perf) {
+            fprintf(f, ",\n     \"threads_counters_per_call\": [");
+            for (int t = 0; t < row->threads; t++) {
+                fprintf(f, "%s{", t ? ", " : "");
+                for (int e = 0, first = 1; e < LSAL_PERF_EVENTS; e++) {
+                    if (!lsal_perf_has(&row->thread_perf[t], e)) continue;
+                    fprintf(f, "%s\"%s\": %.0f", first ? "" : ", ", lsal_perf_names[e],
+                            (double) row->thread_perf[t].value[e] / row->reps);
+                    first = 0;
+                }
+                fprintf(f, "}");
+            }
+            fprintf(f, "]");
+        }
+        fprintf(f, "}");
+    }
+    fprintf(f, "\n  ]\n}\n");
+
+    if (f != stdout) fclose(f);
+    return 0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-k kernels] [-s shapes] [-t threads] [-w warmup] [-r reps] [-p]\n"
+                    "          [-c out.csv] [-j out.json] [-b baseline.csv] [-x tolerance_%%]\n"
+                    "  -k  comma-separated kernels: u,o,omp,simd (default: all)\n"
+                    "  -s  comma-separated <N>x<M> shapes (default: 128x65536,512x16384,2048x4096)\n"
+                    "  -t  comma-separated thread counts for omp (default: 1 and all cores)\n"
+                    "  -w  untimed calls per configuration (default: 2)\n"
+                    "  -r  timed calls per configuration (default: 10)\n"
+                    "  -p  read the hardware counters during the timed calls\n"
+                    "  -x  slowdown of the median over the baseline that counts as a regression (default: 5)\n",
+            prog);
+}
+
+int main(int argc, char **argv) {
+    char default_kernels[] = "u,o,omp,simd";
+    char default_shapes[] = "128x65536,512x16384,2048x4096";
+    char *kernel_list = default_kernels, *shape_list = default_shapes, *thread_list = NULL;
+    const char *csv_path = NULL, *json_path = NULL, *baseline_path = NULL;
+    int warmup = 2, reps = 10;
+    double tolerance = 5.0;
+    int counters = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "k:s:t:w:r:pc:j:b:x:h")) != -1) {
+        switch (opt) {
+        case 'k': kernel_list = optarg; break;
+        case 's': shape_list = optarg; break;
+        case 't': thread_list = optarg; break;
+        case 'w': warmup = atoi(optarg); break;
+        case 'r': reps = atoi(optarg); break;
+        case 'p': counters = 1; break;
+        case 'c': csv_path = optarg; break;
+        case 'j': json_path = optarg; break;
+        case 'b': baseline_path = optarg; break;
+        case 'x': tolerance = atof(optarg); break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (optind != argc || warmup < 0 || reps <= 0 || tolerance < 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    char *names[MAX_KERNELS];
+    const bench_kernel *selected[MAX_KERNELS];
+    int num_kernels = split_list(kernel_list, names, MAX_KERNELS);
+    for (int k = 0; k < num_kernels; k++) {
+        selected[k] = find_kernel(names[k]);
+        if (!selected[k]) {
+            fprintf(stderr, "Unknown kernel '%s'\n", names[k]);
+            return 1;
+        }
+        if (selected[k]->run == kernel_simd && !__builtin_cpu_supports("avx2")) {
+            fprintf(stderr, "This CPU has no AVX2, leave out the simd kernel\n");
+            return 1;
+        }
+    }
+
+    bench_shape shapes[MAX_SHAPES];
+    int num_shapes = parse_shapes(shape_list, shapes);
+    if (num_shapes <= 0) return 1;
+
+    int threads[MAX_THREADS];
+    int num_threads;
+    if (thread_list) {
+        num_threads = parse_threads(thread_list, threads);
+        if (num_threads <= 0) return 1;
+    } else {
+        threads[0] = 1;
+        threads[1] = omp_get_num_procs();
+        num_threads = threads[1] > 1 ? 2 : 1;
+    }
+
+    size_t max_cells = 0, max_M = 0, max_N = 0;
+    for (int s = 0; s < num_shapes; s++) {
+        size_t cells;
+        if (!lsal_size_mul(shapes[s].N, shapes[s].M, &cells)) {
+            fprintf(stderr, "Matrix of %zu x %zu cells is too large\n", shapes[s].N, shapes[s].M);
+            return 1;
+        }
+        if (cells > max_cells) max_cells = cells;
+        if (shapes[s].N > max_N) max_N = shapes[s].N;
+        if (shapes[s].M > max_M) max_M = shapes[s].M;
+    }
+
+    // One arena sized for the largest shape serves every configuration
+    lsal_arena_t arena = {0};
+    if (lsal_arena_reserve(&arena, lsal_arena_bytes(max_cells, sizeof(int)) + lsal_arena_bytes(max_cells, sizeof(char)))) {
+        fprintf(stderr, "Failed to map %zu cells\n", max_cells);
+        return 1;
+    }
+    int *similarity = lsal_arena_alloc(&arena, max_cells, sizeof(int));
+    char *direction = lsal_arena_alloc(&arena, max_cells, sizeof(char));
+    char *q = malloc(max_N + 1);
+    char *d = malloc(max_M + 1);
+    double *samples = malloc(sizeof(double) * reps);
+    bench_row *rows = calloc(MAX_ROWS, sizeof(bench_row));
+    if (!similarity || !direction || !q || !d || !samples || !rows) {
+        fprintf(stderr, "Failed to allocate %zu cells\n", max_cells);
+        return 1;
+    }
+
+    // The calling thread's counters, for the single-threaded kernels
+    lsal_perf_t perf = {0};
+    if (counters) {
+        int available = lsal_perf_open(&perf);
+        printf("Counters: %d of %d events available\n", available, LSAL_PERF_EVENTS);
+    }
+
+    int count = 0, mismatches = 0;
+
+    printf("%-6s %8s %10s %7s %9s %12s %12s %12s %9s\n", "kernel", "N", "M", "threads", "score",
+           "median_ms", "p95_ms", "p99_ms", "GCUPS");
+
+    for (int s = 0; s < num_shapes; s++) {
+        size_t N = shapes[s].N, M = shapes[s].M;
+
+        // Same inputs for every kernel of a shape, and across runs of the benchmark
+        srand(1);
+        init_random_buf(q, N);
+        init_random_buf(d, M);
+        q[N] = d[M] = '\0';
+
+        int reference = -1;
+        const char *reference_kernel = NULL;
+
+        for (int k = 0; k < num_kernels; k++) {
+            const bench_kernel *kernel = selected[k];
+            int runs = kernel->threaded ? num_threads : 1;
+
+            for (int t = 0; t < runs; t++) {
+                int nthreads = kernel->threaded ? threads[t] : 1;
+                bench_row *row = &rows[count++];
+                size_t max_idx = 0;
+
+                if (kernel->threaded) {
+                    omp_set_num_threads(nthreads);
+                    lsal_place_matrices_omp(similarity, direction, N, M);
+                }
+
+                for (int i = 0; i < warmup; i++) {
+                    kernel->run(q, d, &max_idx, similarity, direction, N, M);
+                }
+                // Counters only cover the timed calls
+                if (counters && kernel->threaded) {
+                    row->thread_perf = calloc(nthreads, sizeof(lsal_perf_counts_t));
+                    lsal_omp_perf = row->thread_perf;
+                }
+
+                double wall = 0;
+                for (int i = 0; i < reps; i++) {
+                    if (counters && !kernel->threaded) lsal_perf_begin(&perf);
+                    double start = lsal_wall_seconds();
+                    kernel->run(q, d, &max_idx, similarity, direction, N, M);
+                    samples[i] = lsal_wall_seconds() - start;
+                    if (counters && !kernel->threaded) lsal_perf_end(&perf, &row->perf);
+                    wall += samples[i];
+                }
+                lsal_omp_perf = NULL;
+                qsort(samples, reps, sizeof(double), cmp_double);
+
+                row->kernel = kernel->name;
+                row->N = N;
+                row->M = M;
+                row->threads = nthreads;
+                row->reps = reps;
+                row->score = similarity[max_idx];
+                row->median = percentile(samples, reps, 50);
+                row->p95 = percentile(samples, reps, 95);
+                row->p99 = percentile(samples, reps, 99);
+                row->min = samples[0];
+                row->gcups = (double) N * M / row->median / 1e9;
+
+                printf("%-6s %8zu %10zu %7d %9d %12.3f %12.3f %12.3f %9.3f\n", row->kernel, N, M, nthreads, row->score,
+                       row->median * 1e3, row->p95 * 1e3, row->p99 * 1e3, row->gcups);
+
+                if (counters) {
+                    double cells = (double) N * M * reps;
+                    for (int i = 0; row->thread_perf && i < nthreads; i++) lsal_perf_add(&row->perf, &row->thread_perf[i]);
+                    row->metric_valid = derive_metrics(&row->perf, cells, wall * 1e9 * nthreads, row->metric);
+                    print_metrics("all", row->metric, row->metric_valid);
+
+                    for (int i = 0; row->thread_perf && nthreads > 1 && i < nthreads; i++) {
+                        double metric[METRICS];
+                        char label[16];
+                        snprintf(label, sizeof(label), "t%d", i);
+                        print_metrics(label, metric, derive_metrics(&row->thread_perf[i], cells, wall * 1e9, metric));
+                    }
+                }
+
+                if (reference < 0) {
+                    reference = row->score;
+                    reference_kernel = row->kernel;
+                } else if (row->score != reference) {
+                    printf("  MISMATCH: %s scored %d, %s scored %d\n", row->kernel, row->score, reference_kernel, reference);
+                    mismatches++;
+                }
+            }
+        }
+    }
+
+    int regressions = 0;
+    if (baseline_path) {
+        if (read_baseline(baseline_path, rows, count) < 0) return 1;
+
+        printf("\nBaseline %s, tolerance %.1f%%:\n", baseline_path, tolerance);
+        for (int r = 0; r < count; r++) {
+            bench_row *row = &rows[r];
+            if (row->baseline <= 0) {
+                printf("  %-6s %zux%zu t%d: not in the baseline\n", row->kernel, row->N, row->M, row->threads);
+                continue;
+            }
+
+            double change = (row->median / row->baseline - 1.0) * 100.0;
+            row->regressed = change > tolerance;
+            regressions += row->regressed;
+            printf("  %-6s %zux%zu t%d: %+.1f%% median time%s\n", row->kernel, row->N, row->M, row->threads, change,
+                   row->regressed ? "  REGRESSION" : "");
+        }
+    }
+
+    if (csv_path && write_csv(csv_path, rows, count)) return 1;
+    if (json_path && write_json(json_path, rows, count, warmup)) return 1;
+
+    if (mismatches) printf("%d configuration(s) disagree on the best score\n", mismatches);
+    if (regressions) printf("%d configuration(s) regressed by more than %.1f%%\n", regressions, tolerance);
+
+    lsal_perf_close(&perf);
+    for (int r = 0; r < count; r++) free(rows[r].thread_perf);
+    lsal_arena_release(&arena);
+    free(q);
+    free(d);
+    free(samples);
+    free(rows);
+
+    return mismatches || regressions ? 1 : 0;
+}
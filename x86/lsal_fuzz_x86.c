@@ -0,0 +1,502 @@
+#define _GNU_SOURCE
+
+#include <omp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "lsal_x86.h"
+#include "lsal_alloc.h"
+
+#ifndef TILE_SIZE
+#define TILE_SIZE 4096      // must match lsal_omp_x86.c
+#endif
+
+#define STRIPE_WIDTH 32     // widest SIMD stripe, see lsal_simd_x86.c
+
+// Most cells in one case, and the default longest side; both stay large enough for int8 saturation
+#define CASE_CELLS (4 * TILE_SIZE * STRIPE_WIDTH > 256 * 256 ? 4 * TILE_SIZE * STRIPE_WIDTH : 256 * 256)
+#define CASE_LENGTH (2 * TILE_SIZE + 1 > 257 ? 2 * TILE_SIZE + 1 : 257)
+
+#define MAX_KERNELS 16
+#define MAX_WHAT 512
+
+static const int match = 2;
+static const int mismatch = -1;
+static const int gap = -1;
+
+/*
+ Differential fuzzer for the x86 kernels and the portable ARM wavefront kernel
+ (arm/lsal_par_arm.c). Every case runs lsal_compute_matrices_o as the reference and each
+ fast kernel on the same query and database, and a kernel passes when
+   - its similarity matrix equals the reference cell for cell,
+   - its directions equal the reference wherever the similarity is positive (a zero cell
+     ends every traceback, so what a kernel stores there does not matter),
+   - max_idx is the reference cell: the first best cell in row-major order,
+   - the alignment traced back from its max_idx re-scores to the best score and equals
+     the reference alignment.
+ The reference alignment is re-scored as well, so a bug shared by all kernels still shows.
+
+ Cases come from generators aimed at the weak spots of the kernels: homopolymers and
+ all-mismatch inputs, repeated motifs with many tied maxima, two-letter alphabets, and
+ lengths around the SIMD stripe width, the int8 saturation point and the OpenMP tile size.
+ A failing case is shrunk by deleting and flattening characters for as long as the same
+ kernel still fails, and printed with the -q/-d options that replay it.
+
+ Cases are kept small, at most CASE_CELLS cells, so at the default TILE_SIZE of 4096 every
+ case fits in one row or column of omp tiles and no round of the wavefront has two tiles. Build the fuzzer and
+ lsal_omp_x86.c with a small -DTILE_SIZE (16) to check the wavefront itself.
+
+ The HLS C++ model is not linked in: it needs g++ and the ap_int stand-ins, keeps 16-bit
+ scores, returns no similarity matrix, and stores directions skewed and packed with a
+ different tie order (a gap beats an equal diagonal). The host built on hls/sim checks it
+ cell by cell against the CPU instead.
+ */
+
+// arm/lsal_par_arm.c built with -DLSAL_NO_MAIN
+void lsal_compute_matrices_p(char *q, char *d, size_t *max_idx, int *similarity, char *direction, size_t N, size_t M);
+
+typedef void (*kernel_fn)(const char *q, const char *d, size_t *max_idx, int *similarity, char *direction, size_t N, size_t M);
+
+static void kernel_u(const char *q, const char *d, size_t *max_idx, int *similarity, char *direction, size_t N, size_t M) {
+    lsal_compute_matrices_u((char *) q, (char *) d, max_idx, similarity, direction, N, M);
+}
+
+static void kernel_o(const char *q, const char *d, size_t *max_idx, int *similarity, char *direction, size_t N, size_t M) {
+    lsal_compute_matrices_o((char *) q, (char *) d, max_idx, similarity, direction, N, M);
+}
+
+static void kernel_p(const char *q, const char *d, size_t *max_idx, int *similarity, char *direction, size_t N, size_t M) {
+    lsal_compute_matrices_p((char *) q, (char *) d, max_idx, similarity, direction, N, M);
+}
+
+// The SIMD kernel only fails when its scratch row cannot be mapped, which ends the run
+static void kernel_simd(const char *q, const char *d, size_t *max_idx, int *similarity, char *direction, size_t N, size_t M) {
+    if (lsal_compute_matrices_simd(q, d, max_idx, similarity, direction, N, M)) {
+        fprintf(stderr, "Failed to map the simd scratch row\n");
+        exit(1);
+    }
+}
+
+typedef struct {
+    char name[16];
+    kernel_fn run;
+    int threads;        // OpenMP threads, 0 for the single-threaded kernels
+} fuzz_kernel;
+
+typedef struct {
+    int *similarity;
+    char *direction;
+    size_t max_idx;
+    char *aligned_q, *aligned_d;
+} fuzz_result;
+
+static fuzz_kernel kernels[MAX_KERNELS];
+static int num_kernels;
+
+static lsal_arena_t arena;
+static fuzz_result ref, out;
+
+static int rand_lim(int limit) { return rand() % limit; }
+
+/*
+ Walks the directions back from idx and writes the alignment into aligned_q / aligned_d.
+ Returns the score of the alignment recomputed from its columns, or -1 if the walk leaves
+ the matrix or meets a cell without a direction before reaching a zero cell.
+ */
+static int traceback(const char *q, const char *d, const int *similarity, const char *direction, size_t N, size_t idx,
+                     char *aligned_q, char *aligned_d) {
+    long row = idx / N, col = idx % N;
+    size_t len = 0;
+    int score = 0;
+
+    while (row >= 0 && col >= 0 && similarity[row * N + col] > 0) {
+        char dir = direction[row * N + col];
+        if (dir == 'D') {
+            aligned_q[len] = q[col];
+            aligned_d[len] = d[row];
+            score += q[col] == d[row] ? match : mismatch;
+            row--;
+            col--;
+        } else if (dir == 'U') {
+            aligned_q[len] = '-';
+            aligned_d[len] = d[row];
+            score += gap;
+            row--;
+        } else if (dir == 'L') {
+            aligned_q[len] = q[col];
+            aligned_d[len] = '-';
+            score += gap;
+            col--;
+        } else {
+            return -1;
+        }
+        len++;
+    }
+
+    aligned_q[len] = aligned_d[len] = '\0';
+    return score;
+}
+
+// Makes room for the reference and one kernel's output; returns 0 on success
+static int reserve(size_t N, size_t M) {
+    size_t cells;
+    if (!lsal_size_mul(N, M, &cells)) return -1;
+
+    size_t bytes = 2 * (lsal_arena_bytes(cells, sizeof(int)) + lsal_arena_bytes(cells, sizeof(char)) +
+                        2 * lsal_arena_bytes(N + M + 1, sizeof(char)));
+    if (lsal_arena_reserve(&arena, bytes)) return -1;
+
+    fuzz_result *results[2] = { &ref, &out };
+    for (int i = 0; i < 2; i++) {
+        results[i]->similarity = lsal_arena_alloc(&arena, cells, sizeof(int));
+        results[i]->direction = lsal_arena_alloc(&arena, cells, sizeof(char));
+        results[i]->aligned_q = lsal_arena_alloc(&arena, N + M + 1, sizeof(char));
+        results[i]->aligned_d = lsal_arena_alloc(&arena, N + M + 1, sizeof(char));
+    }
+    return 0;
+}
+
+static void run_kernel(const fuzz_kernel *kernel, const char *q, const char *d, size_t N, size_t M, fuzz_result *result) {
+    if (kernel->threads) omp_set_num_threads(kernel->threads);
+    kernel->run(q, d, &result->max_idx, result->similarity, result->direction, N, M);
+}
+
+// Compares one kernel against the reference already in ref; returns 0 if it passes
+static int check_kernel(const fuzz_kernel *kernel, const char *q, const char *d, size_t N, size_t M, char *what) {
+    size_t cells = N * M;
+
+    run_kernel(kernel, q, d, N, M, &out);
+
+    for (size_t idx = 0; idx < cells; idx++) {
+        if (out.similarity[idx] != ref.similarity[idx]) {
+            snprintf(what, MAX_WHAT, "similarity at (%zu, %zu) is %d, reference %d",
+                     idx / N, idx % N, out.similarity[idx], ref.similarity[idx]);
+            return -1;
+        }
+        if (ref.similarity[idx] > 0 && out.direction[idx] != ref.direction[idx]) {
+            snprintf(what, MAX_WHAT, "direction at (%zu, %zu) is '%c', reference '%c'",
+                     idx / N, idx % N, out.direction[idx], ref.direction[idx]);
+            return -1;
+        }
+    }
+
+    int best = ref.similarity[ref.max_idx];
+    if (out.max_idx >= cells || out.similarity[out.max_idx] != best) {
+        snprintf(what, MAX_WHAT, "max_idx %zu does not hold the best score %d", out.max_idx, best);
+        return -1;
+    }
+    if (out.max_idx != ref.max_idx) {
+        snprintf(what, MAX_WHAT, "max_idx (%zu, %zu) is a tied cell, the first best cell is (%zu, %zu)",
+                 out.max_idx / N, out.max_idx % N, ref.max_idx / N, ref.max_idx % N);
+        return -1;
+    }
+
+    int score = traceback(q, d, out.similarity, out.direction, N, out.max_idx, out.aligned_q, out.aligned_d);
+    if (score != best) {
+        snprintf(what, MAX_WHAT, "alignment re-scores to %d, best score %d", score, best);
+        return -1;
+    }
+    if (strcmp(out.aligned_q, ref.aligned_q) || strcmp(out.aligned_d, ref.aligned_d)) {
+        snprintf(what, MAX_WHAT, "alignment differs from the reference");
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ Runs the reference and then the kernels on one case. With only >= 0 just that kernel is
+ checked. Returns the index of the first failing kernel (num_kernels for the reference
+ itself), or -1 if everything passes.
+ */
+static int check_case(const char *q, size_t N, const char *d, size_t M, int only, char *what) {
+    if (reserve(N, M)) {
+        snprintf(what, MAX_WHAT, "cannot map a %zu x %zu matrix", N, M);
+        return num_kernels;
+    }
+
+    kernel_o(q, d, &ref.max_idx, ref.similarity, ref.direction, N, M);
+
+    int best = ref.similarity[ref.max_idx];
+    for (size_t idx = 0; idx < ref.max_idx; idx++) {
+        if (ref.similarity[idx] >= best) {
+            snprintf(what, MAX_WHAT, "reference max_idx (%zu, %zu) is not the first best cell", ref.max_idx / N, ref.max_idx % N);
+            return num_kernels;
+        }
+    }
+    int score = traceback(q, d, ref.similarity, ref.direction, N, ref.max_idx, ref.aligned_q, ref.aligned_d);
+    if (score != best) {
+        snprintf(what, MAX_WHAT, "reference alignment re-scores to %d, best score %d", score, best);
+        return num_kernels;
+    }
+
+    for (int k = 0; k < num_kernels; k++) {
+        if (only >= 0 && k != only) continue;
+        if (check_kernel(&kernels[k], q, d, N, M, what)) return k;
+    }
+    return -1;
+}
+
+/*
+ Shrinks a failing case: deletes chunks of the query or the database, halving the chunk size
+ down to single characters, then turns characters into 'A', keeping every change after which
+ the same kernel still fails. q and d are updated in place.
+ */
+static void shrink(char *q, size_t *N, char *d, size_t *M, int failing, char *what) {
+    char scratch[MAX_WHAT];
+    int progress = 1;
+
+    while (progress) {
+        progress = 0;
+
+        for (int which = 0; which < 2; which++) {
+            char *s = which ? d : q;
+            size_t *len = which ? M : N;
+
+            for (size_t chunk = *len / 2; chunk >= 1; chunk /= 2) {
+                for (size_t start = 0; start + chunk <= *len && *len > chunk;) {
+                    char saved[chunk];
+                    memcpy(saved, s + start, chunk);
+                    memmove(s + start, s + start + chunk, *len - start - chunk);
+                    *len -= chunk;
+
+                    if (check_case(q, *N, d, *M, failing, scratch) == failing) {
+                        strcpy(what, scratch);
+                        progress = 1;
+                    } else {
+                        memmove(s + start + chunk, s + start, *len - start);
+                        memcpy(s + start, saved, chunk);
+                        *len += chunk;
+                        start += chunk;
+                    }
+                }
+            }
+
+            for (size_t i = 0; i < *len; i++) {
+                if (s[i] == 'A') continue;
+                char saved = s[i];
+                s[i] = 'A';
+                if (check_case(q, *N, d, *M, failing, scratch) == failing) {
+                    strcpy(what, scratch);
+                    progress = 1;
+                } else {
+                    s[i] = saved;
+                }
+            }
+        }
+    }
+}
+
+/*
+ Case generators. Each fills buf with len characters; lengths are drawn separately from
+ pick_length so that the boundary lengths turn up with every kind of content.
+ */
+static void gen_random(char *buf, size_t len) {
+    for (size_t i = 0; i < len; i++) buf[i] = "ACGT"[rand_lim(4)];
+}
+
+static void gen_homopolymer(char *buf, size_t len) {
+    memset(buf, "ACGT"[rand_lim(4)], len);
+}
+
+static void gen_two_letters(char *buf, size_t len) {
+    for (size_t i = 0; i < len; i++) buf[i] = "AC"[rand_lim(2)];
+}
+
+// A short motif over and over: the best score is reached at many cells
+static void gen_repeats(char *buf, size_t len) {
+    char motif[8];
+    size_t period = 1 + rand_lim(sizeof(motif));
+    gen_random(motif, period);
+    for (size_t i = 0; i < len; i++) buf[i] = motif[i % period];
+}
+
+// Runs of one letter with the odd mutation
+static void gen_runs(char *buf, size_t len) {
+    for (size_t i = 0; i < len;) {
+        char c = "ACGT"[rand_lim(4)];
+        size_t run = 1 + rand_lim(40);
+        for (size_t j = 0; j < run && i < len; j++, i++) buf[i] = rand_lim(20) ? c : "ACGT"[rand_lim(4)];
+    }
+}
+
+typedef struct {
+    const char *name;
+    void (*query)(char *buf, size_t len);
+    void (*database)(char *buf, size_t len);
+} fuzz_generator;
+
+static void gen_mismatch_query(char *buf, size_t len) { memset(buf, 'A', len); }
+static void gen_mismatch_database(char *buf, size_t len) { memset(buf, 'C', len); }
+
+static const fuzz_generator generators[] = {
+    { "random", gen_random, gen_random },
+    { "homopolymer", gen_homopolymer, gen_homopolymer },
+    { "all-mismatch", gen_mismatch_query, gen_mismatch_database },
+    { "two-letter", gen_two_letters, gen_two_letters },
+    { "repeats", gen_repeats, gen_repeats },
+    { "runs", gen_runs, gen_runs },
+    { "motif-in-random", gen_repeats, gen_random },
+};
+
+#define NUM_GENERATORS ((int) (sizeof(generators) / sizeof(generators[0])))
+
+// A length around one of the kernels' boundaries most of the time, otherwise a small random one
+static size_t pick_length(size_t max_len) {
+    static const size_t bases[] = { 1, 2, STRIPE_WIDTH / 4, STRIPE_WIDTH / 2, STRIPE_WIDTH, 2 * STRIPE_WIDTH,
+                                    64, 128, 256, TILE_SIZE, 2 * TILE_SIZE };
+    size_t len;
+
+    if (rand_lim(3)) {
+        size_t base = bases[rand_lim(sizeof(bases) / sizeof(bases[0]))];
+        len = base + rand_lim(3) - 1;
+    } else {
+        len = 1 + rand_lim(200);
+    }
+    if (len < 1) len = 1;
+    return len < max_len ? len : max_len;
+}
+
+static void print_case(const char *prog, const char *q, size_t N, const char *d, size_t M) {
+    printf("  query (%zu):    %.*s\n", N, (int) N, q);
+    printf("  database (%zu): %.*s\n", M, (int) M, d);
+    if (N + M <= 4096) printf("  replay: %s -q %.*s -d %.*s\n", prog, (int) N, q, (int) M, d);
+}
+
+// Adds a kernel per entry of a comma-separated thread list for the OpenMP kernel
+static int add_kernels(char *thread_list) {
+    num_kernels = 0;
+
+    strcpy(kernels[num_kernels].name, "u");
+    kernels[num_kernels++].run = kernel_u;
+
+    strcpy(kernels[num_kernels].name, "p");
+    kernels[num_kernels++].run = kernel_p;
+
+    if (__builtin_cpu_supports("avx2")) {
+        strcpy(kernels[num_kernels].name, "simd");
+        kernels[num_kernels++].run = kernel_simd;
+    } else {
+        printf("No AVX2 on this CPU, skipping the simd kernel\n");
+    }
+
+    for (char *tok = strtok(thread_list, ","); tok && num_kernels < MAX_KERNELS; tok = strtok(NULL, ",")) {
+        int threads = atoi(tok);
+        if (threads <= 0) {
+            fprintf(stderr, "Bad thread count '%s'\n", tok);
+            return -1;
+        }
+        snprintf(kernels[num_kernels].name, sizeof(kernels[num_kernels].name), "omp/%d", threads);
+        kernels[num_kernels].run = lsal_compute_matrices_omp;
+        kernels[num_kernels++].threads = threads;
+    }
+    return 0;
+}
+
+static int report_failure(const char *prog, char *q, size_t N, char *d, size_t M, int failing, char *what) {
+    const char *name = failing < num_kernels ? kernels[failing].name : "o (reference)";
+
+    printf("FAIL %s: %s\n", name, what);
+    print_case(prog, q, N, d, M);
+
+    if (failing < num_kernels) {
+        shrink(q, &N, d, &M, failing, what);
+        printf("Shrunk to a %zu x %zu case, %s: %s\n", N, M, name, what);
+        print_case(prog, q, N, d, M);
+    }
+    return 1;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-n cases] [-s seed] [-m max_length] [-t omp_threads]\n"
+                    "       %s -q <query> -d <database> [-t omp_threads]\n"
+                    "  -n  number of random cases (default: 1000)\n"
+                    "  -s  random seed (default: 1)\n"
+                    "  -m  longest query or database generated (default: %d)\n"
+                    "  -t  comma-separated OpenMP thread counts to check (default: 1,2,3)\n"
+                    "  -q, -d  check a single case, e.g. one printed by a failing run\n",
+            prog, prog, CASE_LENGTH);
+}
+
+int main(int argc, char **argv) {
+    long cases = 1000;
+    unsigned seed = 1;
+    size_t max_len = CASE_LENGTH;
+    char default_threads[] = "1,2,3";
+    char *thread_list = default_threads;
+    const char *replay_q = NULL, *replay_d = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:s:m:t:q:d:h")) != -1) {
+        switch (opt) {
+        case 'n': cases = atol(optarg); break;
+        case 's': seed = strtoul(optarg, NULL, 10); break;
+        case 'm': max_len = strtoull(optarg, NULL, 10); break;
+        case 't': thread_list = optarg; break;
+        case 'q': replay_q = optarg; break;
+        case 'd': replay_d = optarg; break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (optind != argc || cases < 0 || max_len < 1 || !replay_q != !replay_d) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (add_kernels(thread_list)) return 1;
+
+    char what[MAX_WHAT];
+
+    if (replay_q) {
+        size_t N = strlen(replay_q), M = strlen(replay_d);
+        char *q = strdup(replay_q), *d = strdup(replay_d);
+        if (!N || !M) {
+            fprintf(stderr, "The query and the database must not be empty\n");
+            return 1;
+        }
+
+        int failing = check_case(q, N, d, M, -1, what);
+        if (failing >= 0) return report_failure(argv[0], q, N, d, M, failing, what);
+
+        printf("PASS: %d kernels agree with the reference, best score %d\n", num_kernels, ref.similarity[ref.max_idx]);
+        return 0;
+    }
+
+    char *q = malloc(max_len);
+    char *d = malloc(max_len);
+    long per_generator[NUM_GENERATORS] = { 0 };
+
+    srand(seed);
+    for (long c = 0; c < cases; c++) {
+        int g = c % NUM_GENERATORS;
+
+        // Keep the matrices small enough to check thousands of cases: one long side at a time
+        size_t N = pick_length(max_len);
+        size_t M = pick_length(max_len);
+        if (N * M > (size_t) CASE_CELLS) {
+            if (rand_lim(2)) N = 1 + rand_lim(STRIPE_WIDTH * 2);
+            else M = 1 + rand_lim(STRIPE_WIDTH * 2);
+        }
+
+        generators[g].query(q, N);
+        generators[g].database(d, M);
+        per_generator[g]++;
+
+        int failing = check_case(q, N, d, M, -1, what);
+        if (failing >= 0) {
+            printf("Case %ld (%s, seed %u)\n", c, generators[g].name, seed);
+            return report_failure(argv[0], q, N, d, M, failing, what);
+        }
+    }
+
+    printf("PASS: %ld cases, %d kernels against the reference (", cases, num_kernels);
+    for (int g = 0; g < NUM_GENERATORS; g++) printf("%s%s %ld", g ? ", " : "", generators[g].name, per_generator[g]);
+    printf(")\n");
+
+    lsal_arena_release(&arena);
+    free(q);
+    free(d);
+    return 0;
+}
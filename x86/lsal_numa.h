@@ -0,0 +1,282 @@
+#ifndef LSAL_NUMA_H
+#define LSAL_NUMA_H
+
+#ifndef _GNU_SOURCE
+#error "lsal_numa.h needs _GNU_SOURCE defined before the first include"
+#endif
+
+#include <omp.h>
+#include <sched.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+/*
+ NUMA topology, thread pinning and page placement for the threaded kernels.
+ The topology is read from sysfs (no libnuma needed) once per process, by whichever thread
+ asks first, and restricted to the CPUs in the process affinity mask. A pinned thread keeps
+ its CPU until lsal_unpin_thread gives it back the mask it had before. The pinning policy is
+ taken from LSAL_PIN:
+   none     leave placement to the OpenMP runtime (default)
+   compact  fill the hardware threads of one node before moving to the next
+   scatter  deal threads round-robin over the nodes
+   smt      one thread per physical core on every node first, SMT siblings last
+ */
+
+#define LSAL_MAX_CPUS 1024
+#define LSAL_MAX_NODES 64
+
+#define LSAL_PIN_NONE 0
+#define LSAL_PIN_COMPACT 1
+#define LSAL_PIN_SCATTER 2
+#define LSAL_PIN_SMT 3
+
+typedef struct {
+    int num_cpus;
+    int num_nodes;
+    int cpu[LSAL_MAX_CPUS];     // OS ids of the usable CPUs
+    int node[LSAL_MAX_CPUS];
+    int core[LSAL_MAX_CPUS];
+    int socket[LSAL_MAX_CPUS];
+    int smt[LSAL_MAX_CPUS];     // rank among the hardware threads of the same core
+    int policy;
+    int order[LSAL_MAX_CPUS];   // slot of the CPU that thread t is pinned to is order[t % num_cpus]
+} lsal_topology_t;
+
+static inline int lsal_read_int(const char *path, int fallback) {
+    FILE *f = fopen(path, "r");
+    if (!f) return fallback;
+    int v;
+    if (fscanf(f, "%d", &v) != 1) v = fallback;
+    fclose(f);
+    return v;
+}
+
+// Parses a sysfs cpulist ("0-3,8,10-11") and tags every listed CPU in node_of with node
+static inline int lsal_read_cpulist(const char *path, int *node_of, int node) {
+    FILE *f = fopen(path, "r");
+    if (!f) return 0;
+
+    int lo, hi;
+    char sep;
+    while (fscanf(f, "%d", &lo) == 1) {
+        hi = lo;
+        if (fscanf(f, "%c", &sep) == 1 && sep == '-') {
+            if (fscanf(f, "%d", &hi) != 1) break;
+            if (fscanf(f, "%c", &sep) != 1) sep = '\n';
+        }
+        for (int c = lo; c <= hi && c < LSAL_MAX_CPUS; c++) node_of[c] = node;
+        if (sep != ',') break;
+    }
+
+    fclose(f);
+    return 1;
+}
+
+static inline int lsal_pin_policy(void) {
+    const char *env = getenv("LSAL_PIN");
+    if (!env || !strcmp(env, "none")) return LSAL_PIN_NONE;
+    if (!strcmp(env, "compact")) return LSAL_PIN_COMPACT;
+    if (!strcmp(env, "scatter")) return LSAL_PIN_SCATTER;
+    if (!strcmp(env, "smt")) return LSAL_PIN_SMT;
+
+    fprintf(stderr, "Unknown LSAL_PIN=%s, expected none|compact|scatter|smt\n", env);
+    return LSAL_PIN_NONE;
+}
+
+static inline const char *lsal_pin_name(int policy) {
+    switch (policy) {
+    case LSAL_PIN_COMPACT: return "compact";
+    case LSAL_PIN_SCATTER: return "scatter";
+    case LSAL_PIN_SMT: return "smt";
+    default: return "none";
+    }
+}
+
+// Sort key of a CPU slot under the pinning policy, compared lexicographically
+static inline void lsal_slot_key(const lsal_topology_t *t, int i, int key[4]) {
+    // Rank of the CPU inside its node, physical cores first, for dealing over the nodes
+    int rank = 0;
+    for (int j = 0; j < t->num_cpus; j++) {
+        if (t->node[j] != t->node[i]) continue;
+        if (t->smt[j] < t->smt[i] || (t->smt[j] == t->smt[i] && j < i)) rank++;
+    }
+
+    switch (t->policy) {
+    case LSAL_PIN_SCATTER:
+        key[0] = rank; key[1] = t->node[i]; key[2] = 0; key[3] = 0;
+        break;
+    case LSAL_PIN_SMT:
+        key[0] = t->smt[i]; key[1] = t->node[i]; key[2] = t->socket[i]; key[3] = t->core[i];
+        break;
+    default:
+        key[0] = t->node[i]; key[1] = t->socket[i]; key[2] = t->core[i]; key[3] = t->smt[i];
+        break;
+    }
+}
+
+static lsal_topology_t lsal_topo;
+
+// Affinity of the calling thread before lsal_pin_thread, restored by lsal_unpin_thread
+static __thread cpu_set_t lsal_saved_mask;
+static __thread int lsal_pinned;
+
+static const lsal_topology_t *lsal_sort_topo;
+
+static inline int lsal_slot_cmp(const void *a, const void *b) {
+    int i = *(const int *) a, j = *(const int *) b;
+    int ki[4], kj[4];
+    lsal_slot_key(lsal_sort_topo, i, ki);
+    lsal_slot_key(lsal_sort_topo, j, kj);
+
+    for (int k = 0; k < 4; k++) {
+        if (ki[k] != kj[k]) return ki[k] < kj[k] ? -1 : 1;
+    }
+    return i - j;
+}
+
+static inline void lsal_topology_init(void) {
+    lsal_topology_t *topo = &lsal_topo;
+    static int node_of[LSAL_MAX_CPUS];
+    for (int c = 0; c < LSAL_MAX_CPUS; c++) node_of[c] = 0;
+
+    char path[128];
+    int nodes = 0;
+    for (int n = 0; n < LSAL_MAX_NODES; n++) {
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", n);
+        if (lsal_read_cpulist(path, node_of, n)) nodes = n + 1;
+    }
+    topo->num_nodes = nodes > 0 ? nodes : 1;
+
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    if (sched_getaffinity(0, sizeof(mask), &mask) != 0) {
+        for (int c = 0; c < CPU_SETSIZE; c++) CPU_SET(c, &mask);
+    }
+
+    topo->num_cpus = 0;
+    for (int c = 0; c < LSAL_MAX_CPUS && c < CPU_SETSIZE; c++) {
+        if (!CPU_ISSET(c, &mask)) continue;
+
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/core_id", c);
+        int core = lsal_read_int(path, -1);
+        if (core < 0) continue;
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", c);
+        int socket = lsal_read_int(path, 0);
+
+        int i = topo->num_cpus++;
+        topo->cpu[i] = c;
+        topo->node[i] = node_of[c];
+        topo->core[i] = core;
+        topo->socket[i] = socket;
+        topo->smt[i] = 0;
+        for (int j = 0; j < i; j++) {
+            if (topo->core[j] == core && topo->socket[j] == socket) topo->smt[i]++;
+        }
+    }
+
+    topo->policy = lsal_pin_policy();
+
+    for (int i = 0; i < topo->num_cpus; i++) topo->order[i] = i;
+    lsal_sort_topo = topo;
+    qsort(topo->order, topo->num_cpus, sizeof(int), lsal_slot_cmp);
+}
+
+// Safe to call from any thread, including inside a parallel region
+static inline lsal_topology_t *lsal_topology(void) {
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    pthread_once(&once, lsal_topology_init);
+    return &lsal_topo;
+}
+
+// Pins the calling thread according to the policy, returns the node it runs on
+static inline int lsal_pin_thread(int tid) {
+    lsal_topology_t *t = lsal_topology();
+    if (t->num_cpus == 0) return 0;
+
+    if (t->policy != LSAL_PIN_NONE) {
+        if (!lsal_pinned && sched_getaffinity(0, sizeof(lsal_saved_mask), &lsal_saved_mask) == 0) lsal_pinned = 1;
+
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(t->cpu[t->order[tid % t->num_cpus]], &set);
+        sched_setaffinity(0, sizeof(set), &set);
+    }
+
+    int cpu = sched_getcpu();
+    for (int i = 0; i < t->num_cpus; i++) {
+        if (t->cpu[i] == cpu) return t->node[i];
+    }
+    return 0;
+}
+
+// Gives the calling thread back the affinity it had before lsal_pin_thread
+static inline void lsal_unpin_thread(void) {
+    if (!lsal_pinned) return;
+    sched_setaffinity(0, sizeof(lsal_saved_mask), &lsal_saved_mask);
+    lsal_pinned = 0;
+}
+
+/*
+ Owner of each tile row. Tile rows are dealt cyclically over the threads taken in node
+ order, so every node gets a contiguous run of tile rows per cycle, sized by its thread
+ count, and neighbouring tile rows (which exchange a boundary row) mostly share a node.
+ */
+static inline void lsal_tile_owners(int *owner, int tile_rows, const int *thread_node, int num_threads) {
+    int by_node[num_threads];
+    int n = 0;
+    for (int node = 0; node < LSAL_MAX_NODES && n < num_threads; node++) {
+        for (int t = 0; t < num_threads; t++) {
+            if (thread_node[t] == node) by_node[n++] = t;
+        }
+    }
+    for (int t = 0; t < num_threads && n < num_threads; t++) {
+        if (thread_node[t] < 0 || thread_node[t] >= LSAL_MAX_NODES) by_node[n++] = t;
+    }
+
+    for (int r = 0; r < tile_rows; r++) owner[r] = by_node[r % num_threads];
+}
+
+/*
+ Fraction of the bytes in [p, p + len) that live on the given node, page by page.
+ Returns -1 if the kernel cannot tell (no move_pages).
+ */
+static inline double lsal_local_fraction(const void *p, size_t len, int node, size_t *local_bytes, size_t *total_bytes) {
+#ifdef SYS_move_pages
+    const size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    uintptr_t start = (uintptr_t) p & ~(uintptr_t) (page - 1);
+    uintptr_t end = (uintptr_t) p + len;
+
+    enum { BATCH = 512 };
+    void *pages[BATCH];
+    int status[BATCH];
+
+    size_t local = 0, total = 0;
+    for (uintptr_t a = start; a < end;) {
+        int n = 0;
+        for (; n < BATCH && a < end; n++, a += page) pages[n] = (void *) a;
+
+        if (syscall(SYS_move_pages, 0, (unsigned long) n, pages, NULL, status, 0) != 0) return -1;
+
+        for (int i = 0; i < n; i++) {
+            uintptr_t lo = (uintptr_t) pages[i] < (uintptr_t) p ? (uintptr_t) p : (uintptr_t) pages[i];
+            uintptr_t hi = (uintptr_t) pages[i] + page > end ? end : (uintptr_t) pages[i] + page;
+            total += hi - lo;
+            if (status[i] == node) local += hi - lo;
+        }
+    }
+
+    *local_bytes += local;
+    *total_bytes += total;
+    return total ? (double) local / (double) total : 1.0;
+#else
+    (void) p; (void) len; (void) node; (void) local_bytes; (void) total_bytes;
+    return -1;
+#endif
+}
+
+#endif
@@ -4,17 +4,20 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "lsal_x86.h"
+#include "lsal_alloc.h"
+
 #ifndef TEST
 #define TEST 0
 #endif
 
-const int match = 2;
-const int mismatch = -1;
-const int gap_row = -1;
-const int gap_col = -1;
+static const int match = 2;
+static const int mismatch = -1;
+static const int gap_row = -1;
+static const int gap_col = -1;
 
-int max(int a, int b) { return a > b ? a : b; }
-int min(int a, int b) { return a < b ? a : b; }
+static inline int max(int a, int b) { return a > b ? a : b; }
+static inline int min(int a, int b) { return a < b ? a : b; }
 
 void lsal_compute_matrices_o(char *q, char *d, size_t *max_idx, int *similarity, char *direction, size_t N, size_t M) {
     int max_similarity = 0;
@@ -48,6 +51,9 @@ void lsal_compute_matrices_o(char *q, char *d, size_t *max_idx, int *similarity,
     }
 }
 
+// Build with -DLSAL_NO_MAIN to link the kernel into another driver
+#ifndef LSAL_NO_MAIN
+
 void lsal_print_similarity(const char *q, const char *d, int *similarity) {
     size_t N = strlen(q);
     size_t M = strlen(d);
@@ -145,8 +151,8 @@ int main(int argc, char **argv) {
         return 1;
     }
 
-    int qlen = atoi(argv[1]);
-    int dlen = atoi(argv[2]);
+    size_t qlen = strtoull(argv[1], NULL, 10);
+    size_t dlen = strtoull(argv[2], NULL, 10);
 
     char *q = calloc(qlen + 1, sizeof(char));
     char *d = calloc(dlen + 1, sizeof(char));
@@ -155,8 +161,25 @@ int main(int argc, char **argv) {
     init_random_buf(d, dlen);
 
     
-    int *similarity = calloc(qlen * dlen, sizeof(int));
-    char *direction = calloc(qlen * dlen, sizeof(char));
+    size_t cells;
+    if (!lsal_size_mul(qlen, dlen, &cells)) {
+        fprintf(stderr, "Matrix of %lu x %lu cells is too large\n", qlen, dlen);
+        return 1;
+    }
+
+    // The kernels write every cell, so the matrices are left uninitialized
+    lsal_arena_t arena = {0};
+    if (lsal_arena_reserve(&arena, lsal_arena_bytes(cells, sizeof(int)) + lsal_arena_bytes(cells, sizeof(char)))) {
+        fprintf(stderr, "Failed to map %lu cells\n", cells);
+        return 1;
+    }
+
+    int *similarity = lsal_arena_alloc(&arena, cells, sizeof(int));
+    char *direction = lsal_arena_alloc(&arena, cells, sizeof(char));
+    if (!similarity || !direction) {
+        fprintf(stderr, "Failed to allocate %lu cells\n", cells);
+        return 1;
+    }
     
     size_t max_idx;
     
@@ -166,7 +189,7 @@ int main(int argc, char **argv) {
 
     #if TEST == 0
     size_t num_iter = 10;
-    clock_t total_time = clock();
+    double total_time = lsal_wall_seconds();
     
     for (size_t i = 0; i < num_iter; i++)
     #endif
@@ -174,10 +197,8 @@ int main(int argc, char **argv) {
         lsal_compute_matrices_o(q, d, &max_idx, similarity, direction, qlen, dlen);
 
     #if TEST == 0
-    total_time = clock() - total_time;
-    total_time /= num_iter;
-    
-    double total_time_secs = (double) total_time / (double) CLOCKS_PER_SEC; 
+    // Wall-clock seconds per call; clock() counted CPU time and divided it in whole ticks
+    double total_time_secs = (lsal_wall_seconds() - total_time) / num_iter;
     #endif
 
     #if TEST
@@ -193,10 +214,11 @@ int main(int argc, char **argv) {
     printf("Exection Time: %lfs\n", total_time_secs);
     #endif
 
-    free(similarity);
-    free(direction);
+    lsal_arena_release(&arena);
     free(q);
     free(d);
 
     return 0;
 }
+
+#endif
@@ -1,22 +1,102 @@
+#define _GNU_SOURCE
+
 #include <omp.h>
 #include <time.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "lsal_x86.h"
+#include "lsal_alloc.h"
+#include "lsal_numa.h"
+
 #ifndef TEST
 #define TEST 0
 #endif
 
+#ifndef TILE_SIZE
 #define TILE_SIZE 4096
+#endif
+
+static const int match = 2;
+static const int mismatch = -1;
+static const int gap_row = -1;
+static const int gap_col = -1;
+
+static inline int max(int a, int b) { return a > b ? a : b; }
+static inline int min(int a, int b) { return a < b ? a : b; }
+
+/*
+ Which thread owns which tile row. A tile row is a contiguous band of the matrices, so the
+ owner writes the band first (placing its pages on the owner's node) and computes every tile
+ of it in the wavefront.
+ */
+typedef struct {
+    int num_threads;
+    int tile_rows;
+    int *owner;          // owning thread of each tile row
+    int *plan_node;      // node each thread was on when the plan was made
+    int *run_node;       // node each thread was on during the last kernel call
+} lsal_placement_t;
+
+static lsal_placement_t placement;
 
-const int match = 2;
-const int mismatch = -1;
-const int gap_row = -1;
-const int gap_col = -1;
+// Counters of each pool thread, opened on its first measured call
+static __thread lsal_perf_t thread_perf;
 
-int max(int a, int b) { return a > b ? a : b; }
-int min(int a, int b) { return a < b ? a : b; }
+lsal_perf_counts_t *lsal_omp_perf = NULL;
+lsal_trace_t *lsal_omp_trace = NULL;
+
+static void lsal_plan_placement(size_t M, int num_threads) {
+    int tile_rows = (int)((M + TILE_SIZE - 1) / TILE_SIZE);
+    if (placement.owner && placement.num_threads == num_threads && placement.tile_rows == tile_rows) return;
+
+    free(placement.owner);
+    free(placement.plan_node);
+    free(placement.run_node);
+
+    placement.num_threads = num_threads;
+    placement.tile_rows = tile_rows;
+    placement.owner = malloc(sizeof(int) * (tile_rows > 0 ? tile_rows : 1));
+    placement.plan_node = malloc(sizeof(int) * num_threads);
+    placement.run_node = malloc(sizeof(int) * num_threads);
+
+    #pragma omp parallel num_threads(num_threads)
+    {
+        int tid = omp_get_thread_num();
+        placement.plan_node[tid] = lsal_pin_thread(tid);
+        placement.run_node[tid] = placement.plan_node[tid];
+        lsal_unpin_thread();
+    }
+
+    lsal_tile_owners(placement.owner, tile_rows, placement.plan_node, num_threads);
+}
+
+/*
+ First-touch placement: every thread writes the tile rows it owns before the first kernel call,
+ so their pages land on its node instead of wherever the allocating thread ran.
+ */
+void lsal_place_matrices_omp(int *similarity, char *direction, size_t N, size_t M) {
+    int num_threads = omp_get_max_threads();
+    lsal_plan_placement(M, num_threads);
+
+    #pragma omp parallel num_threads(num_threads)
+    {
+        int tid = omp_get_thread_num();
+        lsal_pin_thread(tid);
+
+        for (int tile_row = 0; tile_row < placement.tile_rows; tile_row++) {
+            if (placement.owner[tile_row] != tid) continue;
+
+            size_t row_start = (size_t) tile_row * TILE_SIZE;
+            size_t row_end = row_start + TILE_SIZE < M ? row_start + TILE_SIZE : M;
+
+            memset(similarity + row_start * N, 0, (row_end - row_start) * N * sizeof(int));
+            memset(direction + row_start * N, 0, (row_end - row_start) * N * sizeof(char));
+        }
+        lsal_unpin_thread();
+    }
+}
 
 void lsal_compute_matrices_omp(const char *q, const char *d, size_t *max_idx, int *similarity, char *direction, size_t N, size_t M)
 {
@@ -30,31 +110,48 @@ void lsal_compute_matrices_omp(const char *q, const char *d, size_t *max_idx, in
         num_threads = omp_get_num_threads();
     }
 
+    lsal_plan_placement(M, num_threads);
+    const int *owner = placement.owner;
+
     // Allocate thread-local maxima
     int thread_max[num_threads];
     size_t thread_max_idx[num_threads];
     memset(thread_max, 0, sizeof(thread_max));
     memset(thread_max_idx, 0, sizeof(thread_max_idx));
 
-    // Loop over tiles in wavefront (anti-diagonal) fashion
-    #pragma omp parallel
+    // Rows run over the database (M), columns over the query (N)
+    int tile_rows = (int)((M + TILE_SIZE - 1) / TILE_SIZE);
+    int tile_cols = (int)((N + TILE_SIZE - 1) / TILE_SIZE);
+
+    // Loop over tiles in wavefront (anti-diagonal) fashion, each thread taking the tile rows it owns
+    #pragma omp parallel num_threads(num_threads)
     {
         int tid = omp_get_thread_num();
-        for (int round = 0; round < (N + M - 1 + TILE_SIZE - 1) / TILE_SIZE; round++) {
-            #pragma omp for schedule(static)
-            for (int tile_row = 0; tile_row < (int)((N + TILE_SIZE - 1) / TILE_SIZE); tile_row++) {
+        placement.run_node[tid] = lsal_pin_thread(tid);
+
+        if (lsal_omp_perf) lsal_perf_begin(&thread_perf);
+        lsal_trace_t *trace = lsal_omp_trace;
+
+        for (int round = 0; round < tile_rows + tile_cols - 1; round++) {
+            int first = max(0, round - tile_cols + 1);
+            int last = min(round, tile_rows - 1);
+
+            for (int tile_row = first; tile_row <= last; tile_row++) {
+                if (owner[tile_row] != tid) continue;
+
                 int tile_col = round - tile_row;
-                if (tile_col < 0 || tile_col >= (int)((M + TILE_SIZE - 1) / TILE_SIZE)) continue;
 
-                int row_start = tile_row * TILE_SIZE;
-                int col_start = tile_col * TILE_SIZE;
+                size_t row_start = (size_t) tile_row * TILE_SIZE;
+                size_t col_start = (size_t) tile_col * TILE_SIZE;
+
+                size_t row_end = row_start + TILE_SIZE < M ? row_start + TILE_SIZE : M;
+                size_t col_end = col_start + TILE_SIZE < N ? col_start + TILE_SIZE : N;
 
-                int row_end = min(row_start + TILE_SIZE, M);
-                int col_end = min(col_start + TILE_SIZE, N);
+                uint64_t tile_start = trace ? lsal_trace_now() : 0;
 
-                for (int row = row_start; row < row_end; row++) {
-                    for (int col = col_start; col < col_end; col++) {
-                        int idx = row * N + col;
+                for (size_t row = row_start; row < row_end; row++) {
+                    for (size_t col = col_start; col < col_end; col++) {
+                        size_t idx = row * N + col;
 
                         int score = (d[row] == q[col]) ? match : mismatch;
                         int D = (row > 0 && col > 0) ? similarity[(row - 1) * N + (col - 1)] + score : score;
@@ -70,19 +167,31 @@ void lsal_compute_matrices_omp(const char *q, const char *d, size_t *max_idx, in
                         similarity[idx] = best;
                         direction[idx] = dir;
 
-                        if (best > thread_max[tid]) {
+                        // Tiles are not visited in row-major order, so ties go to the lower index
+                        if (best > thread_max[tid] || (best == thread_max[tid] && idx < thread_max_idx[tid])) {
                             thread_max[tid] = best;
                             thread_max_idx[tid] = idx;
                         }
                     }
                 }
+
+                if (trace) lsal_trace_record(trace, tid, LSAL_TRACE_TILE, round, tile_row, tile_col, tile_start, lsal_trace_now());
             }
+
+            uint64_t wait_start = trace ? lsal_trace_now() : 0;
+
+            #pragma omp barrier
+
+            if (trace) lsal_trace_record(trace, tid, LSAL_TRACE_BARRIER, round, -1, -1, wait_start, lsal_trace_now());
         }
+
+        if (lsal_omp_perf) lsal_perf_end(&thread_perf, &lsal_omp_perf[tid]);
+        lsal_unpin_thread();
     }
 
     // Final reduction outside parallel region
     for (int i = 0; i < num_threads; i++) {
-        if (thread_max[i] > global_max) {
+        if (thread_max[i] > global_max || (thread_max[i] == global_max && thread_max_idx[i] < global_max_idx)) {
             global_max = thread_max[i];
             global_max_idx = thread_max_idx[i];
         }
@@ -91,6 +200,34 @@ void lsal_compute_matrices_omp(const char *q, const char *d, size_t *max_idx, in
     *max_idx = global_max_idx;
 }
 
+/*
+ Prints which share of the matrix bytes sits on the node of the thread that computes it.
+ Every cell is read and written by the owner of its tile row (apart from the one boundary row
+ the next tile row reads), so this is the share of the DP traffic that stayed node-local.
+ */
+void lsal_report_locality_omp(const int *similarity, const char *direction, size_t N, size_t M) {
+    lsal_topology_t *topo = lsal_topology();
+    size_t local = 0, total = 0;
+
+    for (int tile_row = 0; tile_row < placement.tile_rows; tile_row++) {
+        size_t row_start = (size_t) tile_row * TILE_SIZE;
+        size_t row_end = row_start + TILE_SIZE < M ? row_start + TILE_SIZE : M;
+        int node = placement.run_node[placement.owner[tile_row]];
+
+        if (lsal_local_fraction(similarity + row_start * N, (row_end - row_start) * N * sizeof(int), node, &local, &total) < 0 ||
+            lsal_local_fraction(direction + row_start * N, (row_end - row_start) * N * sizeof(char), node, &local, &total) < 0) {
+            printf("NUMA: %d node(s), pinning %s, page placement unavailable\n", topo->num_nodes, lsal_pin_name(topo->policy));
+            return;
+        }
+    }
+
+    printf("NUMA: %d node(s), pinning %s, %.1f%% of %lu matrix bytes local to the computing thread\n",
+           topo->num_nodes, lsal_pin_name(topo->policy), total ? 100.0 * local / total : 100.0, total);
+}
+
+// Build with -DLSAL_NO_MAIN to link the kernel into another driver
+#ifndef LSAL_NO_MAIN
+
 void lsal_print_similarity(const char *q, const char *d, int *similarity) {
     size_t N = strlen(q);
     size_t M = strlen(d);
@@ -188,8 +325,8 @@ int main(int argc, char **argv) {
         return 1;
     }
 
-    int qlen = atoi(argv[1]);
-    int dlen = atoi(argv[2]);
+    size_t qlen = strtoull(argv[1], NULL, 10);
+    size_t dlen = strtoull(argv[2], NULL, 10);
 
     char *q = calloc(qlen + 1, sizeof(char));
     char *d = calloc(dlen + 1, sizeof(char));
@@ -198,10 +335,33 @@ int main(int argc, char **argv) {
     init_random_buf(d, dlen);
 
     
-    int *similarity = calloc(qlen * dlen, sizeof(int));
-    char *direction = calloc(qlen * dlen, sizeof(char));
+    size_t cells;
+    if (!lsal_size_mul(qlen, dlen, &cells)) {
+        fprintf(stderr, "Matrix of %lu x %lu cells is too large\n", qlen, dlen);
+        return 1;
+    }
+
+    // The kernels write every cell, so the matrices are left uninitialized
+    lsal_arena_t arena = {0};
+    if (lsal_arena_reserve(&arena, lsal_arena_bytes(cells, sizeof(int)) + lsal_arena_bytes(cells, sizeof(char)))) {
+        fprintf(stderr, "Failed to map %lu cells\n", cells);
+        return 1;
+    }
+
+    int *similarity = lsal_arena_alloc(&arena, cells, sizeof(int));
+    char *direction = lsal_arena_alloc(&arena, cells, sizeof(char));
+    if (!similarity || !direction) {
+        fprintf(stderr, "Failed to allocate %lu cells\n", cells);
+        return 1;
+    }
     
     size_t max_idx;
+
+    lsal_place_matrices_omp(similarity, direction, qlen, dlen);
+
+    // LSAL_TRACE=<file> records the wavefront of the timed calls as a Chrome trace
+    const char *trace_path = getenv("LSAL_TRACE");
+    if (trace_path) lsal_omp_trace = lsal_trace_create(omp_get_max_threads());
     
     #if TEST
     printf("Q: %s\nD: %s\n\n", q, d);
@@ -236,12 +396,22 @@ int main(int argc, char **argv) {
 
     #if TEST == 0
     printf("Execution Time: %lfs\n", omp_time);
+
+    lsal_report_locality_omp(similarity, direction, qlen, dlen);
     #endif
 
-    free(similarity);
-    free(direction);
+    if (lsal_omp_trace) {
+        if (lsal_trace_write_chrome(lsal_omp_trace, trace_path) == 0) printf("Trace written to %s\n", trace_path);
+        lsal_trace_summary(lsal_omp_trace, stdout);
+        lsal_trace_free(lsal_omp_trace);
+        lsal_omp_trace = NULL;
+    }
+
+    lsal_arena_release(&arena);
     free(q);
     free(d);
 
     return 0;
-}
\ No newline at end of file
+}
+
+#endif
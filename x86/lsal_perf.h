@@ -0,0 +1,123 @@
+#ifndef LSAL_PERF_H
+#define LSAL_PERF_H
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+/*
+ Hardware counters around kernel calls, through perf_event_open.
+ Every event is opened on its own for the calling thread (user space only, so the default
+ perf_event_paranoid of 2 allows it), and an event the CPU or the kernel does not offer is
+ simply marked unavailable. The counters run freely once opened; a measurement reads them
+ before and after the code of interest, and the difference is scaled up when the kernel had
+ to multiplex the event with others.
+ */
+
+enum {
+    LSAL_PERF_CYCLES,
+    LSAL_PERF_INSTRUCTIONS,
+    LSAL_PERF_L1D_MISSES,       // L1 data cache read misses
+    LSAL_PERF_LLC_MISSES,       // last-level cache misses
+    LSAL_PERF_BRANCH_MISSES,
+    LSAL_PERF_STALLED_CYCLES,   // cycles the back end made no progress
+    LSAL_PERF_TASK_CLOCK,       // ns the thread was on a CPU (software event)
+    LSAL_PERF_EVENTS
+};
+
+static const char *const lsal_perf_names[LSAL_PERF_EVENTS] = {
+    "cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses", "stalled_cycles", "task_clock_ns"
+};
+
+typedef struct {
+    uint64_t value[LSAL_PERF_EVENTS];
+    unsigned valid;             // bit e set when value[e] was measured
+} lsal_perf_counts_t;
+
+typedef struct {
+    int opened;
+    int fd[LSAL_PERF_EVENTS];
+    uint64_t start[LSAL_PERF_EVENTS][3];    // value, time enabled, time running
+} lsal_perf_t;
+
+static inline int lsal_perf_event_open(uint32_t type, uint64_t config) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+// Opens the counters of the calling thread; returns how many events are available
+static inline int lsal_perf_open(lsal_perf_t *perf) {
+    static const uint64_t l1d_read_miss = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+
+    perf->fd[LSAL_PERF_CYCLES] = lsal_perf_event_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    perf->fd[LSAL_PERF_INSTRUCTIONS] = lsal_perf_event_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    perf->fd[LSAL_PERF_L1D_MISSES] = lsal_perf_event_open(PERF_TYPE_HW_CACHE, l1d_read_miss);
+    perf->fd[LSAL_PERF_LLC_MISSES] = lsal_perf_event_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    perf->fd[LSAL_PERF_BRANCH_MISSES] = lsal_perf_event_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+    perf->fd[LSAL_PERF_STALLED_CYCLES] = lsal_perf_event_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_STALLED_CYCLES_BACKEND);
+    perf->fd[LSAL_PERF_TASK_CLOCK] = lsal_perf_event_open(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK);
+    perf->opened = 1;
+
+    int available = 0;
+    for (int e = 0; e < LSAL_PERF_EVENTS; e++) available += perf->fd[e] >= 0;
+    return available;
+}
+
+static inline void lsal_perf_close(lsal_perf_t *perf) {
+    for (int e = 0; perf->opened && e < LSAL_PERF_EVENTS; e++) {
+        if (perf->fd[e] >= 0) close(perf->fd[e]);
+        perf->fd[e] = -1;
+    }
+    perf->opened = 0;
+}
+
+// Starts a measurement, opening the counters on first use
+static inline void lsal_perf_begin(lsal_perf_t *perf) {
+    if (!perf->opened) lsal_perf_open(perf);
+
+    for (int e = 0; e < LSAL_PERF_EVENTS; e++) {
+        if (perf->fd[e] >= 0 && read(perf->fd[e], perf->start[e], sizeof(perf->start[e])) != sizeof(perf->start[e])) {
+            close(perf->fd[e]);
+            perf->fd[e] = -1;
+        }
+    }
+}
+
+// Ends a measurement and adds what the events counted since lsal_perf_begin to counts
+static inline void lsal_perf_end(lsal_perf_t *perf, lsal_perf_counts_t *counts) {
+    for (int e = 0; e < LSAL_PERF_EVENTS; e++) {
+        uint64_t now[3];
+        if (perf->fd[e] < 0 || read(perf->fd[e], now, sizeof(now)) != sizeof(now)) continue;
+
+        uint64_t value = now[0] - perf->start[e][0];
+        uint64_t enabled = now[1] - perf->start[e][1];
+        uint64_t running = now[2] - perf->start[e][2];
+        if (running && running < enabled) value = (uint64_t) ((double) value * enabled / running);
+
+        counts->value[e] += value;
+        counts->valid |= 1u << e;
+    }
+}
+
+static inline void lsal_perf_add(lsal_perf_counts_t *sum, const lsal_perf_counts_t *counts) {
+    for (int e = 0; e < LSAL_PERF_EVENTS; e++) sum->value[e] += counts->value[e];
+    sum->valid |= counts->valid;
+}
+
+static inline int lsal_perf_has(const lsal_perf_counts_t *counts, int event) {
+    return (counts->valid >> event) & 1;
+}
+
+#endif
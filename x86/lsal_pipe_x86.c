@@ -0,0 +1,420 @@
+#include <time.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "lsal_x86.h"
+#include "lsal_alloc.h"
+#include "lsal_queue.h"
+
+#define QUEUE_DEPTH 64
+
+/*
+ Staged pipeline:
+   reader   parses (or generates) query/database pairs      -> jobs queue (MPMC)
+   compute  worker pool filling the DP matrices, traceback  -> one results ring per worker (SPSC)
+   writer   formatting of finished jobs                     -> output file
+ Every ring is bounded, so a slow stage stalls the ones feeding it. Each worker fills its
+ matrices in one arena that it reuses for every job, and only the alignment travels on.
+ Results come out in completion order, each tagged with its job id. A job whose matrices
+ do not fit is marked failed and still passed on, and the writer reports it among the
+ others. A NULL job is the end-of-stream marker.
+ */
+
+typedef struct {
+    size_t id;
+    char *q, *d;
+    size_t N, M;
+    int failed;             // the worker could not allocate the matrices or the alignment
+    int score;
+    size_t max_idx;
+    char *alignment;        // aligned query, then aligned database, N + M + 1 chars each
+    size_t pos;             // where both alignments start
+} lsal_job_t;
+
+typedef struct {
+    const char *name;
+    int threads;
+    _Atomic uint64_t busy_ns;     // doing the stage's own work
+    _Atomic uint64_t starved_ns;  // waiting on an empty input ring
+    _Atomic uint64_t blocked_ns;  // waiting on a full output ring
+    _Atomic uint64_t items;
+} lsal_stage_t;
+
+typedef struct {
+    // Input: a file of "<query> <database>" lines, or generated random pairs
+    FILE *in;
+    size_t qlen, dlen, num_jobs;
+
+    FILE *out;
+    int workers;
+
+    lsal_mpmc_t jobs;
+    lsal_spsc_t *results;
+
+    lsal_stage_t reader, compute, writer;
+    size_t failed_jobs;     // written by the writer only
+} lsal_pipeline_t;
+
+typedef struct {
+    lsal_pipeline_t *p;
+    int worker;
+} lsal_worker_arg_t;
+
+static void stage_add(_Atomic uint64_t *counter, uint64_t ns) {
+    atomic_fetch_add_explicit(counter, ns, memory_order_relaxed);
+}
+
+static char *random_seq(size_t n) {
+    static const char *choices = "ATGC";
+    char *s = malloc(n + 1);
+    for (size_t i = 0; i < n; i++) s[i] = choices[rand() % 4];
+    s[n] = '\0';
+    return s;
+}
+
+// Reads the next "<query> <database>" record, skipping blank lines. Returns 0 at end of input.
+static int read_record(FILE *in, char **q, char **d) {
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t len;
+
+    while ((len = getline(&line, &cap, in)) >= 0) {
+        char *save, *a = strtok_r(line, " \t\r\n", &save), *b = strtok_r(NULL, " \t\r\n", &save);
+        if (!a) continue;
+        if (!b) {
+            fprintf(stderr, "Skipping record without a database sequence\n");
+            continue;
+        }
+        *q = strdup(a);
+        *d = strdup(b);
+        free(line);
+        return 1;
+    }
+
+    free(line);
+    return 0;
+}
+
+static void *reader_stage(void *arg) {
+    lsal_pipeline_t *p = arg;
+
+    for (size_t id = 0;; id++) {
+        uint64_t start = lsal_now_ns();
+
+        char *q, *d;
+        if (p->in) {
+            if (!read_record(p->in, &q, &d)) break;
+        } else {
+            if (id == p->num_jobs) break;
+            q = random_seq(p->qlen);
+            d = random_seq(p->dlen);
+        }
+
+        lsal_job_t *job = calloc(1, sizeof(lsal_job_t));
+        job->id = id;
+        job->q = q;
+        job->d = d;
+        job->N = strlen(q);
+        job->M = strlen(d);
+
+        stage_add(&p->reader.busy_ns, lsal_now_ns() - start);
+        stage_add(&p->reader.blocked_ns, lsal_mpmc_push(&p->jobs, job));
+        atomic_fetch_add_explicit(&p->reader.items, 1, memory_order_relaxed);
+    }
+
+    for (int w = 0; w < p->workers; w++) {
+        stage_add(&p->reader.blocked_ns, lsal_mpmc_push(&p->jobs, NULL));
+    }
+    return NULL;
+}
+
+// Traceback into caller-provided buffers of N + M + 1 chars, returns the alignment start
+static size_t lsal_traceback_str(const lsal_job_t *job, const int *similarity, const char *direction,
+                                 char *aligned_q, char *aligned_d, int *score) {
+    size_t N = job->N;
+    size_t pos = N + job->M;
+    aligned_q[pos] = '\0';
+    aligned_d[pos] = '\0';
+
+    *score = (job->N && job->M) ? similarity[job->max_idx] : 0;
+    if (*score <= 0) return pos;
+
+    long row = job->max_idx / N;
+    long col = job->max_idx % N;
+
+    while (row >= 0 && col >= 0 && similarity[row * N + col] > 0) {
+        char dir = direction[row * N + col];
+        pos--;
+        if (dir == 'D') {
+            aligned_q[pos] = job->q[col];
+            aligned_d[pos] = job->d[row];
+            row--; col--;
+        } else if (dir == 'U') {
+            aligned_q[pos] = '-';
+            aligned_d[pos] = job->d[row];
+            row--;
+        } else {
+            aligned_q[pos] = job->q[col];
+            aligned_d[pos] = '-';
+            col--;
+        }
+    }
+
+    return pos;
+}
+
+static void *compute_stage(void *arg) {
+    lsal_worker_arg_t *wa = arg;
+    lsal_pipeline_t *p = wa->p;
+    lsal_spsc_t *results = &p->results[wa->worker];
+
+    // Grows to the largest job this worker has seen, then is reused as is
+    lsal_arena_t arena = {0};
+
+    for (;;) {
+        void *item;
+        stage_add(&p->compute.starved_ns, lsal_mpmc_pop(&p->jobs, &item));
+
+        lsal_job_t *job = item;
+        if (!job) break;
+
+        uint64_t start = lsal_now_ns();
+
+        // lsal_arena_bytes is 0 on overflow, and for an empty matrix
+        size_t cells, bytes = 0, len = job->N + job->M + 1;
+        int fits = lsal_size_mul(job->N, job->M, &cells);
+        if (fits) {
+            size_t sim_bytes = lsal_arena_bytes(cells, sizeof(int));
+            size_t dir_bytes = lsal_arena_bytes(cells, sizeof(char));
+            fits = (cells == 0 || (sim_bytes && dir_bytes)) && sim_bytes <= SIZE_MAX - dir_bytes;
+            bytes = sim_bytes + dir_bytes;
+        }
+
+        int *similarity = NULL;
+        char *direction = NULL;
+        if (fits && lsal_arena_reserve(&arena, bytes) == 0) {
+            similarity = lsal_arena_alloc(&arena, cells, sizeof(int));
+            direction = lsal_arena_alloc(&arena, cells, sizeof(char));
+        }
+        job->alignment = similarity && direction ? malloc(2 * len) : NULL;
+
+        if (job->alignment) {
+            lsal_compute_matrices_o(job->q, job->d, &job->max_idx, similarity, direction, job->N, job->M);
+            job->pos = lsal_traceback_str(job, similarity, direction, job->alignment, job->alignment + len, &job->score);
+        } else {
+            job->failed = 1;
+        }
+
+        stage_add(&p->compute.busy_ns, lsal_now_ns() - start);
+        stage_add(&p->compute.blocked_ns, lsal_spsc_push(results, job));
+        atomic_fetch_add_explicit(&p->compute.items, 1, memory_order_relaxed);
+    }
+
+    lsal_arena_release(&arena);
+    stage_add(&p->compute.blocked_ns, lsal_spsc_push(results, NULL));
+    return NULL;
+}
+
+static void *writer_stage(void *arg) {
+    lsal_pipeline_t *p = arg;
+    int remaining = p->workers;
+    int w = 0;
+
+    char *done = calloc(p->workers, sizeof(char));
+
+    // Drain the per-worker rings round-robin, waiting only when every open ring is empty
+    while (remaining > 0) {
+        void *item = NULL;
+        int got = 0;
+        uint64_t wait_start = 0;
+        unsigned spins = 0;
+
+        while (!got) {
+            for (int tries = 0; tries < p->workers && !got; tries++) {
+                w = (w + 1) % p->workers;
+                if (!done[w]) got = lsal_spsc_try_pop(&p->results[w], &item);
+            }
+            if (got) break;
+
+            if (!wait_start) {
+                wait_start = lsal_now_ns();
+                for (int o = 0; o < p->workers; o++) {
+                    if (!done[o]) atomic_fetch_add_explicit(&p->results[o].stats.empty_waits, 1, memory_order_relaxed);
+                }
+            }
+            lsal_backoff(&spins);
+        }
+        if (wait_start) stage_add(&p->writer.starved_ns, lsal_now_ns() - wait_start);
+
+        if (!item) {
+            // End of stream from this worker
+            done[w] = 1;
+            remaining--;
+            continue;
+        }
+
+        uint64_t start = lsal_now_ns();
+        lsal_job_t *job = item;
+
+        if (job->failed) {
+            fprintf(p->out, "Job %lu: failed, no memory for a %lu x %lu matrix\n\n", job->id, job->N, job->M);
+            p->failed_jobs++;
+        } else {
+            size_t len = job->N + job->M + 1;
+            fprintf(p->out, "Job %lu: score %d at (%lu, %lu)\nQ: %s\nD: %s\n\n", job->id, job->score,
+                    job->N ? job->max_idx / job->N : 0, job->N ? job->max_idx % job->N : 0,
+                    job->alignment + job->pos, job->alignment + len + job->pos);
+        }
+
+        free(job->alignment);
+        free(job->q);
+        free(job->d);
+        free(job);
+
+        stage_add(&p->writer.busy_ns, lsal_now_ns() - start);
+        atomic_fetch_add_explicit(&p->writer.items, 1, memory_order_relaxed);
+    }
+
+    fflush(p->out);
+    free(done);
+    return NULL;
+}
+
+// Ends the first `started` workers when the pipeline cannot start: one end marker each, then a join
+static void stop_workers(lsal_pipeline_t *p, pthread_t *workers, int started) {
+    for (int w = 0; w < started; w++) lsal_mpmc_push(&p->jobs, NULL);
+    for (int w = 0; w < started; w++) pthread_join(workers[w], NULL);
+}
+
+static int join_stage(pthread_t thread, const char *name) {
+    int err = pthread_join(thread, NULL);
+    if (err) fprintf(stderr, "Failed to join the %s: %s\n", name, strerror(err));
+    return err != 0;
+}
+
+static void print_stage(const lsal_stage_t *s, double wall_ns) {
+    double capacity = wall_ns * s->threads;
+    fprintf(stderr, "%-8s %7d %8lu %7.1f%% %9.1f%% %9.1f%%\n", s->name, s->threads, (unsigned long) s->items,
+            100.0 * s->busy_ns / capacity, 100.0 * s->starved_ns / capacity, 100.0 * s->blocked_ns / capacity);
+}
+
+static void print_queue(const char *name, size_t capacity, const lsal_queue_stats_t *s) {
+    double mean = s->pushes ? (double) s->occupancy_sum / s->pushes : 0.0;
+    fprintf(stderr, "%-12s %8lu %8lu %9.1f %8lu %11lu %12lu\n", name, (unsigned long) capacity,
+            (unsigned long) s->pushes, mean, (unsigned long) s->occupancy_max,
+            (unsigned long) s->full_waits, (unsigned long) s->empty_waits);
+}
+
+int main(int argc, char **argv) {
+    lsal_pipeline_t p;
+    memset(&p, 0, sizeof(p));
+
+    if (argc == 3) {
+        p.in = strcmp(argv[2], "-") ? fopen(argv[2], "r") : stdin;
+        if (!p.in) {
+            perror(argv[2]);
+            return 1;
+        }
+    } else if (argc == 5) {
+        p.qlen = strtoull(argv[2], NULL, 10);
+        p.dlen = strtoull(argv[3], NULL, 10);
+        p.num_jobs = strtoull(argv[4], NULL, 10);
+    } else {
+        fprintf(stderr, "Usage: %s <num_workers> <input_file | ->\n", argv[0]);
+        fprintf(stderr, "       %s <num_workers> <query_length> <database_length> <num_jobs>\n", argv[0]);
+        return 1;
+    }
+
+    p.workers = atoi(argv[1]);
+    if (p.workers <= 0) {
+        fprintf(stderr, "The number of workers should be positive\n");
+        return 1;
+    }
+    p.out = stdout;
+
+    p.reader = (lsal_stage_t) { .name = "reader", .threads = 1 };
+    p.compute = (lsal_stage_t) { .name = "compute", .threads = p.workers };
+    p.writer = (lsal_stage_t) { .name = "writer", .threads = 1 };
+
+    p.results = calloc(p.workers, sizeof(lsal_spsc_t));
+    if (lsal_mpmc_init(&p.jobs, QUEUE_DEPTH) != 0 || !p.results) {
+        fprintf(stderr, "Failed to allocate the queues\n");
+        return 1;
+    }
+    for (int w = 0; w < p.workers; w++) {
+        if (lsal_spsc_init(&p.results[w], QUEUE_DEPTH / p.workers + 1) != 0) {
+            fprintf(stderr, "Failed to allocate the queues\n");
+            return 1;
+        }
+    }
+
+    pthread_t reader, writer, workers[p.workers];
+    lsal_worker_arg_t args[p.workers];
+
+    uint64_t start = lsal_now_ns();
+    int status = 0, err;
+
+    // The reader starts last: until it runs, the workers can only receive end markers
+    for (int w = 0; w < p.workers; w++) {
+        args[w] = (lsal_worker_arg_t) { &p, w };
+        if ((err = pthread_create(&workers[w], NULL, compute_stage, &args[w])) != 0) {
+            fprintf(stderr, "Failed to start worker %d: %s\n", w, strerror(err));
+            stop_workers(&p, workers, w);
+            return 1;
+        }
+    }
+    if ((err = pthread_create(&writer, NULL, writer_stage, &p)) != 0) {
+        fprintf(stderr, "Failed to start the writer: %s\n", strerror(err));
+        stop_workers(&p, workers, p.workers);
+        return 1;
+    }
+    if ((err = pthread_create(&reader, NULL, reader_stage, &p)) != 0) {
+        fprintf(stderr, "Failed to start the reader: %s\n", strerror(err));
+        for (int w = 0; w < p.workers; w++) lsal_mpmc_push(&p.jobs, NULL);
+        status = 1;
+    } else {
+        status |= join_stage(reader, "reader");
+    }
+
+    for (int w = 0; w < p.workers; w++) status |= join_stage(workers[w], "worker");
+    status |= join_stage(writer, "writer");
+
+    double wall_ns = (double) (lsal_now_ns() - start);
+
+    fprintf(stderr, "Execution Time: %lfs\n\n", wall_ns / 1e9);
+
+    fprintf(stderr, "stage    threads    items    busy  starved(in) blocked(out)\n");
+    print_stage(&p.reader, wall_ns);
+    print_stage(&p.compute, wall_ns);
+    print_stage(&p.writer, wall_ns);
+
+    fprintf(stderr, "\nqueue        capacity    items  mean occ  max occ  full waits  empty waits\n");
+    print_queue("jobs", p.jobs.mask + 1, &p.jobs.stats);
+    for (int w = 0; w < p.workers; w++) {
+        char name[32];
+        snprintf(name, sizeof(name), "results[%d]", w);
+        print_queue(name, p.results[w].mask + 1, &p.results[w].stats);
+    }
+
+    // The stage whose threads are busiest is the one holding the others back
+    const lsal_stage_t *stages[3] = { &p.reader, &p.compute, &p.writer };
+    const lsal_stage_t *bottleneck = stages[0];
+    for (int s = 1; s < 3; s++) {
+        if ((double) stages[s]->busy_ns / stages[s]->threads > (double) bottleneck->busy_ns / bottleneck->threads) {
+            bottleneck = stages[s];
+        }
+    }
+    fprintf(stderr, "\nBottleneck: %s (busy %.1f%%)\n", bottleneck->name,
+            100.0 * bottleneck->busy_ns / (wall_ns * bottleneck->threads));
+    if (p.failed_jobs) fprintf(stderr, "%lu jobs failed\n", (unsigned long) p.failed_jobs);
+
+    lsal_mpmc_destroy(&p.jobs);
+    for (int w = 0; w < p.workers; w++) lsal_spsc_destroy(&p.results[w]);
+    free(p.results);
+    if (p.in && p.in != stdin) fclose(p.in);
+
+    return status || p.failed_jobs ? 1 : 0;
+}
@@ -0,0 +1,245 @@
+#ifndef LSAL_QUEUE_H
+#define LSAL_QUEUE_H
+
+#include <time.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+
+/*
+ Bounded lock-free ring buffers of pointers for the pipeline stages.
+   lsal_spsc_t  one producer, one consumer (Lamport ring with cached indices)
+   lsal_mpmc_t  any number of producers and consumers (Vyukov's sequenced cells)
+ Capacities are rounded up to a power of two. The blocking push/pop spin, then yield,
+ while the ring is full/empty; that is the back-pressure between stages. Every queue keeps
+ counters of how often and how long its users had to wait, and of its occupancy.
+ */
+
+#define LSAL_CACHE_LINE 64
+#define LSAL_SPIN_LIMIT 256
+
+typedef struct {
+    _Atomic uint64_t pushes;
+    _Atomic uint64_t full_waits;     // pushes that found the ring full
+    _Atomic uint64_t empty_waits;    // pops that found the ring empty
+    _Atomic uint64_t full_ns;        // time producers spent waiting for room
+    _Atomic uint64_t empty_ns;       // time consumers spent waiting for items
+    _Atomic uint64_t occupancy_sum;  // items in the ring, sampled at every push
+    _Atomic uint64_t occupancy_max;
+} lsal_queue_stats_t;
+
+static inline uint64_t lsal_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+static inline size_t lsal_pow2_at_least(size_t n) {
+    size_t p = 2;
+    while (p < n) p <<= 1;
+    return p;
+}
+
+static inline void lsal_stats_occupancy(lsal_queue_stats_t *s, uint64_t occ) {
+    atomic_fetch_add_explicit(&s->pushes, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&s->occupancy_sum, occ, memory_order_relaxed);
+
+    uint64_t m = atomic_load_explicit(&s->occupancy_max, memory_order_relaxed);
+    while (occ > m && !atomic_compare_exchange_weak_explicit(&s->occupancy_max, &m, occ,
+                                                             memory_order_relaxed, memory_order_relaxed));
+}
+
+static inline void lsal_backoff(unsigned *spins) {
+    if (++*spins < LSAL_SPIN_LIMIT) {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    } else {
+        sched_yield();
+    }
+}
+
+/* ---------------------------------------------------------------- SPSC */
+
+typedef struct {
+    _Alignas(LSAL_CACHE_LINE) _Atomic size_t head;  // written by the producer
+    size_t tail_cache;                              // producer's last view of tail
+    _Alignas(LSAL_CACHE_LINE) _Atomic size_t tail;  // written by the consumer
+    size_t head_cache;                              // consumer's last view of head
+    _Alignas(LSAL_CACHE_LINE) size_t mask;
+    void **slots;
+    lsal_queue_stats_t stats;
+} lsal_spsc_t;
+
+static inline int lsal_spsc_init(lsal_spsc_t *q, size_t capacity) {
+    size_t cap = lsal_pow2_at_least(capacity);
+    q->slots = calloc(cap, sizeof(void *));
+    if (!q->slots) return -1;
+
+    q->mask = cap - 1;
+    atomic_init(&q->head, 0);
+    atomic_init(&q->tail, 0);
+    q->tail_cache = 0;
+    q->head_cache = 0;
+    return 0;
+}
+
+static inline void lsal_spsc_destroy(lsal_spsc_t *q) { free(q->slots); }
+
+static inline int lsal_spsc_try_push(lsal_spsc_t *q, void *item) {
+    size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    if (head - q->tail_cache > q->mask) {
+        q->tail_cache = atomic_load_explicit(&q->tail, memory_order_acquire);
+        if (head - q->tail_cache > q->mask) return 0;
+    }
+
+    q->slots[head & q->mask] = item;
+    atomic_store_explicit(&q->head, head + 1, memory_order_release);
+    lsal_stats_occupancy(&q->stats, head + 1 - q->tail_cache);
+    return 1;
+}
+
+static inline int lsal_spsc_try_pop(lsal_spsc_t *q, void **item) {
+    size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    if (tail == q->head_cache) {
+        q->head_cache = atomic_load_explicit(&q->head, memory_order_acquire);
+        if (tail == q->head_cache) return 0;
+    }
+
+    *item = q->slots[tail & q->mask];
+    atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+    return 1;
+}
+
+// Returns the nanoseconds spent waiting for room
+static inline uint64_t lsal_spsc_push(lsal_spsc_t *q, void *item) {
+    if (lsal_spsc_try_push(q, item)) return 0;
+
+    uint64_t start = lsal_now_ns();
+    unsigned spins = 0;
+    atomic_fetch_add_explicit(&q->stats.full_waits, 1, memory_order_relaxed);
+    while (!lsal_spsc_try_push(q, item)) lsal_backoff(&spins);
+
+    uint64_t waited = lsal_now_ns() - start;
+    atomic_fetch_add_explicit(&q->stats.full_ns, waited, memory_order_relaxed);
+    return waited;
+}
+
+// Returns the nanoseconds spent waiting for an item
+static inline uint64_t lsal_spsc_pop(lsal_spsc_t *q, void **item) {
+    if (lsal_spsc_try_pop(q, item)) return 0;
+
+    uint64_t start = lsal_now_ns();
+    unsigned spins = 0;
+    atomic_fetch_add_explicit(&q->stats.empty_waits, 1, memory_order_relaxed);
+    while (!lsal_spsc_try_pop(q, item)) lsal_backoff(&spins);
+
+    uint64_t waited = lsal_now_ns() - start;
+    atomic_fetch_add_explicit(&q->stats.empty_ns, waited, memory_order_relaxed);
+    return waited;
+}
+
+/* ---------------------------------------------------------------- MPMC */
+
+typedef struct {
+    _Atomic size_t seq;
+    void *item;
+} lsal_mpmc_cell_t;
+
+typedef struct {
+    _Alignas(LSAL_CACHE_LINE) _Atomic size_t enqueue_pos;
+    _Alignas(LSAL_CACHE_LINE) _Atomic size_t dequeue_pos;
+    _Alignas(LSAL_CACHE_LINE) size_t mask;
+    lsal_mpmc_cell_t *cells;
+    lsal_queue_stats_t stats;
+} lsal_mpmc_t;
+
+static inline int lsal_mpmc_init(lsal_mpmc_t *q, size_t capacity) {
+    size_t cap = lsal_pow2_at_least(capacity);
+    q->cells = malloc(cap * sizeof(lsal_mpmc_cell_t));
+    if (!q->cells) return -1;
+
+    for (size_t i = 0; i < cap; i++) atomic_init(&q->cells[i].seq, i);
+    q->mask = cap - 1;
+    atomic_init(&q->enqueue_pos, 0);
+    atomic_init(&q->dequeue_pos, 0);
+    return 0;
+}
+
+static inline void lsal_mpmc_destroy(lsal_mpmc_t *q) { free(q->cells); }
+
+static inline int lsal_mpmc_try_push(lsal_mpmc_t *q, void *item) {
+    size_t pos = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+    for (;;) {
+        lsal_mpmc_cell_t *cell = &q->cells[pos & q->mask];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t dif = (intptr_t) seq - (intptr_t) pos;
+
+        if (dif == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->enqueue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                cell->item = item;
+                atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+
+                size_t deq = atomic_load_explicit(&q->dequeue_pos, memory_order_relaxed);
+                lsal_stats_occupancy(&q->stats, pos + 1 > deq ? pos + 1 - deq : 0);
+                return 1;
+            }
+        } else if (dif < 0) {
+            return 0;
+        } else {
+            pos = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+        }
+    }
+}
+
+static inline int lsal_mpmc_try_pop(lsal_mpmc_t *q, void **item) {
+    size_t pos = atomic_load_explicit(&q->dequeue_pos, memory_order_relaxed);
+    for (;;) {
+        lsal_mpmc_cell_t *cell = &q->cells[pos & q->mask];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t dif = (intptr_t) seq - (intptr_t) (pos + 1);
+
+        if (dif == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->dequeue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                *item = cell->item;
+                atomic_store_explicit(&cell->seq, pos + q->mask + 1, memory_order_release);
+                return 1;
+            }
+        } else if (dif < 0) {
+            return 0;
+        } else {
+            pos = atomic_load_explicit(&q->dequeue_pos, memory_order_relaxed);
+        }
+    }
+}
+
+static inline uint64_t lsal_mpmc_push(lsal_mpmc_t *q, void *item) {
+    if (lsal_mpmc_try_push(q, item)) return 0;
+
+    uint64_t start = lsal_now_ns();
+    unsigned spins = 0;
+    atomic_fetch_add_explicit(&q->stats.full_waits, 1, memory_order_relaxed);
+    while (!lsal_mpmc_try_push(q, item)) lsal_backoff(&spins);
+
+    uint64_t waited = lsal_now_ns() - start;
+    atomic_fetch_add_explicit(&q->stats.full_ns, waited, memory_order_relaxed);
+    return waited;
+}
+
+static inline uint64_t lsal_mpmc_pop(lsal_mpmc_t *q, void **item) {
+    if (lsal_mpmc_try_pop(q, item)) return 0;
+
+    uint64_t start = lsal_now_ns();
+    unsigned spins = 0;
+    atomic_fetch_add_explicit(&q->stats.empty_waits, 1, memory_order_relaxed);
+    while (!lsal_mpmc_try_pop(q, item)) lsal_backoff(&spins);
+
+    uint64_t waited = lsal_now_ns() - start;
+    atomic_fetch_add_explicit(&q->stats.empty_ns, waited, memory_order_relaxed);
+    return waited;
+}
+
+#endif
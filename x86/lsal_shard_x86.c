@@ -0,0 +1,355 @@
+#include <time.h>
+#include <poll.h>
+#include <stdio.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+
+#include "lsal_x86.h"
+#include "lsal_alloc.h"
+
+#ifndef TEST
+#define TEST 0
+#endif
+
+#define TOP_HITS 10
+
+#define SHARD_MAGIC 0x4c53414cu
+#define SHARD_VERSION 1
+#define SHARD_MAX_WORKERS UINT16_MAX    // shard ids travel as 16 bits
+
+/*
+ The database is split into one shard per worker process. A shard owns a contiguous range of
+ database rows and computes it together with the 3N rows before it: a positive-scoring local
+ alignment against an N-long query spans fewer than 3N rows, so every alignment ending in the
+ owned range is found exactly. Only hits ending in the owned range are reported, so the
+ overlap never produces duplicates.
+
+ Result protocol, worker -> coordinator over a UNIX socket pair, host byte order:
+ one shard_header followed by header.count shard_hit records, best first.
+ */
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t shard;
+    uint32_t status;    // 0 on success, an errno value otherwise
+    uint32_t count;
+} shard_header;
+
+typedef struct {
+    int32_t score;
+    uint32_t col;
+    uint64_t row;       // global database row
+} shard_hit;
+
+typedef struct {
+    size_t own_start, own_end;
+    size_t win_start;
+} shard_plan;
+
+// Higher score first; equal scores in row-major order, like the kernels' max_idx
+static int hit_better(const shard_hit *a, const shard_hit *b) {
+    if (a->score != b->score) return a->score > b->score;
+    if (a->row != b->row) return a->row < b->row;
+    return a->col < b->col;
+}
+
+// Inserts h into the sorted list hits[0..*count), keeping at most TOP_HITS
+static void hit_insert(shard_hit *hits, uint32_t *count, const shard_hit *h) {
+    uint32_t pos = *count;
+    while (pos > 0 && hit_better(h, &hits[pos - 1])) pos--;
+    if (pos >= TOP_HITS) return;
+
+    uint32_t end = *count < TOP_HITS ? *count : TOP_HITS - 1;
+    memmove(&hits[pos + 1], &hits[pos], (end - pos) * sizeof(shard_hit));
+    hits[pos] = *h;
+    if (*count < TOP_HITS) (*count)++;
+}
+
+static int write_full(int fd, const void *buf, size_t len) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int read_full(int fd, void *buf, size_t len) {
+    char *p = buf;
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static void shard_plan_make(shard_plan *plan, int shards, size_t N, size_t M) {
+    size_t overlap = 3 * N;
+
+    for (int s = 0; s < shards; s++) {
+        plan[s].own_start = M * s / shards;
+        plan[s].own_end = M * (s + 1) / shards;
+        plan[s].win_start = plan[s].own_start > overlap ? plan[s].own_start - overlap : 0;
+    }
+}
+
+// Runs in the child: computes the shard window, reports its best row hits and exits
+static void shard_worker(char *q, char *d, size_t N, const shard_plan *plan, int shard, int fd) {
+    shard_header header = { SHARD_MAGIC, SHARD_VERSION, (uint16_t) shard, 0, 0 };
+    shard_hit hits[TOP_HITS];
+
+    size_t rows = plan->own_end - plan->win_start;
+    size_t cells;
+    lsal_arena_t arena = {0};
+    int *similarity = NULL;
+    char *direction = NULL;
+
+    if (lsal_size_mul(rows, N, &cells) &&
+        !lsal_arena_reserve(&arena, lsal_arena_bytes(cells, sizeof(int)) + lsal_arena_bytes(cells, sizeof(char)))) {
+        similarity = lsal_arena_alloc(&arena, cells, sizeof(int));
+        direction = lsal_arena_alloc(&arena, cells, sizeof(char));
+    }
+
+    if (!similarity || !direction) {
+        header.status = ENOMEM;
+        write_full(fd, &header, sizeof(header));
+        _exit(1);
+    }
+
+    size_t max_idx;
+    lsal_compute_matrices_o(q, d + plan->win_start, &max_idx, similarity, direction, N, rows);
+
+    // Best cell of every owned row, the first column on ties
+    for (size_t row = plan->own_start - plan->win_start; row < rows; row++) {
+        shard_hit h = { 0, 0, plan->win_start + row };
+        for (size_t col = 0; col < N; col++) {
+            if (similarity[row * N + col] > h.score) {
+                h.score = similarity[row * N + col];
+                h.col = (uint32_t) col;
+            }
+        }
+        if (h.score > 0) hit_insert(hits, &header.count, &h);
+    }
+
+    int err = write_full(fd, &header, sizeof(header)) || write_full(fd, hits, header.count * sizeof(shard_hit));
+    lsal_arena_release(&arena);
+    _exit(err ? 1 : 0);
+}
+
+// Kills and reaps the workers already forked when the rest cannot be started
+static void shard_abort(const pid_t *pid, const struct pollfd *fds, int started) {
+    for (int s = 0; s < started; s++) {
+        kill(pid[s], SIGKILL);
+        close(fds[s].fd);
+    }
+    for (int s = 0; s < started; s++) {
+        while (waitpid(pid[s], NULL, 0) < 0 && errno == EINTR) {}
+    }
+}
+
+/*
+ Forks one worker per shard, collects their hits as they arrive and merges them into the
+ global top hits. Returns the number of hits, or -1 if any worker failed or could not be
+ started; workers already running are then killed and reaped first.
+ */
+int lsal_shard_search(char *q, char *d, size_t N, size_t M, int workers, shard_hit *top) {
+    if (workers <= 0 || workers > SHARD_MAX_WORKERS) {
+        fprintf(stderr, "The worker count should be between 1 and %d\n", SHARD_MAX_WORKERS);
+        return -1;
+    }
+    if ((size_t) workers > M) workers = M > 0 ? (int) M : 1;
+
+    shard_plan plan[workers];
+    pid_t pid[workers];
+    struct pollfd fds[workers];
+    shard_plan_make(plan, workers, N, M);
+
+    fflush(stdout);
+    for (int s = 0; s < workers; s++) {
+        int sv[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) {
+            perror("socketpair");
+            shard_abort(pid, fds, s);
+            return -1;
+        }
+
+        pid[s] = fork();
+        if (pid[s] == 0) {
+            close(sv[0]);
+            for (int o = 0; o < s; o++) close(fds[o].fd);
+            shard_worker(q, d, N, &plan[s], s, sv[1]);
+        }
+
+        close(sv[1]);
+        if (pid[s] < 0) {
+            perror("fork");
+            close(sv[0]);
+            shard_abort(pid, fds, s);
+            return -1;
+        }
+
+        fds[s].fd = sv[0];
+        fds[s].events = POLLIN;
+    }
+
+    uint32_t count = 0;
+    int failed = 0, pending = workers;
+
+    while (pending > 0) {
+        if (poll(fds, workers, -1) < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            failed = 1;
+            break;
+        }
+
+        for (int s = 0; s < workers; s++) {
+            if (fds[s].fd < 0 || !fds[s].revents) continue;
+
+            shard_header header;
+            shard_hit hits[TOP_HITS];
+            if (read_full(fds[s].fd, &header, sizeof(header)) || header.magic != SHARD_MAGIC ||
+                header.version != SHARD_VERSION || header.shard != s || header.count > TOP_HITS ||
+                read_full(fds[s].fd, hits, header.count * sizeof(shard_hit))) {
+                fprintf(stderr, "Shard %d: malformed or missing result\n", s);
+                failed = 1;
+            } else if (header.status != 0) {
+                fprintf(stderr, "Shard %d: %s\n", s, strerror(header.status));
+                failed = 1;
+            } else {
+                for (uint32_t i = 0; i < header.count; i++) hit_insert(top, &count, &hits[i]);
+            }
+
+            close(fds[s].fd);
+            fds[s].fd = -1;
+            pending--;
+        }
+    }
+
+    for (int s = 0; s < workers; s++) {
+        if (fds[s].fd >= 0) close(fds[s].fd);
+
+        int status;
+        if (waitpid(pid[s], &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "Shard %d: worker did not exit cleanly\n", s);
+            failed = 1;
+        }
+    }
+
+    return failed ? -1 : (int) count;
+}
+
+void init_random_buf(char *buf, size_t n) {
+    static const char *choices = "ATGC";
+
+    for (size_t i = 0; i < n; i++) {
+        buf[i] = choices[rand() % 4];
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc != 4) {
+        fprintf(stderr, "Usage: %s <query_length> <database_length> <num_workers>\n", argv[0]);
+        return 1;
+    }
+
+    size_t qlen = strtoull(argv[1], NULL, 10);
+    size_t dlen = strtoull(argv[2], NULL, 10);
+    long workers = strtol(argv[3], NULL, 10);
+    if (qlen == 0 || dlen == 0 || workers <= 0) {
+        fprintf(stderr, "Lengths and worker count should be positive numbers\n");
+        return 1;
+    }
+    if (workers > SHARD_MAX_WORKERS) {
+        fprintf(stderr, "At most %d workers, shard ids are 16 bits\n", SHARD_MAX_WORKERS);
+        return 1;
+    }
+
+    // The database lives in a shared mapping, the workers read it in place
+    char *q = calloc(qlen + 1, sizeof(char));
+    char *d = mmap(NULL, dlen + 1, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (d == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+
+    init_random_buf(q, qlen);
+    init_random_buf(d, dlen);
+    d[dlen] = '\0';
+
+    shard_hit top[TOP_HITS];
+    int count;
+
+    #if TEST == 0
+    size_t num_iter = 10;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (size_t i = 0; i < num_iter; i++)
+    #endif
+
+        count = lsal_shard_search(q, d, qlen, dlen, workers, top);
+
+    #if TEST == 0
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double total_time_secs = ((end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9) / num_iter;
+    #endif
+
+    if (count < 0) {
+        fprintf(stderr, "Sharded search failed\n");
+        return 1;
+    }
+
+    #if TEST
+    printf("Top hits:\n");
+    for (int i = 0; i < count; i++) {
+        printf("%2d: score %d at (%lu, %u)\n", i, top[i].score, (unsigned long) top[i].row, top[i].col);
+    }
+
+    // Compare against a single process over the whole database
+    size_t cells = qlen * dlen, max_idx;
+    lsal_arena_t arena = {0};
+    if (lsal_arena_reserve(&arena, lsal_arena_bytes(cells, sizeof(int)) + lsal_arena_bytes(cells, sizeof(char)))) {
+        fprintf(stderr, "Failed to map %lu cells\n", cells);
+        return 1;
+    }
+    int *similarity = lsal_arena_alloc(&arena, cells, sizeof(int));
+    char *direction = lsal_arena_alloc(&arena, cells, sizeof(char));
+
+    lsal_compute_matrices_o(q, d, &max_idx, similarity, direction, qlen, dlen);
+
+    printf("Single process: score %d at (%lu, %lu)\n", similarity[max_idx], max_idx / qlen, max_idx % qlen);
+    if (count > 0 && (size_t) top[0].row * qlen + top[0].col == max_idx && top[0].score == similarity[max_idx]) {
+        printf("RESULTS CORRECT\n");
+    } else {
+        printf("Error, mismatch between sharded and single-process results\n");
+    }
+
+    lsal_arena_release(&arena);
+    #endif
+
+    #if TEST == 0
+    printf("Execution Time: %lfs\n", total_time_secs);
+    if (count > 0) {
+        printf("Best hit: score %d at (%lu, %u)\n", top[0].score, (unsigned long) top[0].row, top[0].col);
+    }
+    #endif
+
+    munmap(d, dlen + 1);
+    free(q);
+
+    return 0;
+}
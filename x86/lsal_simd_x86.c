@@ -0,0 +1,485 @@
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lsal_x86.h"
+#include "lsal_alloc.h"
+#include <immintrin.h>
+
+#ifndef __AVX2__
+#error "lsal_simd_x86.c needs AVX2, compile with -mavx2"
+#endif
+
+#ifndef TEST
+#define TEST 0
+#endif
+
+// Widest stripe: 32 int8 lanes in a 256-bit register
+#define STRIPE_WIDTH 32
+
+static const int match = 2;
+static const int mismatch = -1;
+static const int gap_row = -1;
+static const int gap_col = -1;
+
+static inline int max(int a, int b) { return a > b ? a : b; }
+static inline int min(int a, int b) { return a < b ? a : b; }
+
+// Number of stripes that finished at each precision (int8, int16, int32) during the calling thread's last call
+__thread size_t stripe_count[3];
+
+/*
+ The query is split into stripes of columns. Each stripe is swept over the whole database in
+ anti-diagonal order with one query column per vector lane, the left neighbour column being
+ read back from the similarity matrix. Stripes start in saturating int8; when a lane hits the
+ type maximum the stripe is discarded and rerun as narrower stripes with wider lanes
+ (int8 -> int16 -> int32), so only the affected columns pay for the extra precision.
+ */
+
+static inline __attribute__((always_inline)) __m256i v_set1(int x, const int w) {
+    switch (w) {
+    case 1: return _mm256_set1_epi8((char) x);
+    case 2: return _mm256_set1_epi16((short) x);
+    default: return _mm256_set1_epi32(x);
+    }
+}
+
+static inline __attribute__((always_inline)) __m256i v_adds(__m256i a, __m256i b, const int w) {
+    switch (w) {
+    case 1: return _mm256_adds_epi8(a, b);
+    case 2: return _mm256_adds_epi16(a, b);
+    default: return _mm256_add_epi32(a, b);
+    }
+}
+
+static inline __attribute__((always_inline)) __m256i v_max(__m256i a, __m256i b, const int w) {
+    switch (w) {
+    case 1: return _mm256_max_epi8(a, b);
+    case 2: return _mm256_max_epi16(a, b);
+    default: return _mm256_max_epi32(a, b);
+    }
+}
+
+static inline __attribute__((always_inline)) __m256i v_cmpgt(__m256i a, __m256i b, const int w) {
+    switch (w) {
+    case 1: return _mm256_cmpgt_epi8(a, b);
+    case 2: return _mm256_cmpgt_epi16(a, b);
+    default: return _mm256_cmpgt_epi32(a, b);
+    }
+}
+
+static inline __attribute__((always_inline)) __m256i v_cmpeq(__m256i a, __m256i b, const int w) {
+    switch (w) {
+    case 1: return _mm256_cmpeq_epi8(a, b);
+    case 2: return _mm256_cmpeq_epi16(a, b);
+    default: return _mm256_cmpeq_epi32(a, b);
+    }
+}
+
+// Move every lane one position up (lane i takes lane i - 1) and put x into lane 0
+static inline __attribute__((always_inline)) __m256i v_shift_in(__m256i v, int x, const int w) {
+    __m256i lo = _mm256_permute2x128_si256(v, v, 0x08);
+    __m256i s;
+    switch (w) {
+    case 1: s = _mm256_alignr_epi8(v, lo, 15); break;
+    case 2: s = _mm256_alignr_epi8(v, lo, 14); break;
+    default: s = _mm256_alignr_epi8(v, lo, 12); break;
+    }
+    return _mm256_or_si256(s, _mm256_zextsi128_si256(_mm_cvtsi32_si128(x)));
+}
+
+// Widen consecutive database bytes to one character per lane
+static inline __attribute__((always_inline)) __m256i v_load_chars(const char *p, const int w) {
+    switch (w) {
+    case 1: return _mm256_loadu_si256((const __m256i *) p);
+    case 2: return _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) p));
+    default: return _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) p));
+    }
+}
+
+static inline __attribute__((always_inline)) int lane_get(const void *buf, int lane, const int w) {
+    switch (w) {
+    case 1: return ((const signed char *) buf)[lane];
+    case 2: return ((const short *) buf)[lane];
+    default: return ((const int *) buf)[lane];
+    }
+}
+
+static inline __attribute__((always_inline)) void lane_set(void *buf, int lane, int x, const int w) {
+    switch (w) {
+    case 1: ((signed char *) buf)[lane] = (signed char) x; break;
+    case 2: ((short *) buf)[lane] = (short) x; break;
+    default: ((int *) buf)[lane] = x; break;
+    }
+}
+
+/*
+ Computes columns [c0, c0 + width) of the matrices with lanes of w bytes.
+ drev holds the database reversed and padded with STRIPE_WIDTH zeros on both sides, so the
+ characters of one anti-diagonal are contiguous. Returns 1 if the lanes saturated, in which
+ case nothing but the matrices was touched and the stripe has to be recomputed.
+ */
+static inline __attribute__((always_inline)) int lsal_stripe(const char *q, const char *drev, size_t c0, size_t width,
+        int *similarity, char *direction, size_t N, size_t M, int *stripe_max, size_t *stripe_max_idx, const int w)
+{
+    const int lanes = 32 / w;
+    const int sat = (w == 1) ? 127 : (w == 2) ? 32767 : 0x7fffffff;
+
+    // The left neighbour column has to fit in the lanes before we start
+    if (c0 > 0 && w < 4) {
+        for (size_t row = 0; row < M; row++) {
+            if (similarity[row * N + c0 - 1] >= sat) return 1;
+        }
+    }
+
+    _Alignas(32) char hbuf[32], dbuf[32], qbuf[32], lbuf[32];
+    int lane_max[32];
+    size_t lane_row[32];
+
+    for (int lane = 0; lane < lanes; lane++) {
+        lane_set(qbuf, lane, (lane < (int) width) ? (unsigned char) q[c0 + lane] : 0xff, w);
+        lane_set(lbuf, lane, lane, w);
+        lane_max[lane] = 0;
+        lane_row[lane] = 0;
+    }
+
+    __m256i qv = _mm256_load_si256((const __m256i *) qbuf);
+    __m256i lane_idx = _mm256_load_si256((const __m256i *) lbuf);
+
+    // Lanes past the end of the stripe never feed anything and are kept out of the maxima
+    __m256i col_mask = v_cmpgt(v_set1((int) width, w), lane_idx, w);
+
+    const __m256i v_zero = _mm256_setzero_si256();
+    const __m256i v_match = v_set1(match, w);
+    const __m256i v_mismatch = v_set1(mismatch, w);
+    const __m256i v_gap_row = v_set1(gap_row, w);
+    const __m256i v_gap_col = v_set1(gap_col, w);
+    const __m256i v_dir_none = v_set1('-', w);
+    const __m256i v_dir_d = v_set1('D', w);
+    const __m256i v_dir_u = v_set1('U', w);
+    const __m256i v_dir_l = v_set1('L', w);
+
+    __m256i prev_1 = v_zero, prev_2 = v_zero;
+    __m256i v_lane_max = v_zero;
+
+    size_t rounds = M + width - 1;
+    for (size_t round = 0; round < rounds; round++) {
+        // Lane i holds row (round - i); rows outside [0, M) are forced to zero
+        int hi = round < (size_t) lanes ? (int) round : lanes;
+        int lo = round >= M ? (int) (round - M) : -1;
+        __m256i valid = _mm256_andnot_si256(v_cmpgt(lane_idx, v_set1(hi, w), w),
+                                            v_cmpgt(lane_idx, v_set1(lo, w), w));
+
+        int left = (c0 > 0 && round < M) ? similarity[round * N + c0 - 1] : 0;
+        int diag = (c0 > 0 && round > 0 && round - 1 < M) ? similarity[(round - 1) * N + c0 - 1] : 0;
+
+        __m256i dv = v_load_chars(drev + M - 1 + STRIPE_WIDTH - round, w);
+        __m256i score = _mm256_blendv_epi8(v_mismatch, v_match, v_cmpeq(dv, qv, w));
+
+        __m256i D = v_adds(v_shift_in(prev_2, diag, w), score, w);
+        __m256i U = v_adds(prev_1, v_gap_row, w);
+        __m256i L = v_adds(v_shift_in(prev_1, left, w), v_gap_col, w);
+
+        // Same precedence as the scalar kernels: strictly greater wins, D before U before L
+        __m256i best = v_max(D, v_zero, w);
+        __m256i dir = _mm256_blendv_epi8(v_dir_none, v_dir_d, v_cmpgt(D, v_zero, w));
+        dir = _mm256_blendv_epi8(dir, v_dir_u, v_cmpgt(U, best, w));
+        best = v_max(best, U, w);
+        dir = _mm256_blendv_epi8(dir, v_dir_l, v_cmpgt(L, best, w));
+        best = v_max(best, L, w);
+
+        __m256i H = _mm256_and_si256(best, valid);
+        __m256i Hc = _mm256_and_si256(H, col_mask);
+
+        _mm256_store_si256((__m256i *) hbuf, H);
+        _mm256_store_si256((__m256i *) dbuf, dir);
+
+        unsigned int improved = (unsigned int) _mm256_movemask_epi8(v_cmpgt(Hc, v_lane_max, w));
+        while (improved) {
+            int lane = __builtin_ctz(improved) / w;
+            lane_max[lane] = lane_get(hbuf, lane, w);
+            lane_row[lane] = round - lane;
+            improved &= ~(((1u << w) - 1) << (lane * w));
+        }
+        v_lane_max = v_max(v_lane_max, Hc, w);
+
+        size_t first = round >= M ? round - M + 1 : 0;
+        size_t last = round < width - 1 ? round : width - 1;
+        for (size_t lane = first; lane <= last; lane++) {
+            size_t idx = (round - lane) * N + c0 + lane;
+            similarity[idx] = lane_get(hbuf, (int) lane, w);
+            direction[idx] = dbuf[lane * w];
+        }
+
+        prev_2 = prev_1;
+        prev_1 = H;
+    }
+
+    int best = 0;
+    size_t best_idx = 0;
+    for (int lane = 0; lane < (int) width; lane++) {
+        if (w < 4 && lane_max[lane] >= sat) return 1;
+
+        size_t idx = lane_row[lane] * N + c0 + lane;
+        if (lane_max[lane] > best || (lane_max[lane] == best && best > 0 && idx < best_idx)) {
+            best = lane_max[lane];
+            best_idx = idx;
+        }
+    }
+
+    *stripe_max = best;
+    *stripe_max_idx = best_idx;
+    return 0;
+}
+
+static int lsal_stripe_i8(const char *q, const char *drev, size_t c0, size_t width, int *similarity, char *direction,
+        size_t N, size_t M, int *stripe_max, size_t *stripe_max_idx) {
+    return lsal_stripe(q, drev, c0, width, similarity, direction, N, M, stripe_max, stripe_max_idx, 1);
+}
+
+static int lsal_stripe_i16(const char *q, const char *drev, size_t c0, size_t width, int *similarity, char *direction,
+        size_t N, size_t M, int *stripe_max, size_t *stripe_max_idx) {
+    return lsal_stripe(q, drev, c0, width, similarity, direction, N, M, stripe_max, stripe_max_idx, 2);
+}
+
+static int lsal_stripe_i32(const char *q, const char *drev, size_t c0, size_t width, int *similarity, char *direction,
+        size_t N, size_t M, int *stripe_max, size_t *stripe_max_idx) {
+    return lsal_stripe(q, drev, c0, width, similarity, direction, N, M, stripe_max, stripe_max_idx, 4);
+}
+
+/*
+ Runs one stripe at the given precision level (0: int8, 1: int16, 2: int32), splitting it into
+ narrower stripes at the next level when it saturates.
+ */
+static void lsal_stripe_promote(const char *q, const char *drev, size_t c0, size_t width, int *similarity, char *direction,
+        size_t N, size_t M, int level, int *max_similarity, size_t *max_idx)
+{
+    int stripe_max = 0;
+    size_t stripe_max_idx = 0;
+    int saturated;
+
+    if (level == 0) saturated = lsal_stripe_i8(q, drev, c0, width, similarity, direction, N, M, &stripe_max, &stripe_max_idx);
+    else if (level == 1) saturated = lsal_stripe_i16(q, drev, c0, width, similarity, direction, N, M, &stripe_max, &stripe_max_idx);
+    else saturated = lsal_stripe_i32(q, drev, c0, width, similarity, direction, N, M, &stripe_max, &stripe_max_idx);
+
+    if (saturated) {
+        size_t sub = STRIPE_WIDTH >> (level + 1);
+        for (size_t c = c0; c < c0 + width; c += sub) {
+            size_t sub_width = (c0 + width - c < sub) ? c0 + width - c : sub;
+            lsal_stripe_promote(q, drev, c, sub_width, similarity, direction, N, M, level + 1, max_similarity, max_idx);
+        }
+        return;
+    }
+
+    stripe_count[level]++;
+
+    if (stripe_max > *max_similarity || (stripe_max == *max_similarity && stripe_max > 0 && stripe_max_idx < *max_idx)) {
+        *max_similarity = stripe_max;
+        *max_idx = stripe_max_idx;
+    }
+}
+
+// Returns 0, or -1 with the matrices untouched when the scratch row cannot be mapped
+int lsal_compute_matrices_simd(const char *q, const char *d, size_t *max_idx, int *similarity, char *direction, size_t N, size_t M) {
+    int max_similarity = 0;
+    *max_idx = 0;
+
+    memset(stripe_count, 0, sizeof(stripe_count));
+
+    // Reversed database with zero padding, so that d[round - lane] is a contiguous load.
+    // Every thread keeps its own scratch arena between calls, only remapped when M grows.
+    static __thread lsal_arena_t scratch;
+    size_t scratch_bytes = lsal_arena_bytes(M + 2 * STRIPE_WIDTH, sizeof(char));
+    if (!scratch_bytes || lsal_arena_reserve(&scratch, scratch_bytes)) return -1;
+
+    char *drev = lsal_arena_alloc(&scratch, M + 2 * STRIPE_WIDTH, sizeof(char));
+    memset(drev, 0, STRIPE_WIDTH);
+    memset(drev + STRIPE_WIDTH + M, 0, STRIPE_WIDTH);
+    for (size_t row = 0; row < M; row++) {
+        drev[STRIPE_WIDTH + M - 1 - row] = d[row];
+    }
+
+    for (size_t c0 = 0; c0 < N; c0 += STRIPE_WIDTH) {
+        size_t width = (N - c0 < STRIPE_WIDTH) ? N - c0 : STRIPE_WIDTH;
+        lsal_stripe_promote(q, drev, c0, width, similarity, direction, N, M, 0, &max_similarity, max_idx);
+    }
+    return 0;
+}
+
+// Build with -DLSAL_NO_MAIN to link the kernel into another driver
+#ifndef LSAL_NO_MAIN
+
+void lsal_print_similarity(const char *q, const char *d, int *similarity) {
+    size_t N = strlen(q);
+    size_t M = strlen(d);
+
+    printf("\n   |");
+    for (size_t j = 0; j < N; j++) {
+        printf("%3c ", q[j]);
+    }
+    printf("\n---+");
+    for (size_t j = 0; j < N; j++) {
+        printf("----");
+    }
+    printf("\n");
+
+    for (size_t i = 0; i < M; i++) {
+        printf("%2c |", d[i]);
+        for (size_t j = 0; j < N; j++) {
+            printf("%3d ", similarity[i * N + j]);
+        }
+        printf("\n");
+    }
+}
+
+void lsal_print_direction(const char *q, const char *d, char *direction) {
+    size_t N = strlen(q);
+    size_t M = strlen(d);
+
+    printf("\n   |");
+    for (size_t j = 0; j < N; j++) {
+        printf("%3c ", q[j]);
+    }
+    printf("\n---+");
+    for (size_t j = 0; j < N; j++) {
+        printf("----");
+    }
+    printf("\n");
+
+    for (size_t i = 0; i < M; i++) {
+        printf("%2c |", d[i]);
+        for (size_t j = 0; j < N; j++) {
+            printf("%3c ", direction[i * N + j]);
+        }
+        printf("\n");
+    }
+}
+
+void lsal_traceback(const char *q, const char *d, int *similarity, char *direction, size_t max_idx) {
+    size_t N = strlen(q);
+
+    char aligned_d[512], aligned_q[512];
+    int strpos = 511;
+    aligned_d[strpos] = '\0';
+    aligned_q[strpos] = '\0';
+    strpos--;
+
+    int idx = max_idx;
+    int row = idx / N;
+    int col = idx % N;
+
+    while (row >= 0 && col >= 0 && similarity[idx] > 0) {
+        if (direction[idx] == 'D') {
+            aligned_q[strpos] = q[col];
+            aligned_d[strpos] = d[row];
+            row--; col--;
+        } else if (direction[idx] == 'U') {
+            aligned_q[strpos] = '-';
+            aligned_d[strpos] = d[row];
+            row--;
+        } else if (direction[idx] == 'L') {
+            aligned_q[strpos] = q[col];
+            aligned_d[strpos] = '-';
+            col--;
+        }
+
+        idx = row * N + col;
+        strpos--;
+    }
+
+    printf("\nAligned Sequences:\n");
+    printf("Q: %s\n", &aligned_q[strpos + 1]);
+    printf("D: %s\n", &aligned_d[strpos + 1]);
+}
+
+void init_random_buf(char *buf, size_t n) {
+    static const char *choices = "ATGC";
+
+    for (size_t i = 0; i < n; i++) {
+        buf[i] = choices[rand() % 4];
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s <query_length> <database_length>\n", argv[0]);
+        return 1;
+    }
+
+    size_t qlen = strtoull(argv[1], NULL, 10);
+    size_t dlen = strtoull(argv[2], NULL, 10);
+
+    char *q = calloc(qlen + 1, sizeof(char));
+    char *d = calloc(dlen + 1, sizeof(char));
+
+    init_random_buf(q, qlen);
+    init_random_buf(d, dlen);
+
+
+    size_t cells;
+    if (!lsal_size_mul(qlen, dlen, &cells)) {
+        fprintf(stderr, "Matrix of %lu x %lu cells is too large\n", qlen, dlen);
+        return 1;
+    }
+
+    // The kernels write every cell, so the matrices are left uninitialized
+    lsal_arena_t arena = {0};
+    if (lsal_arena_reserve(&arena, lsal_arena_bytes(cells, sizeof(int)) + lsal_arena_bytes(cells, sizeof(char)))) {
+        fprintf(stderr, "Failed to map %lu cells\n", cells);
+        return 1;
+    }
+
+    int *similarity = lsal_arena_alloc(&arena, cells, sizeof(int));
+    char *direction = lsal_arena_alloc(&arena, cells, sizeof(char));
+    if (!similarity || !direction) {
+        fprintf(stderr, "Failed to allocate %lu cells\n", cells);
+        return 1;
+    }
+
+    size_t max_idx;
+
+    #if TEST
+    printf("Q: %s\nD: %s\n\n", q, d);
+    #endif
+
+    #if TEST == 0
+    size_t num_iter = 10;
+    double total_time = lsal_wall_seconds();
+
+    for (size_t i = 0; i < num_iter; i++)
+    #endif
+
+        if (lsal_compute_matrices_simd(q, d, &max_idx, similarity, direction, qlen, dlen)) {
+            fprintf(stderr, "Failed to map the database scratch row\n");
+            return 1;
+        }
+
+    #if TEST == 0
+    // Wall-clock seconds per call; clock() counted CPU time and divided it in whole ticks
+    double total_time_secs = (lsal_wall_seconds() - total_time) / num_iter;
+    #endif
+
+    #if TEST
+    printf("Max score at: (%lu, %lu)\n", max_idx / qlen, max_idx % qlen);
+
+    lsal_print_similarity(q, d, similarity);
+    lsal_print_direction(q, d, direction);
+
+    lsal_traceback(q, d, similarity, direction, max_idx);
+    #endif
+
+    #if TEST == 0
+    printf("Execution Time: %lfs\n", total_time_secs);
+    #endif
+
+    printf("Stripes int8/int16/int32: %lu/%lu/%lu\n", stripe_count[0], stripe_count[1], stripe_count[2]);
+
+    lsal_arena_release(&arena);
+    free(q);
+    free(d);
+
+    return 0;
+}
+
+#endif
@@ -0,0 +1,228 @@
+#ifndef LSAL_TRACE_H
+#define LSAL_TRACE_H
+
+#include <time.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+
+/*
+ Timeline of the OpenMP wavefront: when every thread computed which tile and how long it then
+ waited at the end-of-round barrier. Each thread appends to its own ring, so recording is a
+ plain store plus a release of the ring's head, with no lock or shared cache line between the
+ threads. A full ring overwrites its oldest events. The trace can be written in the Chrome
+ trace event format (chrome://tracing, ui.perfetto.dev) and summarised per round.
+ */
+
+#ifndef LSAL_TRACE_EVENTS
+#define LSAL_TRACE_EVENTS 65536     // events kept per thread, a power of two
+#endif
+
+#define LSAL_TRACE_TILE 0
+#define LSAL_TRACE_BARRIER 1
+
+typedef struct {
+    uint64_t start_ns, end_ns;
+    int32_t kind;           // LSAL_TRACE_*
+    int32_t round;
+    int32_t tile_row, tile_col;     // -1 for barriers
+} lsal_trace_event_t;
+
+typedef struct {
+    _Atomic uint64_t head;          // events ever recorded
+    lsal_trace_event_t *events;
+} __attribute__((aligned(64))) lsal_trace_ring_t;
+
+typedef struct {
+    int num_threads;
+    uint64_t epoch_ns;              // timestamps are written relative to this
+    lsal_trace_ring_t *rings;
+} lsal_trace_t;
+
+static inline uint64_t lsal_trace_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+static inline void lsal_trace_free(lsal_trace_t *trace) {
+    if (!trace) return;
+    for (int t = 0; t < trace->num_threads; t++) free(trace->rings[t].events);
+    free(trace->rings);
+    free(trace);
+}
+
+static inline lsal_trace_t *lsal_trace_create(int num_threads) {
+    lsal_trace_t *trace = calloc(1, sizeof(lsal_trace_t));
+    if (!trace) return NULL;
+
+    trace->num_threads = num_threads;
+    trace->epoch_ns = lsal_trace_now();
+    trace->rings = aligned_alloc(64, sizeof(lsal_trace_ring_t) * num_threads);
+    if (!trace->rings) {
+        free(trace);
+        return NULL;
+    }
+
+    for (int t = 0; t < num_threads; t++) {
+        atomic_init(&trace->rings[t].head, 0);
+        trace->rings[t].events = malloc(sizeof(lsal_trace_event_t) * LSAL_TRACE_EVENTS);
+    }
+    for (int t = 0; t < num_threads; t++) {
+        if (!trace->rings[t].events) {
+            lsal_trace_free(trace);
+            return NULL;
+        }
+    }
+    return trace;
+}
+
+// Called by thread tid only
+static inline void lsal_trace_record(lsal_trace_t *trace, int tid, int kind, int round, int tile_row, int tile_col,
+                                     uint64_t start_ns, uint64_t end_ns) {
+    if (tid >= trace->num_threads) return;
+
+    lsal_trace_ring_t *ring = &trace->rings[tid];
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    lsal_trace_event_t *e = &ring->events[head & (LSAL_TRACE_EVENTS - 1)];
+
+    e->start_ns = start_ns;
+    e->end_ns = end_ns;
+    e->kind = kind;
+    e->round = round;
+    e->tile_row = tile_row;
+    e->tile_col = tile_col;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+// Oldest event still in thread t's ring and the count after it; returns the events lost
+static inline uint64_t lsal_trace_span(const lsal_trace_t *trace, int t, uint64_t *first, uint64_t *count) {
+    uint64_t head = atomic_load_explicit(&trace->rings[t].head, memory_order_acquire);
+    *count = head < LSAL_TRACE_EVENTS ? head : LSAL_TRACE_EVENTS;
+    *first = head - *count;
+    return *first;
+}
+
+static inline int lsal_trace_write_chrome(const lsal_trace_t *trace, const char *path) {
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+
+    fprintf(f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    fprintf(f, "  {\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": 0, \"args\": {\"name\": \"lsal_omp wavefront\"}}");
+
+    for (int t = 0; t < trace->num_threads; t++) {
+        uint64_t first, count;
+        uint64_t dropped = lsal_trace_span(trace, t, &first, &count);
+        if (!count) continue;
+
+        fprintf(f, ",\n  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": %d, \"args\": {\"name\": \"thread %d\"}}",
+                t, t);
+        if (dropped) {
+            fprintf(f, ",\n  {\"name\": \"%lu events dropped\", \"ph\": \"i\", \"s\": \"t\", \"pid\": 0, \"tid\": %d, \"ts\": 0}",
+                    dropped, t);
+        }
+
+        for (uint64_t i = first; i < first + count; i++) {
+            const lsal_trace_event_t *e = &trace->rings[t].events[i & (LSAL_TRACE_EVENTS - 1)];
+            double ts = (e->start_ns - trace->epoch_ns) / 1e3, dur = (e->end_ns - e->start_ns) / 1e3;
+
+            if (e->kind == LSAL_TRACE_TILE) {
+                fprintf(f, ",\n  {\"name\": \"tile %d,%d\", \"cat\": \"tile\", \"ph\": \"X\", \"pid\": 0, \"tid\": %d, "
+                        "\"ts\": %.3f, \"dur\": %.3f, \"args\": {\"round\": %d, \"tile_row\": %d, \"tile_col\": %d}}",
+                        e->tile_row, e->tile_col, t, ts, dur, e->round, e->tile_row, e->tile_col);
+            } else {
+                fprintf(f, ",\n  {\"name\": \"barrier\", \"cat\": \"wait\", \"ph\": \"X\", \"pid\": 0, \"tid\": %d, "
+                        "\"ts\": %.3f, \"dur\": %.3f, \"args\": {\"round\": %d}}", t, ts, dur, e->round);
+            }
+        }
+    }
+
+    fprintf(f, "\n]}\n");
+    fclose(f);
+    return 0;
+}
+
+/*
+ Idle time per round, added up over every kernel call in the trace. A thread's share of a
+ round is its tile time plus its barrier wait; the wait is idle. A thread without a tile in
+ the round spends all of it at the barrier. Prints every round, or the worst ones by idle
+ time when there are many, and the totals.
+ */
+static inline void lsal_trace_summary(const lsal_trace_t *trace, FILE *out) {
+    int rounds = 0;
+    uint64_t dropped = 0;
+
+    for (int t = 0; t < trace->num_threads; t++) {
+        uint64_t first, count;
+        dropped += lsal_trace_span(trace, t, &first, &count);
+        for (uint64_t i = first; i < first + count; i++) {
+            const lsal_trace_event_t *e = &trace->rings[t].events[i & (LSAL_TRACE_EVENTS - 1)];
+            if (e->round + 1 > rounds) rounds = e->round + 1;
+        }
+    }
+    if (!rounds) return;
+
+    uint64_t *busy = calloc(rounds, sizeof(uint64_t));
+    uint64_t *idle = calloc(rounds, sizeof(uint64_t));
+    int *tiles = calloc(rounds, sizeof(int));
+    int *order = malloc(sizeof(int) * rounds);
+
+    for (int t = 0; t < trace->num_threads; t++) {
+        uint64_t first, count;
+        lsal_trace_span(trace, t, &first, &count);
+        for (uint64_t i = first; i < first + count; i++) {
+            const lsal_trace_event_t *e = &trace->rings[t].events[i & (LSAL_TRACE_EVENTS - 1)];
+            if (e->kind == LSAL_TRACE_TILE) {
+                busy[e->round] += e->end_ns - e->start_ns;
+                tiles[e->round]++;
+            } else {
+                idle[e->round] += e->end_ns - e->start_ns;
+            }
+        }
+    }
+
+    // Worst rounds first when there are too many to list
+    int shown = rounds <= 32 ? rounds : 16;
+    for (int r = 0; r < rounds; r++) order[r] = r;
+    if (shown < rounds) {
+        for (int i = 0; i < shown; i++) {
+            for (int j = i + 1; j < rounds; j++) {
+                if (idle[order[j]] > idle[order[i]]) {
+                    int tmp = order[i];
+                    order[i] = order[j];
+                    order[j] = tmp;
+                }
+            }
+        }
+    }
+
+    uint64_t total_busy = 0, total_idle = 0;
+    for (int r = 0; r < rounds; r++) {
+        total_busy += busy[r];
+        total_idle += idle[r];
+    }
+
+    fprintf(out, "Wavefront trace, %d threads, %d rounds summed over every call%s:\n", trace->num_threads, rounds,
+            shown < rounds ? " (the 16 with the most idle time)" : "");
+    fprintf(out, "%7s %7s %12s %12s %7s\n", "round", "tiles", "busy_ms", "idle_ms", "idle%");
+    for (int i = 0; i < shown; i++) {
+        int r = order[i];
+        uint64_t all = busy[r] + idle[r];
+        fprintf(out, "%7d %7d %12.3f %12.3f %6.1f%%\n", r, tiles[r], busy[r] / 1e6, idle[r] / 1e6,
+                all ? 100.0 * idle[r] / all : 0.0);
+    }
+    fprintf(out, "%7s %7s %12.3f %12.3f %6.1f%%\n", "total", "", total_busy / 1e6, total_idle / 1e6,
+            total_busy + total_idle ? 100.0 * total_idle / (total_busy + total_idle) : 0.0);
+    if (dropped) fprintf(out, "%lu events were overwritten, raise LSAL_TRACE_EVENTS for the full run\n", dropped);
+
+    free(busy);
+    free(idle);
+    free(tiles);
+    free(order);
+}
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef LSAL_X86_H
+#define LSAL_X86_H
+
+#include <stddef.h>
+#include <time.h>
+
+#include "lsal_perf.h"
+#include "lsal_trace.h"
+
+/*
+ Kernels of the x86 implementations, for drivers that link them in.
+ Build the kernel sources with -DLSAL_NO_MAIN to drop their own main() and helpers.
+ */
+
+void lsal_compute_matrices_u(char *q, char *d, size_t *max_idx, int *similarity, char *direction, size_t N, size_t M);
+void lsal_compute_matrices_o(char *q, char *d, size_t *max_idx, int *similarity, char *direction, size_t N, size_t M);
+
+// OpenMP wavefront: first-touch the matrices from their owning threads before timing it
+void lsal_compute_matrices_omp(const char *q, const char *d, size_t *max_idx, int *similarity, char *direction, size_t N, size_t M);
+void lsal_place_matrices_omp(int *similarity, char *direction, size_t N, size_t M);
+
+// When set, every call adds thread tid's counters to lsal_omp_perf[tid] (one entry per thread)
+extern lsal_perf_counts_t *lsal_omp_perf;
+
+// When set, every thread records its tiles and barrier waits into its ring of lsal_omp_trace
+extern lsal_trace_t *lsal_omp_trace;
+
+// AVX2 stripes, -1 if the per-thread scratch row cannot be mapped; stripe_count holds the
+// stripes finished in int8/int16/int32 by the calling thread's last call
+int lsal_compute_matrices_simd(const char *q, const char *d, size_t *max_idx, int *similarity, char *direction, size_t N, size_t M);
+extern __thread size_t stripe_count[3];
+
+// Monotonic wall-clock time in seconds
+static inline double lsal_wall_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+#endif